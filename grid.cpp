@@ -613,11 +613,14 @@ void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, S
       phiprof::stop("set face neighbor ranks");
    }
 
-   // Prepare cellIDs and pencils for AMR translation
+   // Prepare cellIDs and pencils for AMR translation. Only pencils affected
+   // by the migrated cells are rebuilt.
    if(P::amrMaxSpatialRefLevel > 0) {
       phiprof::start("GetSeedIdsAndBuildPencils");
+      std::unordered_set<CellID> migratedCells(incoming_cells_list.begin(),incoming_cells_list.end());
+      migratedCells.insert(outgoing_cells_list.begin(),outgoing_cells_list.end());
       for (int dimension=0; dimension<3; dimension++) {
-         prepareSeedIdsAndPencils(mpiGrid,dimension);
+         prepareSeedIdsAndPencils(mpiGrid,dimension,migratedCells);
       }
       phiprof::stop("GetSeedIdsAndBuildPencils");
    }
@@ -656,6 +659,10 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
    phiprof::stop("Transfer with_content_list");
    
    //Adjusts velocity blocks in local spatial cells, doesn't adjust velocity blocks in remote cells.
+   //Periodically also reorder the blocks in memory. Only done when the block lists are sent
+   //to remote neighbors afterwards, so that their copies get the new order.
+   const bool reorderBlocks = doPrepareToReceiveBlocks && P::vlasovBlockReorderInterval > 0
+                           && P::tstep % P::vlasovBlockReorderInterval == 0;
 
    phiprof::start("Adjusting blocks");
    #pragma omp parallel for schedule(dynamic)
@@ -684,6 +691,9 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
          }
       }
       cell->adjust_velocity_blocks(neighbor_ptrs,popID);
+      if (reorderBlocks) {
+         cell->reorder_velocity_blocks(popID,P::vlasovBlockReorderMorton);
+      }
 
       if (getObjectWrapper().particleSpecies[popID].sparse_conserve_mass) {
          for (size_t i=0; i<cell->get_number_of_velocity_blocks(popID)*WID3; ++i) {
@@ -776,6 +786,34 @@ void report_grid_memory_consumption(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
    logFile << "(MEM)   Average capacity: " << sum_mem[5]/n_procs << " local cells " << sum_mem[3]/n_procs << " remote cells " << sum_mem[4]/n_procs << endl;
    logFile << "(MEM)   Max capacity:     " << max_mem[2].val   << " on  process " << max_mem[2].rank << endl;
    logFile << "(MEM)   Min capacity:     " << min_mem[2].val   << " on  process " << min_mem[2].rank << endl;
+
+   #ifndef AMR
+   /*report the state of the velocity block hash tables of local cells: sum of load
+    * factors, number of tables, lookups, probed buckets and rehashes. The lookup
+    * counters are zero unless compiled with -DHASHTABLE_STATISTICS.*/
+   double hashStats[5] = {0};
+   double sum_hashStats[5];
+   for (unsigned int i=0; i<cells.size(); i++) {
+      for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
+         if (mpiGrid[cells[i]]->get_velocity_mesh(popID).usesDenseLookup()) continue;
+         const auto& hashtable = mpiGrid[cells[i]]->get_velocity_mesh(popID).getHashtable();
+         hashStats[0] += hashtable.load_factor();
+         hashStats[1] += 1;
+         hashStats[2] += hashtable.lookup_count();
+         hashStats[3] += hashtable.probe_count();
+         hashStats[4] += hashtable.rehash_count();
+      }
+   }
+   MPI_Reduce(hashStats, sum_hashStats, 5, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+   if (sum_hashStats[1] > 0) {
+      logFile << "(MEM) Velocity mesh hash tables: average load factor " << sum_hashStats[0]/sum_hashStats[1];
+      if (sum_hashStats[2] > 0) {
+         logFile << " average probe length " << sum_hashStats[3]/sum_hashStats[2]
+                 << " lookups " << sum_hashStats[2] << " rehashes " << sum_hashStats[4];
+      }
+      logFile << endl;
+   }
+   #endif
    logFile << writeVerbose;
 }
 
@@ -32,6 +32,11 @@
 #ifdef PAPI_MEM
 #include "papi.h" 
 #endif 
+#ifdef USE_BLOCK_POOL
+#include <atomic>
+#include <vector>
+#include <sys/mman.h>
+#endif
 
 extern Logger logFile, diagnostic;
 using namespace std;
@@ -77,6 +82,157 @@ void operator delete[](void *p)
 
 #endif 
 
+#ifdef USE_BLOCK_POOL
+/* Block pool. Velocity block containers resize their storage often, by small amounts,
+ * and are emptied and refilled as cells migrate in load balancing. Allocating all of
+ * that from the heap fragments it. The pool instead hands out buffers in size
+ * classes, eight per power of two, carved from large arenas that are mapped once
+ * and asked to be backed by huge pages. Freed buffers go to a free list of their
+ * class and are reused, they are never coalesced or returned to the system, so the
+ * pool holds at most the peak use of each class, summed over the classes, plus the
+ * unused part of the current arena. Each thread keeps a small cache of free buffers,
+ * the rest are shared under a lock. Buffers larger than the largest class are
+ * allocated directly.
+ */
+namespace {
+   const int BLOCK_POOL_MIN_POWER = 9;                               // Smallest class is 2^9 bytes
+   const int BLOCK_POOL_MAX_POWER = 24;                              // Largest class is 2^24 bytes
+   const int BLOCK_POOL_N_CLASSES = 8*(BLOCK_POOL_MAX_POWER - BLOCK_POOL_MIN_POWER) + 1;
+   const size_t BLOCK_POOL_ARENA_BYTES = (size_t)1 << 28;            // Size of one arena
+   const size_t BLOCK_POOL_THREAD_CACHE_BYTES = (size_t)1 << 22;     // Maximum size of the free buffers cached by a thread
+
+   struct BlockPoolFreeLists {
+      std::vector<void*> buffers[BLOCK_POOL_N_CLASSES];
+      size_t bytes = 0;
+   };
+
+   struct BlockPool {
+      BlockPoolFreeLists shared;
+      char* arenaNext = NULL;          // Start of the unused part of the current arena
+      size_t arenaLeft = 0;            // Size of the unused part of the current arena
+      std::atomic<size_t> arenaBytes{0};
+      std::atomic<size_t> usedBytes{0};
+      std::atomic<size_t> cachedBytes{0}; // Free buffers in the thread caches
+   };
+
+   // The pool and the thread caches are never destroyed, as block containers may
+   // still be freed during static destruction.
+   BlockPool& blockPool() {
+      static BlockPool* pool = new BlockPool();
+      return *pool;
+   }
+
+   BlockPoolFreeLists& threadBlockCache() {
+      static thread_local BlockPoolFreeLists* cache = NULL;
+      if (cache == NULL) cache = new BlockPoolFreeLists();
+      return *cache;
+   }
+
+   size_t blockPoolClassSize(const int sizeClass) {
+      return (size_t)(8 + sizeClass % 8) << (BLOCK_POOL_MIN_POWER - 3 + sizeClass / 8);
+   }
+
+   // Smallest size class holding size bytes
+   int blockPoolSizeClass(const size_t size) {
+      if (size <= blockPoolClassSize(0)) return 0;
+      const size_t v = size - 1;
+      int power = BLOCK_POOL_MIN_POWER;
+      while ((v >> (power + 1)) != 0) ++power;
+      const int sub = (int)(v >> (power - 3)) - 8;
+      return 8*(power - BLOCK_POOL_MIN_POWER) + sub + 1;
+   }
+
+   // Take a new buffer of the given class from the current arena, mapping a new arena
+   // if needed. The remainder of a full arena is split into buffers of smaller classes.
+   // Call only inside the blockPool critical section.
+   void* blockPoolCarve(BlockPool& pool, const int sizeClass) {
+      const size_t bytes = blockPoolClassSize(sizeClass);
+      if (pool.arenaLeft < bytes) {
+         while (pool.arenaLeft >= blockPoolClassSize(0)) {
+            int c = blockPoolSizeClass(pool.arenaLeft);
+            if (blockPoolClassSize(c) > pool.arenaLeft) --c;
+            pool.shared.buffers[c].push_back(pool.arenaNext);
+            pool.shared.bytes += blockPoolClassSize(c);
+            pool.arenaNext += blockPoolClassSize(c);
+            pool.arenaLeft -= blockPoolClassSize(c);
+         }
+         void* arena = mmap(NULL, BLOCK_POOL_ARENA_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         if (arena == MAP_FAILED) return NULL;
+         #ifdef MADV_HUGEPAGE
+         madvise(arena, BLOCK_POOL_ARENA_BYTES, MADV_HUGEPAGE);
+         #endif
+         pool.arenaNext = (char*)arena;
+         pool.arenaLeft = BLOCK_POOL_ARENA_BYTES;
+         pool.arenaBytes += BLOCK_POOL_ARENA_BYTES;
+      }
+      void* p = pool.arenaNext;
+      pool.arenaNext += bytes;
+      pool.arenaLeft -= bytes;
+      return p;
+   }
+}
+
+void * block_pool_malloc(size_t size) {
+   if (size == 0) return NULL;
+   BlockPool& pool = blockPool();
+   if (size > blockPoolClassSize(BLOCK_POOL_N_CLASSES - 1)) {
+      void* p = aligned_malloc(size, BLOCK_POOL_ALIGNMENT);
+      if (p != NULL) pool.usedBytes += size;
+      return p;
+   }
+
+   const int sizeClass = blockPoolSizeClass(size);
+   const size_t bytes = blockPoolClassSize(sizeClass);
+   BlockPoolFreeLists& cache = threadBlockCache();
+   void* p = NULL;
+   if (cache.buffers[sizeClass].empty() == false) {
+      p = cache.buffers[sizeClass].back();
+      cache.buffers[sizeClass].pop_back();
+      cache.bytes -= bytes;
+      pool.cachedBytes -= bytes;
+   } else {
+      #pragma omp critical(blockPool)
+      {
+         if (pool.shared.buffers[sizeClass].empty() == false) {
+            p = pool.shared.buffers[sizeClass].back();
+            pool.shared.buffers[sizeClass].pop_back();
+            pool.shared.bytes -= bytes;
+         } else {
+            p = blockPoolCarve(pool, sizeClass);
+         }
+      }
+   }
+   if (p != NULL) pool.usedBytes += bytes;
+   return p;
+}
+
+void block_pool_free(void *p, size_t size) {
+   if (p == NULL) return;
+   BlockPool& pool = blockPool();
+   if (size > blockPoolClassSize(BLOCK_POOL_N_CLASSES - 1)) {
+      aligned_free(p);
+      pool.usedBytes -= size;
+      return;
+   }
+
+   const int sizeClass = blockPoolSizeClass(size);
+   const size_t bytes = blockPoolClassSize(sizeClass);
+   pool.usedBytes -= bytes;
+   BlockPoolFreeLists& cache = threadBlockCache();
+   if (cache.bytes + bytes <= BLOCK_POOL_THREAD_CACHE_BYTES) {
+      cache.buffers[sizeClass].push_back(p);
+      cache.bytes += bytes;
+      pool.cachedBytes += bytes;
+   } else {
+      #pragma omp critical(blockPool)
+      {
+         pool.shared.buffers[sizeClass].push_back(p);
+         pool.shared.bytes += bytes;
+      }
+   }
+}
+#endif
+
 
 /*! Return the amount of free memory on the node in bytes*/  
 uint64_t get_node_free_memory(){
@@ -180,6 +336,25 @@ void report_process_memory_consumption(){
    logFile << writeVerbose;
    */
 
+#ifdef USE_BLOCK_POOL
+   /*Report the memory mapped for, used from and held free in the block pool. Free
+     buffers are only reused for their own size class.*/
+   {
+      BlockPool& pool = blockPool();
+      size_t sharedFreeBytes;
+      #pragma omp critical(blockPool)
+      sharedFreeBytes = pool.shared.bytes;
+      double mem_pool[3] = {(double)pool.arenaBytes, (double)pool.usedBytes, (double)(sharedFreeBytes + pool.cachedBytes)};
+      double sum_mem_pool[3];
+      double max_mem_pool[3];
+      MPI_Reduce(mem_pool, sum_mem_pool, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      MPI_Reduce(mem_pool, max_mem_pool, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      logFile << "(MEM) Block pool arenas per process (GiB) avg: " << sum_mem_pool[0]/nProcs/GiB << " max: " << max_mem_pool[0]/GiB
+              << ", in use avg: " << sum_mem_pool[1]/nProcs/GiB << " max: " << max_mem_pool[1]/GiB
+              << ", in free lists avg: " << sum_mem_pool[2]/nProcs/GiB << " max: " << max_mem_pool[2]/GiB << endl;
+   }
+#endif
+
    MPI_Comm_free(&interComm);
    MPI_Comm_free(&nodeComm);
 
@@ -228,5 +228,100 @@ private:
    aligned_allocator& operator=(const aligned_allocator&);
 };
 
+#ifdef USE_BLOCK_POOL
+
+/*! Alignment of all memory returned by block_pool_malloc, in bytes*/
+const std::size_t BLOCK_POOL_ALIGNMENT = 64;
+
+/*! Allocate memory for velocity block data from the block pool of this process,
+ *  see memoryallocation.cpp. Returns NULL if the allocation fails. Thread-safe.*/
+void * block_pool_malloc(std::size_t size);
+
+/*! Return memory allocated with block_pool_malloc to the block pool. The size must
+ *  be the one given to block_pool_malloc. Thread-safe.*/
+void block_pool_free(void *p, std::size_t size);
+
+/**
+ * Allocator drawing its memory from the block pool. Stateless like aligned_allocator,
+ * so containers using it can be swapped and copied freely.
+ */
+template <typename T, std::size_t Alignment>
+class block_pool_allocator
+{
+public:
+   static_assert(Alignment <= BLOCK_POOL_ALIGNMENT, "block_pool_allocator: alignment exceeds BLOCK_POOL_ALIGNMENT");
+
+   typedef T * pointer;
+   typedef const T * const_pointer;
+   typedef T& reference;
+   typedef const T& const_reference;
+   typedef T value_type;
+   typedef std::size_t size_type;
+   typedef ptrdiff_t difference_type;
+
+   std::size_t max_size() const
+      {
+         return (static_cast<std::size_t>(0) - static_cast<std::size_t>(1)) / sizeof(T);
+      }
+
+   template <typename U>
+   struct rebind
+   {
+      typedef block_pool_allocator<U, Alignment> other;
+   } ;
+
+   bool operator!=(const block_pool_allocator& other) const
+      {
+         return !(*this == other);
+      }
+
+   bool operator==(const block_pool_allocator& other) const
+      {
+         return true;
+      }
+
+   block_pool_allocator() { }
+
+   block_pool_allocator(const block_pool_allocator&) { }
+
+   template <typename U> block_pool_allocator(const block_pool_allocator<U, Alignment>&) { }
+
+   ~block_pool_allocator() { }
+
+   T * allocate(const std::size_t n) const
+      {
+         if (n == 0) {
+            return NULL;
+         }
+         if (n > max_size())
+         {
+            throw std::length_error("block_pool_allocator<T>::allocate() - Integer overflow.");
+         }
+         void * const pv = block_pool_malloc(n * sizeof(T));
+         if (pv == NULL)
+         {
+            throw std::bad_alloc();
+         }
+         return static_cast<T *>(pv);
+      }
+
+   void deallocate(T * const p, const std::size_t n) const
+      {
+         block_pool_free(p, n * sizeof(T));
+      }
+
+private:
+   block_pool_allocator& operator=(const block_pool_allocator&);
+};
+
+/*! Allocator of velocity block data and block parameters*/
+template <typename T, std::size_t Alignment> using block_allocator = block_pool_allocator<T, Alignment>;
+
+#else
+
+/*! Allocator of velocity block data and block parameters*/
+template <typename T, std::size_t Alignment> using block_allocator = aligned_allocator<T, Alignment>;
+
+#endif
 
 #endif
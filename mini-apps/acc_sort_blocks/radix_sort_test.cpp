@@ -0,0 +1,58 @@
+/* Check radixSortBlockPairs against std::stable_sort, also for keys at and above 2^22
+ * where the last digit of the radix sort reaches the top bits of the key.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../../vlasovsolver/cpu_acc_radix_sort.hpp"
+
+using namespace std;
+
+static bool checkSort(const vmesh::GlobalID maxKey,const size_t n,mt19937& rng) {
+   uniform_int_distribution<vmesh::GlobalID> keys(0, maxKey);
+   vector<pair<vmesh::GlobalID,vmesh::GlobalID> > pairs(n);
+   for (size_t i = 0; i < n; ++i) {
+      pairs[i] = make_pair(keys(rng), (vmesh::GlobalID)i);
+   }
+   pairs[0].first = maxKey;
+   vector<pair<vmesh::GlobalID,vmesh::GlobalID> > reference(pairs);
+   stable_sort(reference.begin(), reference.end(),
+               [](const pair<vmesh::GlobalID,vmesh::GlobalID>& l, const pair<vmesh::GlobalID,vmesh::GlobalID>& r) {
+                  return l.first < r.first;
+               });
+   radixSortBlockPairs(pairs, maxKey);
+   if (pairs != reference) {
+      cerr << "FAILED: radix sort differs from std::stable_sort for maxKey " << maxKey << endl;
+      return false;
+   }
+   return true;
+}
+
+int main() {
+   mt19937 rng(12345);
+   bool ok = true;
+
+   // Number of passes, one per RADIX_SORT_BITS digit of the key
+   const vmesh::GlobalID passKeys[] = {0, 2047, 2048, (1u << 22) - 1, 1u << 22, 256*256*256 - 1, 0xffffffffu};
+   const uint expectedPasses[] = {1, 1, 2, 2, 3, 3, 3};
+   for (uint i = 0; i < sizeof(passKeys) / sizeof(passKeys[0]); ++i) {
+      if (radixSortPasses(passKeys[i]) != expectedPasses[i]) {
+         cerr << "FAILED: " << radixSortPasses(passKeys[i]) << " passes for maxKey " << passKeys[i]
+              << ", expected " << expectedPasses[i] << endl;
+         ok = false;
+      }
+   }
+
+   const vmesh::GlobalID sortKeys[] = {1000, (1u << 22) - 1, 1u << 22, 256*256*256 - 1, 0xffffffffu};
+   for (const vmesh::GlobalID maxKey : sortKeys) {
+      ok = checkSort(maxKey, 100000, rng) && ok;
+   }
+
+   if (!ok) return EXIT_FAILURE;
+   cout << "radix_sort_test passed" << endl;
+   return EXIT_SUCCESS;
+}
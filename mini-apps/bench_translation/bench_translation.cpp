@@ -0,0 +1,342 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Standalone benchmark of the spatial translation. Sets up a synthetic
+ * periodic grid, uniform or with one level of refinement in its central
+ * part, fills every cell with the same number of velocity blocks of a
+ * Maxwellian-like distribution and runs the production translation
+ * (calculateSpatialTranslation, i.e. trans_map_1d or trans_map_1d_amr and
+ * propagatePencil) for a number of steps. Built with "make bench_translation".
+ *
+ * Usage: mpirun -n <ranks> ./bench_translation [options]
+ *   --cells nx ny nz   Number of spatial cells at refinement level 0 (default 16 16 16)
+ *   --blocks n         Number of velocity blocks per spatial cell (default 1000)
+ *   --steps n          Number of translation steps (default 10)
+ *   --cfl c            Translation CFL number (default 0.5)
+ *   --amr              Refine the central half of the grid once
+ *   --split            Enable vlasovsolver.splitPhaseTranslation
+ *   --combined         Enable vlasovsolver.combinedPopulationTransfer
+ *   --fused n          Enable vlasovsolver.fusedTileTranslation with tiles of n cells
+ *
+ * The throughput is reported in mapped blocks per second, one block mapped
+ * in one dimension counting once, and in the corresponding bytes read and
+ * written per second. The per-phase timings are written by phiprof into
+ * phiprof_bench_translation_*.txt.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <mpi.h>
+#include <phiprof.hpp>
+
+#include "../../common.h"
+#include "../../definitions.h"
+#include "../../grid.h"
+#include "../../logger.h"
+#include "../../object_wrapper.h"
+#include "../../parameters.h"
+#include "../../spatial_cell.hpp"
+#include "../../vlasovmover.h"
+#include "../../vlasovsolver/cpu_trans_map_amr.hpp"
+
+using namespace std;
+using namespace spatial_cell;
+
+typedef Parameters P;
+
+Logger logFile, diagnostic;
+int globalflags::bailingOut = 0;
+bool globalflags::writeRestart = 0;
+bool globalflags::balanceLoad = 0;
+ObjectWrapper objectWrapper;
+ObjectWrapper& getObjectWrapper() {
+   return objectWrapper;
+}
+
+// Defined in grid.cpp
+void initVelocityGridGeometry(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+void initSpatialCellCoordinates(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+void initializeStencils(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+
+static void usage(const char* name) {
+   cerr << "Usage: " << name << " [--cells nx ny nz] [--blocks n] [--steps n] [--cfl c] [--amr] [--split] [--combined] [--fused n]" << endl;
+}
+
+/* Create one population whose velocity mesh is a cube just large enough to
+ * hold a sphere of nBlocks blocks, with the velocity range -1..1 in every
+ * direction.
+ */
+static void initializePopulation(const uint nBlocks) {
+   const uint blocksPerDim = min<uint>(MAX_BLOCKS_PER_DIM, ceil(cbrt(2.0 * nBlocks)) + 2);
+
+   species::Species species;
+   vmesh::MeshParameters vMesh;
+   species.name = vMesh.name = "proton";
+   species.velocityMesh = getObjectWrapper().velocityMeshes.size();
+   getObjectWrapper().particleSpecies.push_back(species);
+   getObjectWrapper().velocityMeshes.push_back(vMesh);
+
+   species::Species& pop = getObjectWrapper().particleSpecies.back();
+   pop.charge = physicalconstants::CHARGE;
+   pop.mass = physicalconstants::MASS_PROTON;
+   pop.sparseMinValue = 1.0e-30;
+   pop.ghostTransferCompression = false;
+   pop.ghostTransferCompressionThreshold = 0.1;
+
+   vmesh::MeshParameters& mesh = getObjectWrapper().velocityMeshes.back();
+   for (uint d = 0; d < 3; ++d) {
+      mesh.meshLimits[2 * d] = -1.0;
+      mesh.meshLimits[2 * d + 1] = 1.0;
+      mesh.gridLength[d] = blocksPerDim;
+      mesh.blockLength[d] = WID;
+   }
+   mesh.refLevelMaxAllowed = 0;
+}
+
+/* Fill the local cells with the nBlocks blocks closest to the center of the
+ * velocity mesh. The values are a Maxwellian-like function of velocity with
+ * a density that varies smoothly in space.
+ */
+static void initializeBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             const uint nBlocks,
+                             const uint popID) {
+   const vmesh::MeshParameters& mesh = getObjectWrapper().velocityMeshes[popID];
+   const int blocksPerDim = mesh.gridLength[0];
+   const Real center = 0.5 * (blocksPerDim - 1);
+
+   // Blocks sorted by their distance from the center of the mesh
+   vector<pair<Real,array<int,3> > > blocks;
+   for (int k = 0; k < blocksPerDim; ++k) {
+      for (int j = 0; j < blocksPerDim; ++j) {
+         for (int i = 0; i < blocksPerDim; ++i) {
+            const Real r2 = (i - center) * (i - center) + (j - center) * (j - center) + (k - center) * (k - center);
+            blocks.push_back(make_pair(r2, array<int,3>{{i, j, k}}));
+         }
+      }
+   }
+   sort(blocks.begin(), blocks.end(),
+        [](const pair<Real,array<int,3> >& a, const pair<Real,array<int,3> >& b) { return a.first < b.first; });
+   blocks.resize(min<size_t>(nBlocks, blocks.size()));
+   const Real radius = sqrt(blocks.back().first) + 1.0;
+   const Real sigma2 = (radius * WID / 3.0) * (radius * WID / 3.0);
+
+   const vector<CellID>& cells = getLocalCells();
+   #pragma omp parallel for schedule(dynamic,1)
+   for (size_t c = 0; c < cells.size(); ++c) {
+      SpatialCell* cell = mpiGrid[cells[c]];
+      const Real x = cell->parameters[CellParams::XCRD] / (P::xmax - P::xmin);
+      const Real y = cell->parameters[CellParams::YCRD] / (P::ymax - P::ymin);
+      const Real z = cell->parameters[CellParams::ZCRD] / (P::zmax - P::zmin);
+      const Real density = 1.0 + 0.5 * sin(2 * M_PI * x) * cos(2 * M_PI * y) * cos(2 * M_PI * z);
+
+      for (size_t b = 0; b < blocks.size(); ++b) {
+         const array<int,3>& indices = blocks[b].second;
+         const vmesh::GlobalID blockGID = cell->get_velocity_mesh(popID).getGlobalID(0, indices[0], indices[1], indices[2]);
+         cell->add_velocity_block(blockGID, popID);
+         Realf* data = cell->get_data(cell->get_velocity_block_local_id(blockGID, popID), popID);
+         for (uint kc = 0; kc < WID; ++kc) {
+            for (uint jc = 0; jc < WID; ++jc) {
+               for (uint ic = 0; ic < WID; ++ic) {
+                  const Real vx = indices[0] * WID + ic + 0.5 - center * WID - 0.5 * WID;
+                  const Real vy = indices[1] * WID + jc + 0.5 - center * WID - 0.5 * WID;
+                  const Real vz = indices[2] * WID + kc + 0.5 - center * WID - 0.5 * WID;
+                  data[ic + jc * WID + kc * WID2] = density * exp(-(vx * vx + vy * vy + vz * vz) / (2 * sigma2));
+               }
+            }
+         }
+      }
+   }
+}
+
+int main(int argc, char* argv[]) {
+   int required = MPI_THREAD_FUNNELED;
+   int provided, myRank;
+   MPI_Init_thread(&argc, &argv, required, &provided);
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   if (required > provided) {
+      if (myRank == MASTER_RANK) cerr << "(MAIN): MPI_Init_thread failed! Got " << provided << ", need " << required << endl;
+      exit(1);
+   }
+   phiprof::initialize();
+   logFile.open(MPI_COMM_WORLD, MASTER_RANK, "logfile_bench_translation.txt");
+
+   uint cells[3] = {16, 16, 16};
+   uint nBlocks = 1000;
+   uint nSteps = 10;
+   Real cfl = 0.5;
+   bool amr = false;
+   for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--cells") == 0 && i + 3 < argc) {
+         for (uint d = 0; d < 3; ++d) cells[d] = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) {
+         nBlocks = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+         nSteps = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--cfl") == 0 && i + 1 < argc) {
+         cfl = atof(argv[++i]);
+      } else if (strcmp(argv[i], "--amr") == 0) {
+         amr = true;
+      } else if (strcmp(argv[i], "--split") == 0) {
+         P::vlasovSplitPhaseTranslation = true;
+      } else if (strcmp(argv[i], "--combined") == 0) {
+         P::vlasovCombinedPopulationTransfer = true;
+      } else if (strcmp(argv[i], "--fused") == 0 && i + 1 < argc) {
+         P::vlasovFusedTileTranslation = true;
+         P::vlasovFusedTileSize = atoi(argv[++i]);
+      } else {
+         if (myRank == MASTER_RANK) usage(argv[0]);
+         MPI_Finalize();
+         return 1;
+      }
+   }
+
+   // Spatial grid of unit cells
+   P::xcells_ini = cells[0];
+   P::ycells_ini = cells[1];
+   P::zcells_ini = cells[2];
+   P::xmin = P::ymin = P::zmin = 0.0;
+   P::xmax = cells[0];
+   P::ymax = cells[1];
+   P::zmax = cells[2];
+   P::dx_ini = P::dy_ini = P::dz_ini = 1.0;
+   P::amrMaxSpatialRefLevel = amr ? 1 : 0;
+   P::loadBalanceAlgorithm = "RCB";
+   initializePopulation(nBlocks);
+
+   float zoltanVersion;
+   if (Zoltan_Initialize(argc, argv, &zoltanVersion) != ZOLTAN_OK) {
+      if (myRank == MASTER_RANK) cerr << "\t ERROR: Zoltan initialization failed." << endl;
+      exit(1);
+   }
+
+   phiprof::start("Initialization");
+   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry> mpiGrid;
+   // Same neighborhood extension for AMR as in initializeGrids()
+   const int neighborhoodSize = amr ? 2 * VLASOV_STENCIL_WIDTH - 1 : VLASOV_STENCIL_WIDTH;
+   globalflags::AMRstencilWidth = neighborhoodSize;
+   const std::array<uint64_t, 3> gridLength = {{P::xcells_ini, P::ycells_ini, P::zcells_ini}};
+   dccrg::Cartesian_Geometry::Parameters geometryParameters;
+   geometryParameters.start[0] = P::xmin;
+   geometryParameters.start[1] = P::ymin;
+   geometryParameters.start[2] = P::zmin;
+   geometryParameters.level_0_cell_length[0] = P::dx_ini;
+   geometryParameters.level_0_cell_length[1] = P::dy_ini;
+   geometryParameters.level_0_cell_length[2] = P::dz_ini;
+   mpiGrid.set_initial_length(gridLength)
+      .set_load_balancing_method(&P::loadBalanceAlgorithm[0])
+      .set_neighborhood_length(neighborhoodSize)
+      .set_maximum_refinement_level(P::amrMaxSpatialRefLevel)
+      .set_periodic(true, true, true)
+      .initialize(MPI_COMM_WORLD)
+      .set_geometry(geometryParameters);
+
+   if (amr) {
+      for (uint k = cells[2] / 4; k < cells[2] - cells[2] / 4; ++k) {
+         for (uint j = cells[1] / 4; j < cells[1] - cells[1] / 4; ++j) {
+            for (uint i = cells[0] / 4; i < cells[0] - cells[0] / 4; ++i) {
+               const std::array<double,3> xyz = {{i + 0.5, j + 0.5, k + 0.5}};
+               mpiGrid.refine_completely_at(xyz);
+            }
+         }
+      }
+      mpiGrid.stop_refining(true);
+   }
+
+   initVelocityGridGeometry(mpiGrid);
+   initializeStencils(mpiGrid);
+   mpiGrid.balance_load();
+   recalculateLocalCellsCache();
+   if (amr) {
+      setFaceNeighborRanks(mpiGrid);
+   }
+   initSpatialCellCoordinates(mpiGrid);
+
+   const vector<CellID>& localCells = getLocalCells();
+   for (size_t c = 0; c < localCells.size(); ++c) {
+      mpiGrid[localCells[c]]->sysBoundaryFlag = sysboundarytype::NOT_SYSBOUNDARY;
+      mpiGrid[localCells[c]]->sysBoundaryLayer = 0;
+   }
+   flagSpatialCellsForAmrCommunication(mpiGrid, localCells);
+   SpatialCell::set_mpi_transfer_type(Transfer::ALL_SPATIAL_DATA);
+   mpiGrid.update_copies_of_remote_neighbors(FULL_NEIGHBORHOOD_ID);
+
+   const uint popID = 0;
+   initializeBlocks(mpiGrid, nBlocks, popID);
+   updateRemoteVelocityBlockLists(mpiGrid, popID, FULL_NEIGHBORHOOD_ID);
+   if (amr) {
+      for (int dimension = 0; dimension < 3; ++dimension) {
+         prepareSeedIdsAndPencils(mpiGrid, dimension);
+      }
+   }
+   phiprof::stop("Initialization");
+
+   // Time step from the CFL condition in the smallest cells, the maximum
+   // velocity of the mesh is 1 in every direction
+   const Real dx = P::dx_ini / (1 << P::amrMaxSpatialRefLevel);
+   const Real dt = cfl * dx;
+
+   uint64_t localBlocks = 0;
+   for (size_t c = 0; c < localCells.size(); ++c) {
+      localBlocks += mpiGrid[localCells[c]]->get_number_of_velocity_blocks(popID);
+   }
+   uint64_t totalBlocks = 0;
+   MPI_Allreduce(&localBlocks, &totalBlocks, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+   uint64_t totalCells = 0;
+   uint64_t nLocalCells = localCells.size();
+   MPI_Allreduce(&nLocalCells, &totalCells, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+   const uint nDimensions = (cells[0] > 1) + (cells[1] > 1) + (cells[2] > 1);
+
+   // One step untimed, to reach a steady state of the allocations
+   calculateSpatialTranslation(mpiGrid, dt);
+
+   MPI_Barrier(MPI_COMM_WORLD);
+   phiprof::start("Translation steps");
+   const double t0 = MPI_Wtime();
+   for (uint step = 0; step < nSteps; ++step) {
+      calculateSpatialTranslation(mpiGrid, dt);
+   }
+   MPI_Barrier(MPI_COMM_WORLD);
+   const double time = MPI_Wtime() - t0;
+   phiprof::stop("Translation steps");
+
+   if (myRank == MASTER_RANK) {
+      int nRanks;
+      MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+      const double mappedBlocks = (double)totalBlocks * nDimensions * nSteps;
+      const double bytes = mappedBlocks * 2 * WID3 * sizeof(Realf);
+      cout << "Translation benchmark: " << totalCells << " cells" << (amr ? " (AMR)" : "")
+           << ", " << totalBlocks << " blocks, " << nRanks << " ranks, " << nSteps << " steps" << endl;
+      cout << "   time per step   " << time / nSteps << " s" << endl;
+      cout << "   blocks/s        " << mappedBlocks / time << endl;
+      cout << "   bytes/s         " << bytes / time << endl;
+   }
+
+   phiprof::print(MPI_COMM_WORLD, "phiprof_bench_translation");
+   logFile.close();
+   MPI_Finalize();
+   return 0;
+}
@@ -0,0 +1,53 @@
+/* Check that a velocity mesh constructed before the mesh parameters exist, the way
+ * dccrg constructs the cells in grid.cpp before initVelocityGridGeometry, uses the
+ * dense lookup table once blocks are added to a mesh with denseLookup set.
+ */
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "velocity_mesh_old.h"
+
+using namespace std;
+
+int main() {
+   bool ok = true;
+
+   // Cell constructor, mesh parameters not set up yet
+   vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID> vmesh;
+   vmesh.initialize(0);
+
+   // initVelocityGridGeometry
+   vector<vmesh::MeshParameters> meshes(1);
+   meshes[0].meshLimits[0] = -1.0; meshes[0].meshLimits[1] = 1.0;
+   meshes[0].meshLimits[2] = -1.0; meshes[0].meshLimits[3] = 1.0;
+   meshes[0].meshLimits[4] = -1.0; meshes[0].meshLimits[5] = 1.0;
+   for (int i = 0; i < 3; ++i) {
+      meshes[0].gridLength[i] = 10;
+      meshes[0].blockLength[i] = 4;
+   }
+   meshes[0].refLevelMaxAllowed = 0;
+   meshes[0].denseLookup = true;
+   vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID> dummy;
+   dummy.initialize(0,meshes);
+
+   for (vmesh::GlobalID gid = 0; gid < 1000; gid += 7) {
+      if (vmesh.push_back(gid) == false) {
+         cerr << "FAILED: could not add block " << gid << endl;
+         ok = false;
+      }
+   }
+   if (vmesh.usesDenseLookup() == false) {
+      cerr << "FAILED: mesh created before initVelocityGridGeometry does not use the dense lookup" << endl;
+      ok = false;
+   }
+   if (vmesh.getLocalID(14) != 2 || vmesh.getLocalID(15) != vmesh::INVALID_LOCALID) {
+      cerr << "FAILED: wrong local IDs from the dense lookup" << endl;
+      ok = false;
+   }
+   vmesh.check();
+
+   if (ok) cout << "PASSED" << endl;
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -52,6 +52,8 @@ bool ObjectWrapper::addPopulationParameters() {
      RP::add(pop + "_sparse.dynamicMinValue2", "The maximum value (value 2) for the dynamic minValue", 1);
      RP::add(pop + "_sparse.dynamicBulkValue1", "Minimum value for the dynamic algorithm range, so for example if dynamicAlgorithm=1 then for sparse.dynamicBulkValue1 = 1e3, sparse.dynamicBulkValue2=1e5, we apply the algorithm to cells for which 1e3<cell.rho<1e5", 0);
      RP::add(pop + "_sparse.dynamicBulkValue2", "Maximum value for the dynamic algorithm range, so for example if dynamicAlgorithm=1 then for sparse.dynamicBulkValue1 = 1e3, sparse.dynamicBulkValue2=1e5, we apply the algorithm to cells for which 1e3<cell.rho<1e5", 0);
+     RP::add(pop + "_sparse.ghostTransferCompression", "If true, the ghost cell data of this population is compressed in translation MPI transfers. Values below ghostTransferCompressionThreshold times the sparsity threshold of the cell are sent as zeros.", false);
+     RP::add(pop + "_sparse.ghostTransferCompressionThreshold", "Fraction of the sparsity threshold of the cell below which values are not sent in compressed ghost transfers", 0.1);
 
      // Grid parameters
      RP::add(pop + "_vspace.vx_min","Minimum value for velocity mesh vx-coordinates.",0);
@@ -64,6 +66,7 @@ bool ObjectWrapper::addPopulationParameters() {
      RP::add(pop + "_vspace.vy_length","Initial number of velocity blocks in vy-direction.",1);
      RP::add(pop + "_vspace.vz_length","Initial number of velocity blocks in vz-direction.",1);
      RP::add(pop + "_vspace.max_refinement_level","Maximum allowed mesh refinement level.", 1);
+     RP::add(pop + "_vspace.dense_lookup","If true, velocity blocks are looked up from a table with an entry for every block of the mesh instead of a hash table. Faster for small, mostly filled meshes, but costs 4 bytes per possible block in every spatial cell with blocks.", false);
      
      // Thermal / suprathermal parameters
      Readparameters::add(pop + "_thermal.vx", "Center coordinate for the maxwellian distribution. Used for calculating the suprathermal moments.", -500000.0);
@@ -132,6 +135,8 @@ bool ObjectWrapper::getParameters() {
       RP::get(pop + "_sparse.dynamicBulkValue2", species.sparseDynamicBulkValue2);
       RP::get(pop + "_sparse.dynamicMinValue1", species.sparseDynamicMinValue1);
       RP::get(pop + "_sparse.dynamicMinValue2", species.sparseDynamicMinValue2);
+      RP::get(pop + "_sparse.ghostTransferCompression", species.ghostTransferCompression);
+      RP::get(pop + "_sparse.ghostTransferCompressionThreshold", species.ghostTransferCompressionThreshold);
 
 
       // Particle velocity space properties
@@ -159,6 +164,7 @@ bool ObjectWrapper::getParameters() {
       int maxRefLevel; // Temporary variable, since target value is a uint8_t
       RP::get(pop + "_vspace.max_refinement_level",maxRefLevel);
       vMesh.refLevelMaxAllowed = maxRefLevel;
+      RP::get(pop + "_vspace.dense_lookup",vMesh.denseLookup);
 
       
       //Get thermal / suprathermal moments parameters
@@ -22,17 +22,34 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
 #include "definitions.h"
 
-// Open bucket power-of-two sized hash table with multiplicative fibonacci hashing
+// Open bucket power-of-two sized hash table with multiplicative fibonacci hashing.
+//
+// An element whose key hashes to h is stored in one of the maxBucketOverflow buckets
+// h, h+1, ..., h+maxBucketOverflow-1, its probe group. The bucket array has
+// maxBucketOverflow-1 extra buckets after the 2^sizePower hashed ones, so a probe group
+// never wraps around. All keys of a group are compared with a fixed-length loop without
+// branches, building a bit mask of the matches. As lookups always check the whole group, erase only
+// empties the bucket of the element, and probing does not degrade with erases.
+//
+// If HASHTABLE_STATISTICS is defined, the table counts lookups, probed buckets and
+// rehashes, see lookup_count, probe_count and rehash_count. Const lookups may run
+// concurrently from several threads, so their counters are relaxed atomics.
 template <typename GID, typename LID, int maxBucketOverflow = 4, GID EMPTYBUCKET = vmesh::INVALID_GLOBALID > class OpenBucketHashtable {
 private:
-   int sizePower; // Logarithm (base two) of the size of the table
+   int sizePower; // Logarithm (base two) of the number of hashed buckets
    size_t fill;   // Number of filled buckets
    std::vector<std::pair<GID, LID>> buckets;
+#ifdef HASHTABLE_STATISTICS
+   mutable std::atomic<size_t> nLookups; // Number of lookups and insertions
+   mutable std::atomic<size_t> nProbes;  // Number of buckets probed by them, up to the match
+   size_t nRehashes;        // Number of times the table has been grown
+#endif
 
    // Fibonacci hash function for 64bit values
    uint32_t fibonacci_hash(GID in) const {
@@ -63,97 +80,187 @@ private:
        }
     }
 
+   // Number of buckets for the given size power, including the overflow buckets after the hashed ones
+   static size_t bucketArraySize(int power) {
+      return ((size_t)1 << power) + maxBucketOverflow - 1;
+   }
+
+   // First bucket of the probe group of the key
+   size_t groupStart(const GID& key) const {
+      return hash(key) & (((size_t)1 << sizePower) - 1);
+   }
+
+   // Compare all buckets of the probe group starting at bucket start. Bit i of
+   // keyMask (emptyMask) is set if bucket start+i holds the key (is empty).
+   void probeGroup(size_t start, const GID& key, uint32_t& keyMask, uint32_t& emptyMask) const {
+      const std::pair<GID, LID>* group = buckets.data() + start;
+      keyMask = 0;
+      emptyMask = 0;
+      for (int i = 0; i < maxBucketOverflow; i++) {
+         keyMask |= (uint32_t)(group[i].first == key) << i;
+         emptyMask |= (uint32_t)(group[i].first == EMPTYBUCKET) << i;
+      }
+   }
+
+   // Index of the lowest set bit, mask must be non-zero
+   static int lowestBit(uint32_t mask) {
+#ifdef __GNUC__
+      return __builtin_ctz(mask);
+#else
+      int i = 0;
+      while ((mask & 1) == 0) {
+         mask >>= 1;
+         i++;
+      }
+      return i;
+#endif
+   }
+
+   // Count a lookup that probed nProbed buckets
+   void countLookup([[maybe_unused]] int nProbed) const {
+#ifdef HASHTABLE_STATISTICS
+      nLookups.fetch_add(1, std::memory_order_relaxed);
+      nProbes.fetch_add(nProbed, std::memory_order_relaxed);
+#endif
+   }
+
+   // Index of the bucket holding the key, or buckets.size() if it does not exist
+   size_t findIndex(const GID& key) const {
+      const size_t start = groupStart(key);
+      uint32_t keyMask, emptyMask;
+      probeGroup(start, key, keyMask, emptyMask);
+      if (keyMask != 0) {
+         countLookup(lowestBit(keyMask) + 1);
+         return start + lowestBit(keyMask);
+      }
+      countLookup(maxBucketOverflow);
+      return buckets.size();
+   }
+
+   // Index of the bucket holding the key. If the key does not exist, it is
+   // stored in the first empty bucket of its group and created is set to true.
+   size_t findOrCreateIndex(const GID& key, bool& created) {
+      while (true) {
+         const size_t start = groupStart(key);
+         uint32_t keyMask, emptyMask;
+         probeGroup(start, key, keyMask, emptyMask);
+         if (keyMask != 0) {
+            countLookup(lowestBit(keyMask) + 1);
+            created = false;
+            return start + lowestBit(keyMask);
+         }
+         if (emptyMask != 0) {
+            countLookup(maxBucketOverflow);
+            const size_t index = start + lowestBit(emptyMask);
+            buckets[index].first = key;
+            fill++;
+            created = true;
+            return index;
+         }
+         // Not found, and we have no free slots to create a new one. So we need to rehash to a larger size.
+         rehash(sizePower + 1);
+      }
+   }
+
 public:
    OpenBucketHashtable()
-       : sizePower(4), fill(0), buckets(1 << sizePower, std::pair<GID, LID>(EMPTYBUCKET, LID())){};
+       : sizePower(4), fill(0), buckets(bucketArraySize(sizePower), std::pair<GID, LID>(EMPTYBUCKET, LID())) {
+#ifdef HASHTABLE_STATISTICS
+      nLookups = 0;
+      nProbes = 0;
+      nRehashes = 0;
+#endif
+   }
    OpenBucketHashtable(const OpenBucketHashtable<GID, LID>& other)
-       : sizePower(other.sizePower), fill(other.fill), buckets(other.buckets){};
+       : sizePower(other.sizePower), fill(other.fill), buckets(other.buckets) {
+#ifdef HASHTABLE_STATISTICS
+      nLookups.store(other.nLookups.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      nProbes.store(other.nProbes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      nRehashes = other.nRehashes;
+#endif
+   }
+   OpenBucketHashtable& operator=(const OpenBucketHashtable<GID, LID>& other) {
+      sizePower = other.sizePower;
+      fill = other.fill;
+      buckets = other.buckets;
+#ifdef HASHTABLE_STATISTICS
+      nLookups.store(other.nLookups.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      nProbes.store(other.nProbes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      nRehashes = other.nRehashes;
+#endif
+      return *this;
+   }
 
    // Resize the table to fit more things. This is automatically invoked once
-   // maxBucketOverflow has triggered.
+   // a probe group is full. If the elements do not fit into the probe groups of
+   // the new size, the size is increased further.
    void rehash(int newSizePower) {
-      if (newSizePower > 32) {
-         throw std::out_of_range("OpenBucketHashtable ran into rehashing catastrophe and exceeded 32bit buckets.");
-      }
-      std::vector<std::pair<GID, LID>> newBuckets(1 << newSizePower,
-                                                  std::pair<GID, LID>(EMPTYBUCKET, LID()));
-      sizePower = newSizePower;
-      int bitMask = (1 << sizePower) - 1; // For efficient modulo of the array size
-
-      // Iterate through all old elements and rehash them into the new array.
-      for (auto& e : buckets) {
-         // Skip empty buckets
-         if (e.first == EMPTYBUCKET) {
-            continue;
+      std::vector<std::pair<GID, LID>> newBuckets;
+      while (true) {
+         if (newSizePower > 32) {
+            throw std::out_of_range("OpenBucketHashtable ran into rehashing catastrophe and exceeded 32bit buckets.");
          }
-
-         uint32_t newHash = hash(e.first);
-         bool found = false;
-         for (int i = 0; i < maxBucketOverflow; i++) {
-            std::pair<GID, LID>& candidate = newBuckets[(newHash + i) & bitMask];
-            if (candidate.first == EMPTYBUCKET) {
-               // Found an empty bucket, assign that one.
-               candidate = e;
-               found = true;
+         newBuckets.assign(bucketArraySize(newSizePower), std::pair<GID, LID>(EMPTYBUCKET, LID()));
+         const int oldSizePower = sizePower;
+         sizePower = newSizePower; // hash() depends on the size
+
+         // Iterate through all old elements and rehash them into the new array.
+         bool success = true;
+         for (const auto& e : buckets) {
+            // Skip empty buckets
+            if (e.first == EMPTYBUCKET) {
+               continue;
+            }
+            std::pair<GID, LID>* group = newBuckets.data() + groupStart(e.first);
+            uint32_t emptyMask = 0;
+            for (int i = 0; i < maxBucketOverflow; i++) {
+               emptyMask |= (uint32_t)(group[i].first == EMPTYBUCKET) << i;
+            }
+            if (emptyMask == 0) {
+               success = false;
                break;
             }
+            group[lowestBit(emptyMask)] = e;
          }
-
-         if (!found) {
-            // Having arrived here means that we unsuccessfully rehashed and
-            // are *still* overflowing our buckets. So we need to try again with a bigger one.
-            return rehash(newSizePower + 1);
+         if (success) {
+            break;
          }
+         // Still overflowing our buckets, try again with a bigger table.
+         sizePower = oldSizePower;
+         newSizePower++;
       }
 
       // Replace our buckets with the new ones
-      buckets = newBuckets;
+      buckets.swap(newBuckets);
+#ifdef HASHTABLE_STATISTICS
+      nRehashes++;
+#endif
    }
 
-   // Element access (by reference). Nonexistent elements get created.
-   LID& at(const GID& key) {
-      int bitMask = (1 << sizePower) - 1; // For efficient modulo of the array size
-      uint32_t hashIndex = hash(key);
-
-      // Try to find the matching bucket.
-      for (int i = 0; i < maxBucketOverflow; i++) {
-         std::pair<GID, LID>& candidate = buckets[(hashIndex + i) & bitMask];
-         if (candidate.first == key) {
-            // Found a match, return that
-            return candidate.second;
-         }
-         if (candidate.first == EMPTYBUCKET) {
-            // Found an empty bucket, assign and return that.
-            candidate.first = key;
-            fill++;
-            return candidate.second;
-         }
+   // Grow the table once so that it holds at least nElements with a fill
+   // factor of at most one half, instead of rehashing repeatedly while inserting.
+   void reserve(size_t nElements) {
+      int newSizePower = sizePower;
+      while (((size_t)1 << newSizePower) < 2 * nElements) {
+         newSizePower++;
       }
+      if (newSizePower > sizePower) {
+         rehash(newSizePower);
+      }
+   }
 
-      // Not found, and we have no free slots to create a new one. So we need to rehash to a larger size.
-      rehash(sizePower + 1);
-      return at(key); // Recursive tail call to try again with larger table.
+   // Element access (by reference). Nonexistent elements get created.
+   LID& at(const GID& key) {
+      bool created;
+      return buckets[findOrCreateIndex(key, created)].second;
    }
       
    const LID& at(const GID& key) const {
-      int bitMask = (1 << sizePower) - 1; // For efficient modulo of the array size
-      uint32_t hashIndex = hash(key);
-
-      // Try to find the matching bucket.
-      for (int i = 0; i < maxBucketOverflow; i++) {
-         const std::pair<GID, LID>& candidate = buckets[(hashIndex + i) & bitMask];
-         if (candidate.first == key) {
-            // Found a match, return that
-            return candidate.second;
-         }
-         if (candidate.first == EMPTYBUCKET) {
-            // Found an empty bucket, so error.
-            throw std::out_of_range("Element not found in OpenBucketHashtable.at");
-         }
+      const size_t index = findIndex(key);
+      if (index == buckets.size()) {
+         throw std::out_of_range("Element not found in OpenBucketHashtable.at");
       }
-
-      // Not found, so error.
-      throw std::out_of_range("Element not found in OpenBucketHashtable.at");
+      return buckets[index].second;
    }
 
    // Typical array-like access with [] operator
@@ -165,18 +272,29 @@ public:
    size_t bucket_count() const { return buckets.size(); }
 
    size_t count(const GID& key) const {
-      if (find(key) != end()) {
-         return 1;
-      } else {
-         return 0;
-      }
+      return findIndex(key) == buckets.size() ? 0 : 1;
    }
 
    void clear() {
-      buckets = std::vector<std::pair<GID, LID>>(1 << sizePower, {EMPTYBUCKET, LID()});
+      buckets.assign(bucketArraySize(sizePower), std::pair<GID, LID>(EMPTYBUCKET, LID()));
       fill = 0;
    }
 
+   // Fraction of the hashed buckets that hold an element
+   double load_factor() const { return (double)fill / ((size_t)1 << sizePower); }
+
+   // Statistics, zero unless HASHTABLE_STATISTICS is defined. The average probe
+   // length of lookups and insertions is probe_count() / lookup_count().
+#ifdef HASHTABLE_STATISTICS
+   size_t lookup_count() const { return nLookups.load(std::memory_order_relaxed); }
+   size_t probe_count() const { return nProbes.load(std::memory_order_relaxed); }
+   size_t rehash_count() const { return nRehashes; }
+#else
+   size_t lookup_count() const { return 0; }
+   size_t probe_count() const { return 0; }
+   size_t rehash_count() const { return 0; }
+#endif
+
    // Iterator type. Iterates through all non-empty buckets.
    class iterator : public std::iterator<std::random_access_iterator_tag, std::pair<GID, LID>> {
       OpenBucketHashtable<GID, LID>* hashtable;
@@ -271,117 +389,60 @@ public:
 
    // Element access by iterator
    iterator find(GID key) {
-      int bitMask = (1 << sizePower) - 1; // For efficient modulo of the array size
-      uint32_t hashIndex = hash(key);
-
-      // Try to find the matching bucket.
-      for (int i = 0; i < maxBucketOverflow; i++) {
-         const std::pair<GID, LID>& candidate = buckets[(hashIndex + i) & bitMask];
-         if (candidate.first == key) {
-            // Found a match, return that
-            return iterator(*this, (hashIndex + i) & bitMask);
-         }
-
-         if (candidate.first == EMPTYBUCKET) {
-            // Found an empty bucket. Return empty.
-            return end();
-         }
-      }
-
-      // Not found
-      return end();
+      return iterator(*this, findIndex(key));
    }
 
    const const_iterator find(GID key) const {
-      int bitMask = (1 << sizePower) - 1; // For efficient modulo of the array size
-      uint32_t hashIndex = hash(key);
-
-      // Try to find the matching bucket.
-      for (int i = 0; i < maxBucketOverflow; i++) {
-         const std::pair<GID, LID>& candidate = buckets[(hashIndex + i) & bitMask];
-         if (candidate.first == key) {
-            // Found a match, return that
-            return const_iterator(*this, (hashIndex + i) & bitMask);
-         }
-
-         if (candidate.first == EMPTYBUCKET) {
-            // Found an empty bucket. Return empty.
-            return end();
-         }
-      }
-
-      // Not found
-      return end();
+      return const_iterator(*this, findIndex(key));
    }
 
    // More STL compatibility implementations
    std::pair<iterator, bool> insert(std::pair<GID, LID> newEntry) {
-      bool found = find(newEntry.first) != end();
-      if (!found) {
-         at(newEntry.first) = newEntry.second;
+      bool created;
+      const size_t index = findOrCreateIndex(newEntry.first, created);
+      if (created) {
+         buckets[index].second = newEntry.second;
       }
-      return std::pair<iterator, bool>(find(newEntry.first), !found);
+      return std::pair<iterator, bool>(iterator(*this, index), created);
    }
 
-   // Remove one element from the hash table.
+   // Remove one element from the hash table. Lookups compare the whole probe
+   // group, so the other elements do not need to be moved.
    iterator erase(iterator keyPos) {
-      // Due to overflowing buckets, this might require moving quite a bit of stuff around.
       size_t index = keyPos.getIndex();
-
       if (buckets[index].first != EMPTYBUCKET) {
          // Decrease fill count
          fill--;
 
          // Clear the element itself.
          buckets[index].first = EMPTYBUCKET;
-
-         int bitMask = (1 << sizePower) - 1; // For efficient modulo of the array size
-         size_t targetPos = index;
-         // Search ahead to verify items are in correct places (until empty bucket is found)
-         for (unsigned int i = 1; i < fill; i++) {
-            GID nextBucket = buckets[(index + i)&bitMask].first;
-            if (nextBucket == EMPTYBUCKET) {
-               // The next bucket is empty, we are done.
-               break;
-            }
-            // Found an entry: is it in the correct bucket?
-            uint32_t hashIndex = hash(nextBucket);
-            if ((hashIndex&bitMask) != ((index + i)&bitMask)) {
-               // This entry has overflown. Now check if it should be moved:
-               uint32_t distance =  ((targetPos - hashIndex + (1<<sizePower) )&bitMask);
-               if (distance < maxBucketOverflow) {
-                  // Copy this entry to the current newly empty bucket, then continue with deleting
-                  // this overflown entry and continue searching for overflown entries
-                  LID moveValue = buckets[(index+i)&bitMask].second;
-                  buckets[targetPos] = std::pair<GID, LID>(nextBucket,moveValue);
-                  targetPos = ((index+i)&bitMask);
-                  buckets[targetPos].first = EMPTYBUCKET;
-               }
-            }
-         }
       }
       // return the next valid bucket member
       ++keyPos;
       return keyPos;
    }
    size_t erase(const GID& key) {
-      iterator element = find(key);
-      if(element == end()) {
+      const size_t index = findIndex(key);
+      if (index == buckets.size()) {
          return 0;
       } else {
-         erase(element);
+         erase(iterator(*this, index));
          return 1;
       }
    }
 
    void swap(OpenBucketHashtable<GID, LID>& other) {
       buckets.swap(other.buckets);
-      int tempSizePower = sizePower;
-      sizePower = other.sizePower;
-      other.sizePower = tempSizePower;
-
-      size_t tempFill = fill;
-      fill = other.fill;
-      other.fill = tempFill;
+      std::swap(sizePower, other.sizePower);
+      std::swap(fill, other.fill);
+#ifdef HASHTABLE_STATISTICS
+      const size_t lookups = nLookups.load(std::memory_order_relaxed);
+      const size_t probes = nProbes.load(std::memory_order_relaxed);
+      nLookups.store(other.nLookups.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      nProbes.store(other.nProbes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      other.nLookups.store(lookups, std::memory_order_relaxed);
+      other.nProbes.store(probes, std::memory_order_relaxed);
+      std::swap(nRehashes, other.nRehashes);
+#endif
    }
 };
@@ -135,6 +135,18 @@ vector<string> P::diagnosticVariableList;
 string P::projectName = string("");
 
 bool P::vlasovAccelerateMaxwellianBoundaries = false;
+bool P::vlasovSplitPhaseTranslation = false;
+bool P::vlasovCombinedPopulationTransfer = false;
+bool P::vlasovFusedTileTranslation = false;
+uint P::vlasovFusedTileSize = 24;
+bool P::vlasovAccelerationColumnCache = false;
+uint P::vlasovThreadedCellAccelerationBlocks = 0;
+bool P::vlasovAccelerationTransformCache = false;
+Real P::vlasovAccelerationTransformCacheTolerance = 0.0;
+bool P::vlasovAccelerationStreaming = false;
+uint P::vlasovBlockReorderInterval = 0;
+bool P::vlasovBlockReorderMorton = false;
+bool P::vlasovAccelerationContentLists = false;
 Real P::maxSlAccelerationRotation = 10.0;
 Real P::hallMinimumRhom = physicalconstants::MASS_PROTON;
 Real P::hallMinimumRhoq = physicalconstants::CHARGE;
@@ -302,6 +314,67 @@ bool P::addParameters() {
    RP::add("vlasovsolver.accelerateMaxwellianBoundaries",
            "Propagate maxwellian boundary cell contents in velocity space. Default false.",
            false);
+   RP::add("vlasovsolver.splitPhaseTranslation",
+           "Overlap the ghost cell exchange of the translation with the mapping of cells whose stencil is local. "
+           "Uses a temporary copy of the target blocks. Default false.",
+           false);
+   RP::add("vlasovsolver.combinedPopulationTransfer",
+           "Exchange the ghost cell data of all particle populations in translation in one message per neighbor "
+           "and dimension, instead of one per population. Default false.",
+           false);
+   RP::add("vlasovsolver.fusedTileTranslation",
+           "On uniform grids, translate tiles of local cells far enough from process and system boundaries in the "
+           "first two translated dimensions (z and x in 3D) at once. The tiles are one cell thick in the third "
+           "dimension, and each tile also gathers and maps a halo of VLASOV_STENCIL_WIDTH+1 cells per side. The "
+           "mapped blocks of the tile cells of all populations are held in new block containers until the second "
+           "dimension is done. Not used with splitPhaseTranslation. Default false.",
+           false);
+   RP::add("vlasovsolver.fusedTileSize",
+           "Size of the tiles of fusedTileTranslation in cells per fused dimension. Each thread works on one "
+           "velocity block of a tile at a time in two buffers of (size+2*(VLASOV_STENCIL_WIDTH+1))^2 blocks, which "
+           "should fit in the L2 cache: 450 KiB in single precision with PPM for the default. Tile sizes for which "
+           "the tile and its halo hold more than twice the cells of the tile are rejected, e.g. sizes below 15 with "
+           "PPM. Default 24.",
+           24);
+   RP::add("vlasovsolver.accelerationColumnCache",
+           "Keep the blocks of each cell sorted into columns between acceleration sweeps and subcycles. The lists are "
+           "reused if the cell has not changed, patched if only a few blocks (about one per thousand) were added or "
+           "removed, and rebuilt otherwise. Uses 12 bytes of memory per velocity block. Default false.",
+           false);
+   RP::add("vlasovsolver.threadedCellAccelerationBlocks",
+           "Cells with at least this many velocity blocks are accelerated one at a time by all threads, which map the "
+           "column sets of the cell in parallel. 0 disables. Default 0.",
+           0);
+   RP::add("vlasovsolver.accelerationTransformCache",
+           "Reuse the part of the acceleration transform of a cell that depends on its fields and subcycle dt while "
+           "they are unchanged within accelerationTransformCacheTolerance. The bulk velocity and charge density are "
+           "applied on every subcycle. Default false.",
+           false);
+   RP::add("vlasovsolver.accelerationTransformCacheTolerance",
+           "Relative tolerance of each field value and dt for reusing the acceleration transform. 0 reuses only "
+           "exactly equal values, such as on consecutive subcycles of equal length. Default 0.",
+           0.0);
+   RP::add("vlasovsolver.accelerationStreaming",
+           "In cells accelerated by all threads (see threadedCellAccelerationBlocks), map the column sets in batches "
+           "of one set per thread, creating their target blocks just before and removing their emptied source "
+           "blocks right after, instead of in one batch of all sets. Bounds the growth of such a cell during the "
+           "mapping to one column set per thread, at the cost of more synchronization. Other cells are always "
+           "mapped one set at a time. Default false.",
+           false);
+   RP::add("vlasovsolver.blockReorderInterval",
+           "Every this many time steps, reorder the velocity blocks of each adjusted cell in memory so that blocks "
+           "close in velocity space are close in memory. Done at block adjustment, before the block lists are sent "
+           "to remote neighbors. 0 disables. Default 0.",
+           0);
+   RP::add("vlasovsolver.blockReorderMorton",
+           "Reorder the velocity blocks along a Morton (Z-order) curve of the block indices instead of by global ID "
+           "(columns along vx). Default false.",
+           false);
+   RP::add("vlasovsolver.accelerationContentLists",
+           "Record the maximum value of each velocity block in the last mapping of the acceleration and build the "
+           "content lists of accelerated cells from it, instead of rescanning all block data at block adjustment. "
+           "Default false.",
+           false);
 
    // Load balancing parameters
    RP::add("loadBalance.algorithm", "Load balancing algorithm to be used", string("RCB"));
@@ -688,6 +761,35 @@ void Parameters::getParameters() {
    RP::get("vlasovsolver.maxCFL", P::vlasovSolverMaxCFL);
    RP::get("vlasovsolver.minCFL", P::vlasovSolverMinCFL);
    RP::get("vlasovsolver.accelerateMaxwellianBoundaries",  P::vlasovAccelerateMaxwellianBoundaries);
+   RP::get("vlasovsolver.splitPhaseTranslation", P::vlasovSplitPhaseTranslation);
+   RP::get("vlasovsolver.combinedPopulationTransfer", P::vlasovCombinedPopulationTransfer);
+   RP::get("vlasovsolver.fusedTileTranslation", P::vlasovFusedTileTranslation);
+   RP::get("vlasovsolver.fusedTileSize", P::vlasovFusedTileSize);
+   if (P::vlasovFusedTileTranslation) {
+      // The halo of the tiles is gathered and mapped redundantly in the (at most two) fused dimensions
+      const double tileSize = P::vlasovFusedTileSize;
+      const double halo = VLASOV_STENCIL_WIDTH + 1;
+      const int nFusedDimensions = min(2, (P::xcells_ini > 1) + (P::ycells_ini > 1) + (P::zcells_ini > 1));
+      double haloOverhead = 1.0;
+      for (int d = 0; d < nFusedDimensions; ++d) {
+         haloOverhead *= (tileSize + 2 * halo) / tileSize;
+      }
+      if (P::vlasovFusedTileSize == 0 || haloOverhead > 2.0) {
+         if (myRank == MASTER_RANK) {
+            cerr << "ERROR vlasovsolver.fusedTileSize " << P::vlasovFusedTileSize << " is too small, the tiles and their "
+                 << "halos would hold " << haloOverhead << " times the cells of the tiles (at most 2)." << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+         }
+      }
+   }
+   RP::get("vlasovsolver.accelerationColumnCache", P::vlasovAccelerationColumnCache);
+   RP::get("vlasovsolver.threadedCellAccelerationBlocks", P::vlasovThreadedCellAccelerationBlocks);
+   RP::get("vlasovsolver.accelerationTransformCache", P::vlasovAccelerationTransformCache);
+   RP::get("vlasovsolver.accelerationTransformCacheTolerance", P::vlasovAccelerationTransformCacheTolerance);
+   RP::get("vlasovsolver.accelerationStreaming", P::vlasovAccelerationStreaming);
+   RP::get("vlasovsolver.blockReorderInterval", P::vlasovBlockReorderInterval);
+   RP::get("vlasovsolver.blockReorderMorton", P::vlasovBlockReorderMorton);
+   RP::get("vlasovsolver.accelerationContentLists", P::vlasovAccelerationContentLists);
 
    // Get load balance parameters
    RP::get("loadBalance.algorithm", P::loadBalanceAlgorithm);
@@ -140,6 +140,18 @@ struct Parameters {
    static Real maxSlAccelerationRotation; /*!< Maximum rotation in acceleration for semilagrangian solver*/
    static int maxSlAccelerationSubcycles; /*!< Maximum number of subcycles in acceleration*/
    static bool vlasovAccelerateMaxwellianBoundaries; /*!< Accelerate also Maxwellian boundary cells*/
+   static bool vlasovSplitPhaseTranslation; /*!< Overlap the ghost cell exchange with the mapping of interior cells in translation*/
+   static bool vlasovCombinedPopulationTransfer; /*!< Exchange the translation ghost data of all populations in one message*/
+   static bool vlasovFusedTileTranslation; /*!< Translate interior tiles of uniform grids in the first two dimensions at once*/
+   static uint vlasovFusedTileSize; /*!< Size of the tiles of vlasovFusedTileTranslation in cells*/
+   static bool vlasovAccelerationColumnCache; /*!< Keep the column layouts of the acceleration between map_1d calls*/
+   static uint vlasovThreadedCellAccelerationBlocks; /*!< Cells with at least this many blocks are accelerated by all threads, 0 disables*/
+   static bool vlasovAccelerationTransformCache; /*!< Reuse the field dependent part of the acceleration transform of a cell if its fields and dt are unchanged*/
+   static Real vlasovAccelerationTransformCacheTolerance; /*!< Relative tolerance of vlasovAccelerationTransformCache*/
+   static bool vlasovAccelerationStreaming; /*!< Map the column sets of threaded acceleration cells in batches of one set per thread*/
+   static uint vlasovBlockReorderInterval; /*!< Reorder the velocity blocks of cells in memory every this many time steps, 0 disables*/
+   static bool vlasovBlockReorderMorton; /*!< Reorder the velocity blocks along a Morton curve instead of by global ID*/
+   static bool vlasovAccelerationContentLists; /*!< Build the content lists of accelerated cells from block maxima recorded by the acceleration*/
 
    static Real hallMinimumRhom; /*!< Minimum mass density value used in the field solver.*/
    static Real hallMinimumRhoq; /*!< Minimum charge density value used for the Hall and electron pressure gradient terms
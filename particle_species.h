@@ -56,6 +56,8 @@ namespace species {
       Real sparseDynamicBulkValue2;    /*!< Maximum value for the dynamic algorithm range, so for example if dynamicAlgorithm=1 then for sparse.dynamicMinValue = 1e3, sparse.dynamicMaxValue=1e5, we apply the algorithm to cells for which 1e3<cell.rho<1e5*/
       Real sparseDynamicMinValue1;     /*!< The minimum value for the minValue*/
       Real sparseDynamicMinValue2;     /*!< The maximum value for the minValue*/
+      bool ghostTransferCompression;   /*!< If true, translation ghost cell data is sent compressed, without values below the threshold*/
+      Real ghostTransferCompressionThreshold; /*!< Values below this fraction of the cell's sparsity threshold are not sent in compressed ghost transfers*/
 
       Real thermalRadius;           /*!< Radius of sphere to split the distribution into thermal and suprathermal. 0 (default in cfg) disables the DRO. */
       std::array<Real, 3> thermalV; /*!< Centre of sphere to split the distribution into thermal and suprathermal. 0 (default in cfg) disables the DRO. */
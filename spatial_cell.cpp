@@ -20,7 +20,9 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
 #include <unordered_set>
+#include <cstring>
 
 #include "spatial_cell.hpp"
 #include "velocity_blocks.h"
@@ -34,6 +36,7 @@ using namespace std;
 
 namespace spatial_cell {
    int SpatialCell::activePopID = 0;
+   std::vector<uint> SpatialCell::activePopIDs;
    uint64_t SpatialCell::mpi_transfer_type = 0;
    bool SpatialCell::mpiTransferAtSysBoundaries = false;
    bool SpatialCell::mpiTransferInAMRTranslation = false;
@@ -71,6 +74,7 @@ namespace spatial_cell {
          populations[popID].vmesh.initialize(spec.velocityMesh);
          populations[popID].velocityBlockMinValue = spec.sparseMinValue;
          populations[popID].N_blocks = 0;
+         populations[popID].compressedBlockDataSize = 0;
       }
    }
 
@@ -201,10 +205,14 @@ namespace spatial_cell {
          }
       }
 
-      // ADD all blocks with neighbors in spatial or velocity space (if it exists then the block is unchanged)
+      // ADD all blocks with neighbors in spatial or velocity space (if it exists then the block is unchanged).
+      // The missing blocks are added with one bulk insert, sorted so that they are stored in GID order.
+      std::vector<vmesh::GlobalID> newBlocks;
       for (std::unordered_set<vmesh::GlobalID>::iterator it=neighbors_have_content.begin(); it != neighbors_have_content.end(); ++it) {
-         this->add_velocity_block(*it,popID);
+         if (get_velocity_block_local_id(*it,popID) == invalid_local_id()) newBlocks.push_back(*it);
       }
+      std::sort(newBlocks.begin(),newBlocks.end());
+      this->add_velocity_blocks(newBlocks,popID);
    }
 
    #else       // AMR version
@@ -593,10 +601,7 @@ namespace spatial_cell {
       // create datatype for actual data if we are in the first two 
       // layers around a boundary, or if we send for the whole system
       // in AMR translation, only send the necessary cells
-      if (this->mpiTransferEnabled && ((SpatialCell::mpiTransferAtSysBoundaries==false && SpatialCell::mpiTransferInAMRTranslation==false) ||
-                                       (SpatialCell::mpiTransferAtSysBoundaries==true && (this->sysBoundaryLayer ==1 || this->sysBoundaryLayer ==2)) ||
-                                       (SpatialCell::mpiTransferInAMRTranslation==true &&
-                                        this->parameters[CellParams::AMR_TRANSLATE_COMM_X+SpatialCell::mpiTransferXYZTranslation]==true ))) {
+      if (this->mpi_transfer_is_active()) {
 
          //add data to send/recv to displacement and block length lists
          if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_LIST_STAGE1) != 0) {
@@ -640,8 +645,46 @@ namespace spatial_cell {
          }
 
          if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_DATA) !=0) {
-            displacements.push_back((uint8_t*) get_data(activePopID) - (uint8_t*) this);
-            block_lengths.push_back(sizeof(Realf) * VELOCITY_BLOCK_LENGTH * populations[activePopID].blockContainer.size());
+            if (activePopIDs.size() == 0) {
+               displacements.push_back((uint8_t*) get_data(activePopID) - (uint8_t*) this);
+               block_lengths.push_back(sizeof(Realf) * VELOCITY_BLOCK_LENGTH * populations[activePopID].blockContainer.size());
+            } else {
+               // Data of several populations in one message
+               for (const uint popID : activePopIDs) {
+                  if (populations[popID].blockContainer.size() == 0) continue;
+                  displacements.push_back((uint8_t*) get_data(popID) - (uint8_t*) this);
+                  block_lengths.push_back(sizeof(Realf) * VELOCITY_BLOCK_LENGTH * populations[popID].blockContainer.size());
+               }
+            }
+         }
+
+         if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_DATA_COMPRESSED_SIZE) !=0) {
+            const std::vector<uint> popIDs = (activePopIDs.size() == 0) ? std::vector<uint>(1,activePopID) : activePopIDs;
+            for (const uint popID : popIDs) {
+               if (populations[popID].blockContainer.size() == 0) continue;
+               if (!getObjectWrapper().particleSpecies[popID].ghostTransferCompression) continue;
+               if (!receiving) populations[popID].compressedBlockDataSize = populations[popID].compressedBlockData.size();
+               displacements.push_back((uint8_t*) &(populations[popID].compressedBlockDataSize) - (uint8_t*) this);
+               block_lengths.push_back(sizeof(size_t));
+            }
+         }
+
+         if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_DATA_COMPRESSED) !=0) {
+            const std::vector<uint> popIDs = (activePopIDs.size() == 0) ? std::vector<uint>(1,activePopID) : activePopIDs;
+            for (const uint popID : popIDs) {
+               if (populations[popID].blockContainer.size() == 0) continue;
+               if (getObjectWrapper().particleSpecies[popID].ghostTransferCompression) {
+                  //compressedBlockDataSize transferred earlier (VEL_BLOCK_DATA_COMPRESSED_SIZE)
+                  if (receiving) {
+                     populations[popID].compressedBlockData.resize(populations[popID].compressedBlockDataSize);
+                  }
+                  displacements.push_back((uint8_t*) populations[popID].compressedBlockData.data() - (uint8_t*) this);
+                  block_lengths.push_back(populations[popID].compressedBlockData.size());
+               } else {
+                  displacements.push_back((uint8_t*) get_data(popID) - (uint8_t*) this);
+                  block_lengths.push_back(sizeof(Realf) * VELOCITY_BLOCK_LENGTH * populations[popID].blockContainer.size());
+               }
+            }
          }
 
          if ((SpatialCell::mpi_transfer_type & Transfer::NEIGHBOR_VEL_BLOCK_DATA) != 0) {
@@ -1330,6 +1373,143 @@ namespace spatial_cell {
       insertedBlocks.insert(newInserted.begin(),newInserted.end());
    }
 
+   /** Number of 64-bit words in the mask of one velocity block in compressed block data.*/
+   static const size_t COMPRESSED_BLOCK_MASK_WORDS = (VELOCITY_BLOCK_LENGTH + 63) / 64;
+
+   /** Get the largest possible size of compressed velocity block data, in bytes.
+    * @param nBlocks Number of velocity blocks.
+    * @return Size of the buffer needed for packing the compressed data.*/
+   size_t SpatialCell::compressed_block_data_max_size(const vmesh::LocalID nBlocks) {
+      return (size_t)nBlocks * (COMPRESSED_BLOCK_MASK_WORDS * sizeof(uint64_t) + VELOCITY_BLOCK_LENGTH * sizeof(Realf));
+   }
+
+   /** Spread the lowest 10 bits of the value so that there are two zero bits between each bit.*/
+   static inline uint64_t spreadMortonBits(uint64_t v) {
+      v &= 0x3ff;
+      v = (v | (v << 16)) & 0x030000ff;
+      v = (v | (v <<  8)) & 0x0300f00f;
+      v = (v | (v <<  4)) & 0x030c30c3;
+      v = (v | (v <<  2)) & 0x09249249;
+      return v;
+   }
+
+   /** Reorder the velocity blocks of a population in memory, so that blocks close to each
+    * other in velocity space are also close to each other in memory. The blocks are sorted
+    * by their global ID, i.e. into columns along vx with the columns in vy,vz order, or
+    * along a Morton (Z-order) curve of the block indices. The set of blocks is not changed,
+    * only their local IDs. Does nothing for the AMR mesh.
+    * @param popID Population ID.
+    * @param mortonOrder If true, sort along the Morton curve instead of by global ID.*/
+   void SpatialCell::reorder_velocity_blocks(const uint popID,const bool mortonOrder) {
+      #ifndef AMR
+      vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = populations[popID].vmesh;
+      const vmesh::LocalID nBlocks = vmesh.size();
+
+      std::vector<std::pair<uint64_t,vmesh::LocalID> > keys(nBlocks);
+      bool sorted = true;
+      for (vmesh::LocalID b=0; b<nBlocks; ++b) {
+         const vmesh::GlobalID blockGID = vmesh.getGlobalID(b);
+         uint64_t key = blockGID;
+         if (mortonOrder) {
+            uint8_t refLevel;
+            vmesh::LocalID indices[3];
+            vmesh.getIndices(blockGID,refLevel,indices[0],indices[1],indices[2]);
+            key = spreadMortonBits(indices[0]) | (spreadMortonBits(indices[1]) << 1) | (spreadMortonBits(indices[2]) << 2);
+         }
+         keys[b] = std::make_pair(key,b);
+         if (b > 0 && key < keys[b-1].first) sorted = false;
+      }
+      if (sorted) return;
+
+      std::sort(keys.begin(),keys.end());
+      std::vector<vmesh::LocalID> order(nBlocks);
+      for (vmesh::LocalID b=0; b<nBlocks; ++b) order[b] = keys[b].second;
+      vmesh.permute(order);
+      populations[popID].blockContainer.permute(order);
+      #endif
+   }
+
+   /** Compress the velocity block data of a population for a ghost transfer
+    * with Transfer::VEL_BLOCK_DATA_COMPRESSED. For each block a bitmask of the
+    * velocity cells whose value is at least threshold is stored, followed by
+    * the values of those cells. Values below the threshold are sent as zeros.
+    * @param popID Population ID.
+    * @param threshold Smallest value that is transferred.*/
+   void SpatialCell::pack_compressed_block_data(const uint popID,const Realf threshold) {
+      const vmesh::LocalID nBlocks = populations[popID].blockContainer.size();
+      std::vector<uint8_t>& buffer = populations[popID].compressedBlockData;
+      buffer.resize(compressed_block_data_max_size(nBlocks));
+
+      const Realf* data = get_data(popID);
+      uint8_t* out = buffer.data();
+      for (vmesh::LocalID blockLID=0; blockLID<nBlocks; ++blockLID) {
+         uint64_t mask[COMPRESSED_BLOCK_MASK_WORDS] = {};
+         uint8_t* maskOut = out;
+         out += sizeof(mask);
+         for (uint i=0; i<VELOCITY_BLOCK_LENGTH; ++i) {
+            const Realf value = data[blockLID*VELOCITY_BLOCK_LENGTH + i];
+            if (value >= threshold) {
+               mask[i / 64] |= (uint64_t)1 << (i % 64);
+               memcpy(out,&value,sizeof(Realf));
+               out += sizeof(Realf);
+            }
+         }
+         memcpy(maskOut,mask,sizeof(mask));
+      }
+      // Capacity is kept for the next transfer
+      buffer.resize(out - buffer.data());
+   }
+
+   /** Decompress the velocity block data of a population received in a ghost
+    * transfer with Transfer::VEL_BLOCK_DATA_COMPRESSED, see pack_compressed_block_data.
+    * Exits if the received data does not match the number of blocks of the population.
+    * @param popID Population ID.*/
+   void SpatialCell::unpack_compressed_block_data(const uint popID) {
+      const vmesh::LocalID nBlocks = populations[popID].blockContainer.size();
+      Realf* data = get_data(popID);
+      const std::vector<uint8_t>& buffer = populations[popID].compressedBlockData;
+      const uint8_t* in = buffer.data();
+      const uint8_t* const end = buffer.data() + buffer.size();
+      bool valid = (buffer.size() == populations[popID].compressedBlockDataSize);
+      for (vmesh::LocalID blockLID=0; blockLID<nBlocks && valid; ++blockLID) {
+         uint64_t mask[COMPRESSED_BLOCK_MASK_WORDS];
+         if ((size_t)(end - in) < sizeof(mask)) {
+            valid = false;
+            break;
+         }
+         memcpy(mask,in,sizeof(mask));
+         in += sizeof(mask);
+
+         // The mask must not have bits past the end of the block, and the values it
+         // selects must be in the buffer
+         size_t nValues = 0;
+         for (size_t w=0; w<COMPRESSED_BLOCK_MASK_WORDS; ++w) nValues += __builtin_popcountll(mask[w]);
+         if (VELOCITY_BLOCK_LENGTH % 64 != 0 && (mask[COMPRESSED_BLOCK_MASK_WORDS-1] >> (VELOCITY_BLOCK_LENGTH % 64)) != 0) {
+            valid = false;
+            break;
+         }
+         if ((size_t)(end - in) < nValues * sizeof(Realf)) {
+            valid = false;
+            break;
+         }
+
+         for (uint i=0; i<VELOCITY_BLOCK_LENGTH; ++i) {
+            if ((mask[i / 64] >> (i % 64)) & 1) {
+               memcpy(&data[blockLID*VELOCITY_BLOCK_LENGTH + i],in,sizeof(Realf));
+               in += sizeof(Realf);
+            } else {
+               data[blockLID*VELOCITY_BLOCK_LENGTH + i] = 0.0;
+            }
+         }
+      }
+      if (!valid || in != end) {
+         std::cerr << "ERROR, compressed block data of population " << popID << " (" << buffer.size() << " bytes, ";
+         std::cerr << populations[popID].compressedBlockDataSize << " expected) does not match its " << nBlocks << " blocks in ";
+         std::cerr << __FILE__ << ":" << __LINE__ << std::endl;
+         exit(1);
+      }
+   }
+
    /** Set the particle species SpatialCell should use in functions that 
     * use the velocity mesh.
     * @param popID Population ID.
@@ -1344,6 +1524,25 @@ namespace spatial_cell {
       #endif
       
       activePopID = popID;
+      activePopIDs.clear();
+      return true;
+   }
+
+   /** Set the particle species whose velocity block data (Transfer::VEL_BLOCK_DATA)
+    * is transferred together in one MPI message. Other transfer types, and the
+    * functions using the velocity mesh, use the first species of the list.
+    * @param popIDs Population IDs.
+    * @return If true, the new species are in use.*/
+   bool SpatialCell::setCommunicatedSpecies(const std::vector<uint>& popIDs) {
+      if (popIDs.size() == 0) {
+         std::cerr << "ERROR, empty list of species in " << __FILE__ << ":" << __LINE__ << std::endl;
+         exit(1);
+      }
+      for (const uint popID : popIDs) {
+         if (setCommunicatedSpecies(popID) == false) return false;
+      }
+      activePopID = popIDs[0];
+      activePopIDs = popIDs;
       return true;
    }
    
@@ -1413,15 +1612,35 @@ namespace spatial_cell {
       
       velocity_block_with_content_list.clear();
       velocity_block_with_no_content_list.clear();
-      
-      for (vmesh::LocalID block_index=0; block_index<populations[popID].vmesh.size(); ++block_index) {
-         const vmesh::GlobalID globalID = populations[popID].vmesh.getGlobalID(block_index);
-         if (compute_block_has_content(globalID,popID)){
-            velocity_block_with_content_list.push_back(globalID);
-         } else {
-            velocity_block_with_no_content_list.push_back(globalID);
+
+      // If the acceleration recorded the maximum of every block and the mesh has not
+      // changed since, the lists are filtered from the maxima without touching the
+      // block data. The maxima are only used once.
+      Population& pop = populations[popID];
+      if (pop.blockMaximaValid &&
+          pop.blockMaximaModifications == pop.vmesh.getModificationCount() &&
+          pop.blockMaxima.size() == pop.vmesh.size()) {
+         // Compared in Real, as in compute_block_has_content, so both give the same lists
+         const Real velocity_block_min_value = getVelocityBlockMinValue(popID);
+         for (size_t b=0; b<pop.blockMaxima.size(); ++b) {
+            if (pop.blockMaxima[b].second >= velocity_block_min_value) {
+               velocity_block_with_content_list.push_back(pop.blockMaxima[b].first);
+            } else {
+               velocity_block_with_no_content_list.push_back(pop.blockMaxima[b].first);
+            }
+         }
+      } else {
+         for (vmesh::LocalID block_index=0; block_index<pop.vmesh.size(); ++block_index) {
+            const vmesh::GlobalID globalID = pop.vmesh.getGlobalID(block_index);
+            if (compute_block_has_content(globalID,popID)){
+               velocity_block_with_content_list.push_back(globalID);
+            } else {
+               velocity_block_with_no_content_list.push_back(globalID);
+            }
          }
       }
+      pop.blockMaximaValid = false;
+      pop.blockMaxima.clear();
    }
    
    void SpatialCell::printMeshSizes() {
@@ -117,6 +117,11 @@ namespace spatial_cell {
       const uint64_t POP_METADATA             = (1ull<<26);
       const uint64_t RANDOMGEN                = (1ull<<27);
       const uint64_t CELL_GRADPE_TERM         = (1ull<<28);
+      const uint64_t VEL_BLOCK_DATA_COMPRESSED = (1ull<<29); /**< As VEL_BLOCK_DATA, but species with ghost transfer compression
+                                                              * send the buffer filled by pack_compressed_block_data.
+                                                              * VEL_BLOCK_DATA_COMPRESSED_SIZE must have been transferred first.*/
+      const uint64_t VEL_BLOCK_DATA_COMPRESSED_SIZE = (1ull<<30); /**< Sizes of the compressed velocity block data of the species
+                                                              * with ghost transfer compression.*/
       //all data
       const uint64_t ALL_DATA =
       CELL_PARAMETERS
@@ -169,6 +174,31 @@ namespace spatial_cell {
                                                                       * in this spatial cell. Cells are identified by their unique 
                                                                       * global IDs.*/
       vmesh::VelocityBlockContainer<vmesh::LocalID> blockContainer;  /**< Velocity block data.*/
+      std::vector<uint8_t> compressedBlockData;                      /**< Compressed velocity block data for ghost transfers,
+                                                                      * see pack_compressed_block_data.*/
+      size_t compressedBlockDataSize;                                /**< Size of compressedBlockData in bytes, used when receiving
+                                                                      * compressed block data from remote neighbors using MPI.*/
+      bool sortedBlocksValid = false;                                /**< If true, sortedBlocks and sortedBlocksChanges are maintained.*/
+      std::vector<vmesh::GlobalID> sortedBlocks[3];                  /**< Blocks sorted into columns along each dimension for the
+                                                                      * acceleration, see map_1d.*/
+      std::vector<std::pair<vmesh::GlobalID,bool> > sortedBlocksChanges; /**< Blocks added (true) or removed (false) since
+                                                                      * sortedBlocks were last updated.*/
+      size_t sortedBlocksModifications = 0;                          /**< vmesh modification count when sortedBlocks were last updated.*/
+
+      static const uint N_ACC_TRANSFORM_INPUTS = 13;                 /**< Number of field values and dt the cached transform parts depend on.*/
+      static const uint N_ACC_TRANSFORM_PARTS = 15;                  /**< Number of values in accTransformParts.*/
+      bool accTransformValid = false;                                /**< If true, accTransformInputs and accTransformParts hold the
+                                                                      * last acceleration transform, see cpu_accelerate_cell.*/
+      Real accTransformInputs[N_ACC_TRANSFORM_INPUTS];               /**< Inputs of the cached acceleration transform parts.*/
+      Real accTransformParts[N_ACC_TRANSFORM_PARTS];                 /**< Parts of the acceleration transform that do not depend on
+                                                                      * the bulk velocity or charge density, see
+                                                                      * compute_acceleration_transformation_parts.*/
+
+      bool blockMaximaValid = false;                                 /**< If true, blockMaxima holds the maximum value of every block,
+                                                                      * see update_velocity_block_content_lists.*/
+      size_t blockMaximaModifications = 0;                           /**< vmesh modification count when blockMaxima were recorded.*/
+      std::vector<std::pair<vmesh::GlobalID,Realf> > blockMaxima;    /**< Maximum value of each block written by the last
+                                                                      * acceleration of the cell.*/
    };
 
    class SpatialCell {
@@ -258,6 +288,7 @@ namespace spatial_cell {
 
       void printMeshSizes();
       static bool setCommunicatedSpecies(const uint popID);
+      static bool setCommunicatedSpecies(const std::vector<uint>& popIDs);
 
       // Following functions adjust velocity blocks stored on the cell //
       bool add_velocity_block(const vmesh::GlobalID& block,const uint popID);
@@ -268,6 +299,9 @@ namespace spatial_cell {
                                   const uint popID,
                                   bool doDeleteEmptyBlocks=true);
       void update_velocity_block_content_lists(const uint popID);
+      void pack_compressed_block_data(const uint popID,const Realf threshold);
+      void unpack_compressed_block_data(const uint popID);
+      static size_t compressed_block_data_max_size(const vmesh::LocalID nBlocks);
       bool checkMesh(const uint popID);
       void clear(const uint popID);
       void coarsen_block(const vmesh::GlobalID& parent,const std::vector<vmesh::GlobalID>& children,const uint popID);
@@ -279,6 +313,8 @@ namespace spatial_cell {
       bool shrink_to_fit();
       size_t size(const uint popID) const;
       void remove_velocity_block(const vmesh::GlobalID& block,const uint popID);
+      void reorder_velocity_blocks(const uint popID,const bool mortonOrder);
+      void log_velocity_block_change(const vmesh::GlobalID& block,const bool added,const uint popID);
       void swap(vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
                 vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer,const uint popID);
       vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& get_velocity_mesh(const size_t& popID);
@@ -306,6 +342,7 @@ namespace spatial_cell {
       static void set_mpi_transfer_type(const uint64_t type,bool atSysBoundaries=false, bool inAMRtranslation=false);
       static void set_mpi_transfer_direction(const int dimension);
       void set_mpi_transfer_enabled(bool transferEnabled);
+      bool mpi_transfer_is_active() const;
       void updateSparseMinValue(const uint popID);
       Real getVelocityBlockMinValue(const uint popID) const;
 
@@ -356,6 +393,8 @@ namespace spatial_cell {
 				  std::set<vmesh::GlobalID>& blockRemovalList);
 
       static int activePopID;
+      static std::vector<uint> activePopIDs;                                  /**< Populations whose velocity block data is transferred
+                                                                               * together. If empty, only activePopID is transferred.*/
       bool initialized;
       bool mpiTransferEnabled;
 
@@ -1667,6 +1706,7 @@ namespace spatial_cell {
       if (populations[popID].vmesh.push_back(block) == false) {
          return false;
       }
+      log_velocity_block_change(block,true,popID);
 
       const vmesh::LocalID VBC_LID = populations[popID].blockContainer.push_back();
 
@@ -1688,6 +1728,10 @@ namespace spatial_cell {
       return success;
    }
    
+   /*!
+    Adds the given empty velocity blocks into this spatial cell in one pass.
+    Blocks that already exist are skipped.
+    */
    inline void SpatialCell::add_velocity_blocks(const std::vector<vmesh::GlobalID>& blocks,const uint popID) {
       #ifdef DEBUG_SPATIAL_CELL
       if (popID >= populations.size()) {
@@ -1697,15 +1741,21 @@ namespace spatial_cell {
       }
       #endif
       
-      // Add blocks to mesh
+      // Add blocks to mesh. Blocks that already exist are skipped,
+      // the new blocks are appended to the end of the mesh.
+      const vmesh::LocalID startLID = populations[popID].vmesh.size();
       const uint8_t adds = populations[popID].vmesh.push_back(blocks);
       if (adds == 0) {
          std::cerr << "Failed to add blocks" << std::endl;
          return;
       }
+      const vmesh::LocalID nAdded = populations[popID].vmesh.size() - startLID;
+      for (vmesh::LocalID b=0; b<nAdded; ++b) {
+         log_velocity_block_change(populations[popID].vmesh.getGlobalID(startLID+b),true,popID);
+      }
 
-      // Add blocks to block container
-      vmesh::LocalID startLID = populations[popID].blockContainer.push_back(blocks.size());
+      // Add blocks to block container, the storage is grown once for all blocks
+      populations[popID].blockContainer.push_back(nAdded);
       Real* parameters = populations[popID].blockContainer.getParameters(startLID);
 
       #ifdef DEBUG_SPATIAL_CELL
@@ -1715,11 +1765,12 @@ namespace spatial_cell {
       #endif
 
       // Set block parameters
-      for (size_t b=0; b<blocks.size(); ++b) {
-         parameters[BlockParams::VXCRD] = get_velocity_block_vx_min(popID,blocks[b]);
-         parameters[BlockParams::VYCRD] = get_velocity_block_vy_min(popID,blocks[b]);
-         parameters[BlockParams::VZCRD] = get_velocity_block_vz_min(popID,blocks[b]);
-         populations[popID].vmesh.getCellSize(blocks[b],&(parameters[BlockParams::DVX]));
+      for (vmesh::LocalID b=0; b<nAdded; ++b) {
+         const vmesh::GlobalID blockGID = populations[popID].vmesh.getGlobalID(startLID+b);
+         parameters[BlockParams::VXCRD] = get_velocity_block_vx_min(popID,blockGID);
+         parameters[BlockParams::VYCRD] = get_velocity_block_vy_min(popID,blockGID);
+         parameters[BlockParams::VZCRD] = get_velocity_block_vz_min(popID,blockGID);
+         populations[popID].vmesh.getCellSize(blockGID,&(parameters[BlockParams::DVX]));
          parameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
       }
    }
@@ -1822,11 +1873,33 @@ namespace spatial_cell {
 
       populations[popID].vmesh.copy(lastLID,removedLID);
       populations[popID].vmesh.pop();
+      log_velocity_block_change(block,false,popID);
 
       populations[popID].blockContainer.copy(lastLID,removedLID);
       populations[popID].blockContainer.pop();
    }
 
+   /*!
+    Records an added or removed velocity block for updating the sorted block lists of the
+    acceleration (Population::sortedBlocks). Must be called once for every block added to or
+    removed from the mesh, the log is checked against the modification count of the mesh.
+    The sorted lists are dropped if the log grows long compared to them, rebuilding them with
+    the radix sort is then cheaper than patching. Patching costs a lookup in the changes and a
+    mapped ID for every listed block, and only wins for fewer than about one change per
+    thousand blocks.
+    */
+   inline void SpatialCell::log_velocity_block_change(const vmesh::GlobalID& block,const bool added,const uint popID) {
+      Population& pop = populations[popID];
+      if (pop.sortedBlocksValid == false) return;
+
+      pop.sortedBlocksChanges.push_back(std::make_pair(block,added));
+      if (pop.sortedBlocksChanges.size() > 16 + pop.vmesh.size() / 1024) {
+         // The sorted lists are kept allocated, map_1d may be reading them
+         pop.sortedBlocksValid = false;
+         pop.sortedBlocksChanges.clear();
+      }
+   }
+
    inline void SpatialCell::swap(vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
                                  vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer,
                                  const uint popID) {
@@ -1876,6 +1949,19 @@ namespace spatial_cell {
    inline void SpatialCell::set_mpi_transfer_enabled(bool transferEnabled) {
       this->mpiTransferEnabled=transferEnabled;
    }
+
+   /*!
+    Check if get_mpi_datatype transfers the data of this cell with the current transfer
+    settings. Cells for which this is false are neither sent nor received.
+    */
+   inline bool SpatialCell::mpi_transfer_is_active() const {
+      // transfer data if we are in the first two layers around a boundary, or if we
+      // send for the whole system; in AMR translation, only the necessary cells
+      return this->mpiTransferEnabled && ((SpatialCell::mpiTransferAtSysBoundaries==false && SpatialCell::mpiTransferInAMRTranslation==false) ||
+                                          (SpatialCell::mpiTransferAtSysBoundaries==true && (this->sysBoundaryLayer ==1 || this->sysBoundaryLayer ==2)) ||
+                                          (SpatialCell::mpiTransferInAMRTranslation==true &&
+                                           this->parameters[CellParams::AMR_TRANSLATE_COMM_X+SpatialCell::mpiTransferXYZTranslation]==true ));
+   }
    
    inline bool SpatialCell::velocity_block_has_children(const vmesh::GlobalID& blockGID,const uint popID) const {
       #ifdef DEBUG_SPATIAL_CELL
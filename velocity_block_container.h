@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "common.h"
+#include "memoryallocation.h"
 #include "unistd.h"
 
 #ifdef DEBUG_VBC
@@ -51,6 +52,7 @@ namespace vmesh {
       Realf* getData(const LID& blockLID);
       const Realf* getData(const LID& blockLID) const;
       Realf* getNullData();
+      void permute(const std::vector<LID>& order);
       Real* getParameters();
       const Real* getParameters() const;
       Real* getParameters(const LID& blockLID);      
@@ -74,11 +76,11 @@ namespace vmesh {
       void exitInvalidLocalID(const LID& localID,const std::string& funcName) const;
       void resize();
       
-      std::vector<Realf,aligned_allocator<Realf,WID3> > block_data;
+      std::vector<Realf,block_allocator<Realf,WID3> > block_data;
       Realf null_block_data[WID3];
       LID currentCapacity;
       LID numberOfBlocks;
-      std::vector<Real,aligned_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > parameters;
+      std::vector<Real,block_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > parameters;
    };
    
    template<typename LID> inline
@@ -101,8 +103,8 @@ namespace vmesh {
     * reserved for velocity blocks.*/
    template<typename LID> inline
    void VelocityBlockContainer<LID>::clear() {
-      std::vector<Realf,aligned_allocator<Realf,WID3> > dummy_data;
-      std::vector<Real,aligned_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters;
+      std::vector<Realf,block_allocator<Realf,WID3> > dummy_data;
+      std::vector<Real,block_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters;
       
       block_data.swap(dummy_data);
       parameters.swap(dummy_parameters);
@@ -220,6 +222,21 @@ namespace vmesh {
       return parameters.data() + blockLID*BlockParams::N_VELOCITY_BLOCK_PARAMS;
    }
    
+   /** Reorder the blocks, block order[i] is moved to local ID i. The capacity is not changed.
+    * @param order Permutation of the local IDs, of size size().*/
+   template<typename LID> inline
+   void VelocityBlockContainer<LID>::permute(const std::vector<LID>& order) {
+      const size_t N_PARAMS = BlockParams::N_VELOCITY_BLOCK_PARAMS;
+      std::vector<Realf,block_allocator<Realf,WID3> > dummy_data(currentCapacity*WID3);
+      std::vector<Real,block_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters(currentCapacity*N_PARAMS);
+      for (LID b=0; b<numberOfBlocks; ++b) {
+         for (size_t i=0; i<WID3; ++i) dummy_data[b*WID3+i] = block_data[order[b]*WID3+i];
+         for (size_t i=0; i<N_PARAMS; ++i) dummy_parameters[b*N_PARAMS+i] = parameters[order[b]*N_PARAMS+i];
+      }
+      dummy_data.swap(block_data);
+      dummy_parameters.swap(parameters);
+   }
+
    template<typename LID> inline
    void VelocityBlockContainer<LID>::pop() {
       if (numberOfBlocks == 0) return;
@@ -269,12 +286,12 @@ namespace vmesh {
    bool VelocityBlockContainer<LID>::recapacitate(const LID& newCapacity) {
       if (newCapacity < numberOfBlocks) return false;
       {
-         std::vector<Realf,aligned_allocator<Realf,WID3> > dummy_data(newCapacity*WID3);
+         std::vector<Realf,block_allocator<Realf,WID3> > dummy_data(newCapacity*WID3);
          for (size_t i=0; i<numberOfBlocks*WID3; ++i) dummy_data[i] = block_data[i];
          dummy_data.swap(block_data);
       }
       {
-         std::vector<Real,aligned_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters(newCapacity*BlockParams::N_VELOCITY_BLOCK_PARAMS);
+         std::vector<Real,block_allocator<Real,BlockParams::N_VELOCITY_BLOCK_PARAMS> > dummy_parameters(newCapacity*BlockParams::N_VELOCITY_BLOCK_PARAMS);
          for (size_t i=0; i<numberOfBlocks*BlockParams::N_VELOCITY_BLOCK_PARAMS; ++i) dummy_parameters[i] = parameters[i];
          dummy_parameters.swap(parameters);
       }
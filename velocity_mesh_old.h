@@ -66,12 +66,14 @@ namespace vmesh {
       GID getGlobalIndexOffset(const uint8_t& refLevel=0);
       std::vector<GID>& getGrid();
       const LID* getGridLength(const uint8_t& refLevel) const;
+      const OpenBucketHashtable<GID,LID>& getHashtable() const;
 //      void     getNeighbors(const GlobalID& globalID,std::vector<GlobalID>& neighborIDs);
       void getIndices(const GID& globalID,uint8_t& refLevel,LID& i,LID& j,LID& k) const;
       size_t getMesh() const;
       LID getLocalID(const GID& globalID) const;
       uint8_t getMaxAllowedRefinementLevel() const;
       GID getMaxVelocityBlocks() const;
+      size_t getModificationCount() const;
       const Real* getMeshMaxLimits() const;
       const Real* getMeshMinLimits() const;
       void getNeighborsAtSameLevel(const GID& globalID,std::vector<GID>& neighborIDs) const;
@@ -91,6 +93,7 @@ namespace vmesh {
       static GID invalidGlobalID();
       static LID invalidLocalID();
       bool isInitialized() const;
+      void permute(const std::vector<LID>& order);
       void pop();
       bool push_back(const GID& globalID);
       bool push_back(const std::vector<GID>& blocks);
@@ -102,6 +105,7 @@ namespace vmesh {
       size_t size() const;
       size_t sizeInBytes() const;
       void swap(VelocityMesh& vm);
+      bool usesDenseLookup() const;
 
     private:
       static std::vector<vmesh::MeshParameters> meshParameters;
@@ -109,7 +113,19 @@ namespace vmesh {
 
       std::vector<GID> localToGlobalMap;
       OpenBucketHashtable<GID,LID> globalToLocalMap; //
+      size_t nModifications;                             /**< Number of changes to the set of blocks, see getModificationCount.*/
       //std::unordered_map<GID,LID> globalToLocalMap;
+      bool denseLookup;                                  /**< If true, local IDs are stored in denseGlobalToLocalMap
+                                                          * instead of globalToLocalMap, see MeshParameters::denseLookup.*/
+      std::vector<LID> denseGlobalToLocalMap;            /**< Local ID of every global ID of the mesh, INVALID_LOCALID if the
+                                                          * block does not exist. Allocated when the first block is added.*/
+
+      void clearLookup();
+      void eraseLocalID(const GID& globalID);
+      bool insertLocalID(const GID& globalID,const LID& localID);
+      LID lookupLocalID(const GID& globalID) const;
+      void setLocalID(const GID& globalID,const LID& localID);
+      void setLookupMode(const bool dense);
    };
 
    // ***** INITIALIZERS FOR STATIC MEMBER VARIABLES ***** //
@@ -120,6 +136,8 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    VelocityMesh<GID,LID>::VelocityMesh() { 
       meshID = std::numeric_limits<size_t>::max();
+      nModifications = 0;
+      denseLookup = false;
    }
    
    template<typename GID,typename LID> inline
@@ -128,14 +146,15 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::capacityInBytes() const {
       return localToGlobalMap.capacity()*sizeof(GID)
-           + globalToLocalMap.bucket_count()*(sizeof(GID)+sizeof(LID));
+           + globalToLocalMap.bucket_count()*(sizeof(GID)+sizeof(LID))
+           + denseGlobalToLocalMap.capacity()*sizeof(LID);
    }
 
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::check() const {
       bool ok = true;
 
-      if (localToGlobalMap.size() != globalToLocalMap.size()) {
+      if (!denseLookup && localToGlobalMap.size() != globalToLocalMap.size()) {
          std::cerr << "VMO ERROR: sizes differ, " << localToGlobalMap.size() << " vs " << globalToLocalMap.size() << std::endl;
          ok = false;
          exit(1);	 
@@ -143,8 +162,7 @@ namespace vmesh {
 
       for (size_t b=0; b<size(); ++b) {
          const LID globalID = localToGlobalMap[b];
-         auto it = globalToLocalMap.find(globalID);
-         const GID localID = it->second;
+         const GID localID = lookupLocalID(globalID);
          if (localID != b) {
             ok = false;
             std::cerr << "VMO ERROR: localToGlobalMap[" << b << "] = " << globalID << " but ";
@@ -159,7 +177,8 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::clear() {
       std::vector<GID>().swap(localToGlobalMap);
-      globalToLocalMap.clear();
+      clearLookup();
+      ++nModifications;
    }
    
    template<typename GID,typename LID> inline
@@ -172,17 +191,16 @@ namespace vmesh {
       const GID sourceGID = localToGlobalMap[sourceLID]; // block at the end of list
       const GID targetGID = localToGlobalMap[targetLID]; // removed block
 
-      // at-function will throw out_of_range exception for non-existing global ID:
-      globalToLocalMap.at(sourceGID) = targetLID;
+      setLocalID(sourceGID,targetLID);
       localToGlobalMap[targetLID]    = sourceGID;
-      globalToLocalMap.at(targetGID) = sourceLID; // These are needed to make pop() work
+      setLocalID(targetGID,sourceLID); // These are needed to make pop() work
       localToGlobalMap[sourceLID]    = targetGID;
       return true;
    }
    
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::count(const GID& globalID) const {
-      return globalToLocalMap.count(globalID);
+      return lookupLocalID(globalID) == invalidLocalID() ? 0 : 1;
    }
    
    template<typename GID,typename LID> inline
@@ -196,7 +214,7 @@ namespace vmesh {
       GID blockGID = getGlobalID(0,i_block,j_block,k_block);
       
       // If the block exists, return it:
-      if (globalToLocalMap.find(blockGID) != globalToLocalMap.end()) {
+      if (lookupLocalID(blockGID) != invalidLocalID()) {
          return blockGID;
       } else {
          return invalidGlobalID();
@@ -379,9 +397,7 @@ namespace vmesh {
 
    template<typename GID,typename LID> inline
    LID VelocityMesh<GID,LID>::getLocalID(const GID& globalID) const {
-      auto it = globalToLocalMap.find(globalID);
-      if (it != globalToLocalMap.end()) return it->second;
-      return invalidLocalID();
+      return lookupLocalID(globalID);
    }
    
    template<typename GID,typename LID> inline
@@ -389,10 +405,27 @@ namespace vmesh {
       return 0;
    }
 
+   /** Get the hash table mapping global IDs to local IDs, for reporting its
+    * load factor and lookup statistics. The table is empty if the mesh uses
+    * a dense lookup table, see usesDenseLookup.*/
+   template<typename GID,typename LID> inline
+   const OpenBucketHashtable<GID,LID>& VelocityMesh<GID,LID>::getHashtable() const {
+      return globalToLocalMap;
+   }
+
    template<typename GID,typename LID> inline
    GID VelocityMesh<GID,LID>::getMaxVelocityBlocks() const {
       return meshParameters[meshID].max_velocity_blocks;
    }
+
+   /** Get the number of changes made to the set of blocks in this mesh. Adding or
+    * removing one block counts as one change, resetting the whole mesh (clear, setGrid,
+    * setNewSize, swap) as one change. The count never decreases, so it can be used to
+    * check that no unrecorded changes were made since a given point.*/
+   template<typename GID,typename LID> inline
+   size_t VelocityMesh<GID,LID>::getModificationCount() const {
+      return nModifications;
+   }
    
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::getMesh() const {
@@ -454,9 +487,9 @@ namespace vmesh {
       GID nbrGlobalID = getGlobalID(0,i+i_off,j+j_off,k+k_off);
       if (nbrGlobalID == invalidGlobalID()) return;
 
-      auto nbr = globalToLocalMap.find(nbrGlobalID);
-      if (nbr != globalToLocalMap.end()) {
-         neighborLocalIDs.push_back(nbr->second);
+      const LID nbrLocalID = lookupLocalID(nbrGlobalID);
+      if (nbrLocalID != invalidLocalID()) {
+         neighborLocalIDs.push_back(nbrLocalID);
          refLevelDifference = 0;
          return;
       }
@@ -520,6 +553,7 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::initialize(const size_t& meshID) {
       this->meshID = meshID;
+      if (meshID < meshParameters.size()) setLookupMode(meshParameters[meshID].denseLookup);
       return true;
    }
    
@@ -583,10 +617,23 @@ namespace vmesh {
 
       const LID lastLID = size()-1;
       const GID lastGID = localToGlobalMap[lastLID];
-      auto last = globalToLocalMap.find(lastGID);
 
-      globalToLocalMap.erase(last);
+      eraseLocalID(lastGID);
       localToGlobalMap.pop_back();
+      ++nModifications;
+   }
+
+   /** Reorder the blocks, block order[i] gets local ID i. The set of blocks does not
+    * change, so this does not count as a modification, see getModificationCount.
+    * @param order Permutation of the local IDs, of size size().*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::permute(const std::vector<LID>& order) {
+      std::vector<GID> newLocalToGlobalMap(localToGlobalMap.size());
+      for (LID i=0; i<newLocalToGlobalMap.size(); ++i) {
+         newLocalToGlobalMap[i] = localToGlobalMap[order[i]];
+         setLocalID(newLocalToGlobalMap[i],i);
+      }
+      localToGlobalMap.swap(newLocalToGlobalMap);
    }
 
    template<typename GID,typename LID> inline
@@ -594,16 +641,25 @@ namespace vmesh {
       if (size() >= meshParameters[meshID].max_velocity_blocks) return false;
       if (globalID == invalidGlobalID()) return false;
 
-      auto position
-        = globalToLocalMap.insert(std::make_pair(globalID,localToGlobalMap.size()));
+      const bool inserted = insertLocalID(globalID,localToGlobalMap.size());
 
-      if (position.second == true) {
+      if (inserted == true) {
          localToGlobalMap.push_back(globalID);
+         ++nModifications;
       }
 
-      return position.second;
+      return inserted;
    }
 
+   /** Add the given blocks to the end of the mesh in one pass. The storage of
+    * both maps is reserved once for all blocks, and each block costs a single
+    * lookup. Blocks that already exist in the mesh, repeated blocks
+    * and invalid global IDs are skipped, the added blocks keep their relative
+    * order. If the list is sorted, consecutive blocks are also close to each
+    * other in the hashtable.
+    * @param blocks Global IDs of the added blocks.
+    * @return If true, all valid new blocks were added. If false, the mesh would have
+    * exceeded the maximum number of blocks and it was not modified.*/
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::push_back(const std::vector<GID>& blocks) {
       if (size()+blocks.size() > meshParameters[meshID].max_velocity_blocks) {
@@ -612,11 +668,16 @@ namespace vmesh {
          std::cerr << ", max is " << meshParameters[meshID].max_velocity_blocks << std::endl;
          return false;
       }
-         
+
+      localToGlobalMap.reserve(localToGlobalMap.size()+blocks.size());
+      if (!denseLookup) globalToLocalMap.reserve(globalToLocalMap.size()+blocks.size());
       for (size_t b=0; b<blocks.size(); ++b) {
-         globalToLocalMap.insert(std::make_pair(blocks[b],localToGlobalMap.size()+b));
+         if (blocks[b] == invalidGlobalID()) continue;
+         if (insertLocalID(blocks[b],localToGlobalMap.size()) == false) continue;
+
+         localToGlobalMap.push_back(blocks[b]);
+         ++nModifications;
       }
-      localToGlobalMap.insert(localToGlobalMap.end(),blocks.begin(),blocks.end());
 
       return true;
    }
@@ -628,19 +689,21 @@ namespace vmesh {
 
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::setGrid() {
-      globalToLocalMap.clear();
+      clearLookup();
       for (size_t i=0; i<localToGlobalMap.size(); ++i) {
-         globalToLocalMap.insert(std::make_pair(localToGlobalMap[i],i));
+         insertLocalID(localToGlobalMap[i],i);
       }
+      ++nModifications;
    }
 
    template<typename GID,typename LID> inline
    bool VelocityMesh<GID,LID>::setGrid(const std::vector<GID>& globalIDs) {
-      globalToLocalMap.clear();
+      clearLookup();
       for (LID i=0; i<globalIDs.size(); ++i) {
-         globalToLocalMap.insert(std::make_pair(globalIDs[i],i));
+         insertLocalID(globalIDs[i],i);
       }
       localToGlobalMap = globalIDs;
+      ++nModifications;
       return true;
    }
 
@@ -648,12 +711,14 @@ namespace vmesh {
    bool VelocityMesh<GID,LID>::setMesh(const size_t& meshID) {
       if (meshID >= meshParameters.size()) return false;
       this->meshID = meshID;
+      setLookupMode(meshParameters[meshID].denseLookup);
       return true;
    }
    
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::setNewSize(const LID& newSize) {
       localToGlobalMap.resize(newSize);
+      ++nModifications;
    }
 
    template<typename GID,typename LID> inline
@@ -664,13 +729,109 @@ namespace vmesh {
    template<typename GID,typename LID> inline
    size_t VelocityMesh<GID,LID>::sizeInBytes() const {
       return globalToLocalMap.size()*sizeof(GID)
-           + localToGlobalMap.size()*(sizeof(GID)+sizeof(LID));
+           + localToGlobalMap.size()*(sizeof(GID)+sizeof(LID))
+           + denseGlobalToLocalMap.size()*sizeof(LID);
    }
 
    template<typename GID,typename LID> inline
    void VelocityMesh<GID,LID>::swap(VelocityMesh& vm) {
       globalToLocalMap.swap(vm.globalToLocalMap);
       localToGlobalMap.swap(vm.localToGlobalMap);
+      denseGlobalToLocalMap.swap(vm.denseGlobalToLocalMap);
+      std::swap(denseLookup,vm.denseLookup);
+      // The counters stay with the objects, both have changed
+      ++nModifications;
+      ++vm.nModifications;
+   }
+
+   /** Query if local IDs are looked up from a dense table indexed by global ID
+    * instead of the hash table. Set per mesh with MeshParameters::denseLookup.*/
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::usesDenseLookup() const {
+      return denseLookup;
+   }
+
+   // ***** PRIVATE LOOKUP FUNCTIONS ***** //
+
+   /** Remove all global ID to local ID mappings.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::clearLookup() {
+      globalToLocalMap.clear();
+      std::vector<LID>().swap(denseGlobalToLocalMap);
+   }
+
+   /** Remove the mapping of the given global ID.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::eraseLocalID(const GID& globalID) {
+      if (denseLookup) {
+         denseGlobalToLocalMap[globalID] = invalidLocalID();
+      } else {
+         globalToLocalMap.erase(globalID);
+      }
+   }
+
+   /** Map the given global ID to the local ID, unless it is already mapped.
+    * This costs a single lookup in both modes. Meshes created before the mesh
+    * parameters were set up (dccrg constructs the cells before
+    * initVelocityGridGeometry) switch to the lookup mode of their mesh here.
+    * @return If true, the mapping was added.*/
+   template<typename GID,typename LID> inline
+   bool VelocityMesh<GID,LID>::insertLocalID(const GID& globalID,const LID& localID) {
+      if (meshID < meshParameters.size() && denseLookup != meshParameters[meshID].denseLookup) {
+         setLookupMode(meshParameters[meshID].denseLookup);
+      }
+      if (denseLookup) {
+         if (denseGlobalToLocalMap.empty()) {
+            denseGlobalToLocalMap.assign(meshParameters[meshID].max_velocity_blocks,invalidLocalID());
+         }
+         if (globalID >= denseGlobalToLocalMap.size()) return false;
+         if (denseGlobalToLocalMap[globalID] != invalidLocalID()) return false;
+         denseGlobalToLocalMap[globalID] = localID;
+         return true;
+      }
+
+      // at() creates the entry if it does not exist, which is
+      // seen as a change in the number of entries
+      const size_t oldFill = globalToLocalMap.size();
+      LID& mappedLocalID = globalToLocalMap.at(globalID);
+      if (globalToLocalMap.size() == oldFill) return false;
+      mappedLocalID = localID;
+      return true;
+   }
+
+   /** Get the local ID of the given global ID, or invalidLocalID() if the block does not exist.*/
+   template<typename GID,typename LID> inline
+   LID VelocityMesh<GID,LID>::lookupLocalID(const GID& globalID) const {
+      if (denseLookup) {
+         if (globalID >= denseGlobalToLocalMap.size()) return invalidLocalID();
+         return denseGlobalToLocalMap[globalID];
+      }
+      auto it = globalToLocalMap.find(globalID);
+      if (it != globalToLocalMap.end()) return it->second;
+      return invalidLocalID();
+   }
+
+   /** Change the local ID of an existing global ID.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::setLocalID(const GID& globalID,const LID& localID) {
+      if (denseLookup) {
+         denseGlobalToLocalMap[globalID] = localID;
+      } else {
+         // at-function will throw out_of_range exception for non-existing global ID:
+         globalToLocalMap.at(globalID) = localID;
+      }
+   }
+
+   /** Select the lookup structure, dense table or hash table, and move the existing
+    * blocks into it. Local IDs are not changed.*/
+   template<typename GID,typename LID> inline
+   void VelocityMesh<GID,LID>::setLookupMode(const bool dense) {
+      if (dense == denseLookup) return;
+      clearLookup();
+      denseLookup = dense;
+      for (size_t i=0; i<localToGlobalMap.size(); ++i) {
+         insertLocalID(localToGlobalMap[i],i);
+      }
    }
    
 } // namespace vmesh
@@ -50,6 +50,9 @@ namespace vmesh {
       vmesh::LocalID gridLength[3];             /**< Number of blocks in mesh per coordinate at base grid level.*/
       vmesh::LocalID blockLength[3];            /**< Number of phase-space cells per coordinate in block.*/
       uint8_t refLevelMaxAllowed;               /**< Maximum refinement level allowed, 0=no refinement.*/
+      bool denseLookup;                         /**< If true, the block local IDs are looked up from a table with 
+                                                 * one entry per possible block instead of a hash table. Meant for 
+                                                 * small meshes that are mostly filled.*/
       
       // ***** DERIVED PARAMETERS, CALCULATED BY VELOCITY MESH ***** //
       bool initialized;                         /**< If true, variables in this struct contain sensible values.*/
@@ -73,6 +76,7 @@ namespace vmesh {
 
       MeshParameters() {
          initialized = false;
+         denseLookup = false;
       }
    };
 
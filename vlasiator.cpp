@@ -52,6 +52,7 @@
 
 #include "object_wrapper.h"
 #include "fieldsolver/gridGlue.hpp"
+#include "vlasovsolver/cpu_kernel_counters.hpp"
 
 #ifdef CATCH_FPE
 #include <fenv.h>
@@ -383,6 +384,7 @@ int main(int argn,char* args[]) {
       #endif
       logFile << " OpenMP threads per process" << endl << writeVerbose;      
    }
+   initializeKernelCounters();
    phiprof::stop("open logFile & diagnostic");
    
    // Init project
@@ -711,6 +713,7 @@ int main(int argn,char* args[]) {
           P::tstep-P::tstep_min >0) {
 
          phiprof::print(MPI_COMM_WORLD,"phiprof");
+         reportKernelCounters();
          
          double currentTime=MPI_Wtime();
          double timePerStep=double(currentTime  - beforeTime) / (P::tstep-beforeStep);
@@ -725,7 +728,11 @@ int main(int argn,char* args[]) {
          beforeTime = MPI_Wtime();
          beforeSimulationTime=P::t;
          beforeStep=P::tstep;
+         #ifdef HASHTABLE_STATISTICS
+         report_grid_memory_consumption(mpiGrid);
+         #else
          //report_grid_memory_consumption(mpiGrid);
+         #endif
          report_process_memory_consumption();
       }
       logFile << writeVerbose;
@@ -25,6 +25,10 @@
 #include <algorithm>
 #include <utility>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "vec.h"
 #include "../object_wrapper.h"
 #include "cpu_acc_sort_blocks.hpp"
@@ -36,44 +40,6 @@
 
 using namespace std;
 using namespace spatial_cell;
-/** Attempt to add the given velocity block to the given velocity mesh.
- * If the block was added to the mesh, its data is set to zero values and 
- * velocity block parameters are calculated.
- * @param blockGID Global ID of the added velocity block.
- * @param vmesh Velocity mesh where the block is added.
- * @param blockContainer Velocity block data container.
- * @return Local ID of the added block. If the block was not added, the 
- * local ID of the null velocity block is returned instead.*/
-vmesh::LocalID addVelocityBlock(const vmesh::GlobalID& blockGID,
-        vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-        vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer) {
-    // Block insert will fail if the block already exists, or if 
-    // there are too many blocks in the velocity mesh.
-    if (vmesh.push_back(blockGID) == false) 
-        return vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID();
-
-    // Insert velocity block data, this will set values to 0.
-    const vmesh::LocalID newBlockLID = blockContainer.push_back();
-
-    #ifdef DEBUG_ACC
-        bool ok = true;
-        if (vmesh.size() != blockContainer.size()) ok = false;
-        if (vmesh.getLocalID(blockGID) != newBlockLID) ok = false;
-        if (ok == false) {
-            stringstream ss;
-            ss << "ERROR in acc: sizes " << vmesh.size() << ' ' << blockContainer.size() << endl;
-            ss << "\t local IDs " << vmesh.getLocalID(blockGID) << " vs " << newBlockLID << endl;
-            cerr << ss.str();
-            exit(1);
-        }
-    #endif
-    
-    // Set block parameters:
-    Real* parameters = blockContainer.getParameters(newBlockLID);
-    vmesh.getBlockCoordinates(blockGID,parameters+BlockParams::VXCRD);
-    vmesh.getCellSize(blockGID,parameters+BlockParams::DVX);
-    return newBlockLID;
-}
 
 
 
@@ -112,22 +78,42 @@ void inline swapBlockIndices(velocity_block_indices_t &blockIndices, const uint
    pre-creates new blocks in a separate loop first (serial operation),
    then the openmp parallization would scale well (better than over
    spatial cells), and would not need synchronization.
+
+   The kernel is compiled separately for each dimension and reconstruction
+   order (degree of the reconstruction polynomial: 1 PLM, 2 PPM, 4 PQM), so
+   that the dimension-dependent index tables and branches are resolved at
+   compile time. map_1d selects the kernel.
+
+   If recordBlockMaxima is true, the maximum value of each target block is
+   recorded into Population::blockMaxima right after its column set has been
+   mapped, while the block is still in cache. All blocks left in the mesh are
+   target blocks, so update_velocity_block_content_lists can use the maxima
+   instead of scanning the block data again.
    
 */
-bool map_1d(SpatialCell* spatial_cell,
-            const uint popID,     
-            Realv intersection, Realv intersection_di, Realv intersection_dj,Realv intersection_dk,
-            const uint dimension) {
+template <uint dimension, int order>
+static bool map_1d_kernel(SpatialCell* spatial_cell,
+                          const uint popID,     
+                          Real intersection, Real intersection_di, Real intersection_dj,Real intersection_dk,
+                          const bool threaded,
+                          const bool recordBlockMaxima) {
+   static_assert(dimension < 3, "map_1d_kernel: dimension must be 0, 1 or 2");
+   static_assert(order == 1 || order == 2 || order == 4, "map_1d_kernel: order must be 1 (PLM), 2 (PPM) or 4 (PQM)");
    no_subnormals();
 
-   Realv dv,v_min;
-   Realv is_temp;
+   Real dv,v_min;
+   Real is_temp;
    uint max_v_length;
    uint block_indices_to_id[3] = {0, 0, 0}; /*< used when computing id of target block, 0 for compiler */
    uint cell_indices_to_id[3] = {0, 0, 0}; /*< used when computing id of target cell in block, 0 for compiler */
 
    vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh    = spatial_cell->get_velocity_mesh(popID);
    vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer = spatial_cell->get_velocity_blocks(popID);
+   Population& pop = spatial_cell->get_population(popID);
+   if (recordBlockMaxima) {
+      pop.blockMaximaValid = false;
+      pop.blockMaxima.clear();
+   }
 
    //nothing to do if no blocks
    if(vmesh.size() == 0 )
@@ -195,7 +181,7 @@ bool map_1d(SpatialCell* spatial_cell,
    const Realv i_dv=1.0/dv;
 
    // sort blocks according to dimension, and divide them into columns
-   vmesh::LocalID* blocks = new vmesh::LocalID[vmesh.size()];
+   vmesh::LocalID* blocks;
    std::vector<uint> columnBlockOffsets;
    std::vector<uint> columnNumBlocks;
    std::vector<uint> setColumnOffsets;
@@ -203,392 +189,575 @@ bool map_1d(SpatialCell* spatial_cell,
    std::vector<int> columnMinBlockK;
    std::vector<int> columnMaxBlockK;
    
-   sortBlocklistByDimension(vmesh, dimension, blocks,
-                            columnBlockOffsets, columnNumBlocks,
-                            setColumnOffsets, setNumColumns);
+   if (Parameters::vlasovAccelerationColumnCache) {
+      // The sorted block lists of the cell are patched with the blocks added and removed
+      // since they were last updated. If the mesh has been changed in some other way
+      // the log does not match the modification count and the lists are rebuilt.
+      if (pop.sortedBlocksValid == false ||
+          pop.sortedBlocksModifications + pop.sortedBlocksChanges.size() != vmesh.getModificationCount()) {
+         for (uint d = 0; d < 3; ++d) {
+            sortBlocksByDimension(vmesh, d, pop.sortedBlocks[d]);
+         }
+      } else {
+         patchSortedBlocks(vmesh, pop.sortedBlocksChanges, pop.sortedBlocks);
+      }
+      pop.sortedBlocksChanges.clear();
+      pop.sortedBlocksModifications = vmesh.getModificationCount();
+      pop.sortedBlocksValid = true;
+
+      // The list is not modified during this call, blocks added and removed below are logged
+      blocks = pop.sortedBlocks[dimension].data();
+      computeColumnOffsets(vmesh, dimension, blocks, vmesh.size(),
+                           columnBlockOffsets, columnNumBlocks,
+                           setColumnOffsets, setNumColumns);
+   } else {
+      blocks = new vmesh::LocalID[vmesh.size()];
+      sortBlocklistByDimension(vmesh, dimension, blocks,
+                               columnBlockOffsets, columnNumBlocks,
+                               setColumnOffsets, setNumColumns);
+   }
    
    // loop over block column sets  (all columns along the dimension with the other dimensions being equal )
+
+   // The column sets are independent, each one reads and writes only its own blocks.
+   // The sets are mapped in batches, and the mesh is modified only between the parallel
+   // loops: target blocks of a batch are created before it is mapped and its emptied
+   // source blocks are removed after it, so the block data pointers stay valid while
+   // the sets are mapped. If threaded is false the region is executed by the calling
+   // thread only, and each set is a batch of its own, so the blocks vacated by a set are
+   // released before the next ones are created, as in the serial mapping. If threaded is
+   // true all sets form one batch, or in streaming mode each thread maps one set per
+   // batch, so that the cell grows by at most one set per thread instead of by all its
+   // new target blocks.
+   const uint nSets = setColumnOffsets.size();
+   columnMinBlockK.resize(columnNumBlocks.size());
+   columnMaxBlockK.resize(columnNumBlocks.size());
+   // Source blocks that are not target blocks, removed after the mapping of each batch
+   std::vector<vmesh::GlobalID> removedBlocks;
+
+   #pragma omp parallel if (threaded)
+   {
+      // Compute the range of target blocks of each column
+      #pragma omp for schedule(dynamic,1)
+      for (uint setIndex=0; setIndex < nSets; ++setIndex) {
+         uint8_t refLevel = 0;
+         /*need x,y coordinate of this column set of blocks, take it from first
+           block in first column*/
+         velocity_block_indices_t setFirstBlockIndices;
+         vmesh.getIndices(blocks[columnBlockOffsets[setColumnOffsets[setIndex]]],
+                          refLevel, 
+                          setFirstBlockIndices[0], setFirstBlockIndices[1], setFirstBlockIndices[2]);
+         swapBlockIndices(setFirstBlockIndices, dimension);
+         /*compute the maximum starting point of the lagrangian (target) grid
+           (base level) within the 4 corner cells in this
+           block. Needed for computig maximum extent of target column*/
       
+         Real max_intersectionMin = intersection +
+                                         (setFirstBlockIndices[0] * WID + 0) * intersection_di +
+                                         (setFirstBlockIndices[1] * WID + 0) * intersection_dj;
+         max_intersectionMin =  std::max(max_intersectionMin,
+                                         intersection +
+                                         (setFirstBlockIndices[0] * WID + 0) * intersection_di + 
+                                         (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
+         max_intersectionMin =  std::max(max_intersectionMin,
+                                         intersection +
+                                         (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
+                                         (setFirstBlockIndices[1] * WID + 0) * intersection_dj);
+         max_intersectionMin =  std::max(max_intersectionMin,
+                                         intersection +
+                                         (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
+                                         (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
+      
+         Real min_intersectionMin = intersection +
+                                         (setFirstBlockIndices[0] * WID + 0) * intersection_di +
+                                         (setFirstBlockIndices[1] * WID + 0) * intersection_dj;
+         min_intersectionMin =  std::min(min_intersectionMin,
+                                         intersection +
+                                         (setFirstBlockIndices[0] * WID + 0) * intersection_di + 
+                                         (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
+         min_intersectionMin =  std::min(min_intersectionMin,
+                                         intersection +
+                                         (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
+                                         (setFirstBlockIndices[1] * WID + 0) * intersection_dj);
+         min_intersectionMin =  std::min(min_intersectionMin,
+                                         intersection +
+                                         (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
+                                         (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
+
+         //now, record the target blocks of each column
+         for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
+            const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
+            vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
+            velocity_block_indices_t firstBlockIndices;
+            velocity_block_indices_t lastBlockIndices;
+            vmesh.getIndices(cblocks[0],
+                             refLevel, 
+                             firstBlockIndices[0], firstBlockIndices[1], firstBlockIndices[2]);
+            vmesh.getIndices(cblocks[n_cblocks -1],
+                             refLevel, 
+                             lastBlockIndices[0], lastBlockIndices[1], lastBlockIndices[2]);
+            swapBlockIndices(firstBlockIndices, dimension);
+            swapBlockIndices(lastBlockIndices, dimension);
+         
+            /*firstBlockV is in z the minimum velocity value of the lower
+             * edge in source grid.
+              *lastBlockV is in z the maximum velocity value of the upper
+             * edge in source grid. Added 1.01*dv to account for unexpected issues*/ 
+            double firstBlockMinV = (WID * firstBlockIndices[2]) * dv + v_min;
+            double lastBlockMaxV = (WID * (lastBlockIndices[2] + 1)) * dv + v_min;
+         
+            /*gk is now the k value in terms of cells in target
+            grid. This distance between max_intersectionMin (so lagrangian
+            plan, well max value here) and V of source grid, divided by
+            intersection_dk to find out how many grid cells that is*/
+            const int firstBlock_gk = (int)((firstBlockMinV - max_intersectionMin)/intersection_dk);
+            const int lastBlock_gk = (int)((lastBlockMaxV - min_intersectionMin)/intersection_dk);
+
+            int firstBlockIndexK = firstBlock_gk/WID;         
+            int lastBlockIndexK = lastBlock_gk/WID;
+         
+            //now enforce mesh limits for target column blocks
+            firstBlockIndexK = (firstBlockIndexK >= 0)            ? firstBlockIndexK : 0;
+            firstBlockIndexK = (firstBlockIndexK < max_v_length ) ? firstBlockIndexK : max_v_length - 1;
+            lastBlockIndexK  = (lastBlockIndexK  >= 0)            ? lastBlockIndexK  : 0;
+            lastBlockIndexK  = (lastBlockIndexK  < max_v_length ) ? lastBlockIndexK  : max_v_length - 1;
+            if(firstBlockIndexK < Parameters::bailout_velocity_space_wall_margin
+               || firstBlockIndexK >= max_v_length - Parameters::bailout_velocity_space_wall_margin
+               || lastBlockIndexK < Parameters::bailout_velocity_space_wall_margin
+               || lastBlockIndexK >= max_v_length - Parameters::bailout_velocity_space_wall_margin
+            ) {
+               string message = "Some target blocks in acceleration are going to be less than ";
+               message += std::to_string(Parameters::bailout_velocity_space_wall_margin);
+               message += " blocks away from the current velocity space walls for population ";
+               message += getObjectWrapper().particleSpecies[popID].name;
+               message += " at CellID ";
+               message += std::to_string(spatial_cell->parameters[CellParams::CELLID]);
+               message += ". Consider expanding velocity space for that population.";
+               bailout(true, message, __FILE__, __LINE__);
+            }
+         
+            //store for each column firstBlockIndexK, and lastBlockIndexK
+            columnMinBlockK[columnIndex] = firstBlockIndexK;
+            columnMaxBlockK[columnIndex] = lastBlockIndexK;
+         }
+      }
+
 /*   
      values array used to store column data The max size is the worst
      case scenario with every second block having content, creating up
      to ( MAX_BLOCKS_PER_DIM / 2 + 1) columns with each needing three
      blocks (two for padding)
 */
-   Vec values[(3 * ( MAX_BLOCKS_PER_DIM / 2 + 1)) * WID3 / VECL];
-   /*pointers to target block datas*/
-   Realf *blockIndexToBlockData[MAX_BLOCKS_PER_DIM];
-   bool isTargetBlock[MAX_BLOCKS_PER_DIM];
-   bool isSourceBlock[MAX_BLOCKS_PER_DIM];
-
-   for( uint setIndex=0; setIndex< setColumnOffsets.size(); ++setIndex) {
-      uint8_t refLevel = 0;
-      //init 
-      for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
-         blockIndexToBlockData[blockK] =  NULL;
-         isTargetBlock[blockK] = false;
-         isSourceBlock[blockK] = false;
-      }
-      
-      //Load data into values array (this also zeroes the original data)
-      uint valuesColumnOffset = 0; //offset to values array for data in a column in this set
-      for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
-         const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
-         vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
-         loadColumnBlockData(vmesh, blockContainer, cblocks, n_cblocks, dimension, values + valuesColumnOffset);
-         valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL); // there are WID3/VECL elements of type Vec per block
+      Vec values[(3 * ( MAX_BLOCKS_PER_DIM / 2 + 1)) * WID3 / VECL];
+      /*pointers to target block datas*/
+      Realf *blockIndexToBlockData[MAX_BLOCKS_PER_DIM];
+      bool isTargetBlock[MAX_BLOCKS_PER_DIM];
+      // Maxima of the target blocks mapped by this thread
+      std::vector<std::pair<vmesh::GlobalID,Realf> > threadBlockMaxima;
+
+      #ifdef _OPENMP
+      const uint nThreads = omp_get_num_threads();
+      #else
+      const uint nThreads = 1;
+      #endif
+      uint setsPerBatch = 1;
+      if (threaded) {
+         setsPerBatch = Parameters::vlasovAccelerationStreaming ? nThreads : std::max(nSets, 1u);
       }
+      for (uint batchBegin = 0; batchBegin < nSets; batchBegin += setsPerBatch) {
+         const uint batchEnd = std::min(nSets, batchBegin + setsPerBatch);
+
+         //now add target blocks that do not yet exist, and collect source blocks
+         //that are not target blocks for removal
+         #pragma omp single
+         {
+            bool isSourceBlock[MAX_BLOCKS_PER_DIM];
+            // Target blocks that do not exist yet, added with one bulk insert
+            std::vector<vmesh::GlobalID> newBlocks;
+            for (uint setIndex=batchBegin; setIndex < batchEnd; ++setIndex) {
+               uint8_t refLevel = 0;
+               for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+                  isTargetBlock[blockK] = false;
+                  isSourceBlock[blockK] = false;
+               }
+               velocity_block_indices_t setFirstBlockIndices;
+               vmesh.getIndices(blocks[columnBlockOffsets[setColumnOffsets[setIndex]]],
+                                refLevel,
+                                setFirstBlockIndices[0], setFirstBlockIndices[1], setFirstBlockIndices[2]);
+               swapBlockIndices(setFirstBlockIndices, dimension);
+
+               for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
+                  const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
+                  vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
+                  velocity_block_indices_t firstBlockIndices;
+                  velocity_block_indices_t lastBlockIndices;
+                  vmesh.getIndices(cblocks[0],
+                                   refLevel,
+                                   firstBlockIndices[0], firstBlockIndices[1], firstBlockIndices[2]);
+                  vmesh.getIndices(cblocks[n_cblocks -1],
+                                   refLevel,
+                                   lastBlockIndices[0], lastBlockIndices[1], lastBlockIndices[2]);
+                  swapBlockIndices(firstBlockIndices, dimension);
+                  swapBlockIndices(lastBlockIndices, dimension);
+
+                  //store source blocks
+                  for (uint blockK = firstBlockIndices[2]; blockK <= lastBlockIndices[2]; blockK++){
+                     isSourceBlock[blockK] = true;
+                  }
 
+                  //store target blocks
+                  for (int blockK = columnMinBlockK[columnIndex]; blockK <= columnMaxBlockK[columnIndex]; blockK++){
+                     isTargetBlock[blockK]=true;
+                  }
+               }
 
-      /*need x,y coordinate of this column set of blocks, take it from first
-        block in first column*/
-      velocity_block_indices_t setFirstBlockIndices;
-      vmesh.getIndices(blocks[columnBlockOffsets[setColumnOffsets[setIndex]]],
-                       refLevel, 
-                       setFirstBlockIndices[0], setFirstBlockIndices[1], setFirstBlockIndices[2]);
-      swapBlockIndices(setFirstBlockIndices, dimension);
-      /*compute the maximum starting point of the lagrangian (target) grid
-        (base level) within the 4 corner cells in this
-        block. Needed for computig maximum extent of target column*/
-      
-      Realv max_intersectionMin = intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di +
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj;
-      max_intersectionMin =  std::max(max_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-      max_intersectionMin =  std::max(max_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj);
-      max_intersectionMin =  std::max(max_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-      
-      Realv min_intersectionMin = intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di +
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj;
-      min_intersectionMin =  std::min(min_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + 0) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-      min_intersectionMin =  std::min(min_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + 0) * intersection_dj);
-      min_intersectionMin =  std::min(min_intersectionMin,
-                                      intersection +
-                                      (setFirstBlockIndices[0] * WID + WID - 1) * intersection_di + 
-                                      (setFirstBlockIndices[1] * WID + WID - 1) * intersection_dj);
-
-      //now, record which blocks are target blocks
-      for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
-         const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
-         vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
-         velocity_block_indices_t firstBlockIndices;
-         velocity_block_indices_t lastBlockIndices;
-         vmesh.getIndices(cblocks[0],
-                          refLevel, 
-                          firstBlockIndices[0], firstBlockIndices[1], firstBlockIndices[2]);
-         vmesh.getIndices(cblocks[n_cblocks -1],
-                          refLevel, 
-                          lastBlockIndices[0], lastBlockIndices[1], lastBlockIndices[2]);
-         swapBlockIndices(firstBlockIndices, dimension);
-         swapBlockIndices(lastBlockIndices, dimension);
-         
-         /*firstBlockV is in z the minimum velocity value of the lower
-          * edge in source grid.
-           *lastBlockV is in z the maximum velocity value of the upper
-          * edge in source grid. Added 1.01*dv to account for unexpected issues*/ 
-         double firstBlockMinV = (WID * firstBlockIndices[2]) * dv + v_min;
-         double lastBlockMaxV = (WID * (lastBlockIndices[2] + 1)) * dv + v_min;
-         
-         /*gk is now the k value in terms of cells in target
-         grid. This distance between max_intersectionMin (so lagrangian
-         plan, well max value here) and V of source grid, divided by
-         intersection_dk to find out how many grid cells that is*/
-         const int firstBlock_gk = (int)((firstBlockMinV - max_intersectionMin)/intersection_dk);
-         const int lastBlock_gk = (int)((lastBlockMaxV - min_intersectionMin)/intersection_dk);
-
-         int firstBlockIndexK = firstBlock_gk/WID;         
-         int lastBlockIndexK = lastBlock_gk/WID;
-         
-         //now enforce mesh limits for target column blocks
-         firstBlockIndexK = (firstBlockIndexK >= 0)            ? firstBlockIndexK : 0;
-         firstBlockIndexK = (firstBlockIndexK < max_v_length ) ? firstBlockIndexK : max_v_length - 1;
-         lastBlockIndexK  = (lastBlockIndexK  >= 0)            ? lastBlockIndexK  : 0;
-         lastBlockIndexK  = (lastBlockIndexK  < max_v_length ) ? lastBlockIndexK  : max_v_length - 1;
-         if(firstBlockIndexK < Parameters::bailout_velocity_space_wall_margin
-            || firstBlockIndexK >= max_v_length - Parameters::bailout_velocity_space_wall_margin
-            || lastBlockIndexK < Parameters::bailout_velocity_space_wall_margin
-            || lastBlockIndexK >= max_v_length - Parameters::bailout_velocity_space_wall_margin
-         ) {
-            string message = "Some target blocks in acceleration are going to be less than ";
-            message += std::to_string(Parameters::bailout_velocity_space_wall_margin);
-            message += " blocks away from the current velocity space walls for population ";
-            message += getObjectWrapper().particleSpecies[popID].name;
-            message += " at CellID ";
-            message += std::to_string(spatial_cell->parameters[CellParams::CELLID]);
-            message += ". Consider expanding velocity space for that population.";
-            bailout(true, message, __FILE__, __LINE__);
-         }
-         
-         //store source blocks
-         for (uint blockK = firstBlockIndices[2]; blockK <= lastBlockIndices[2]; blockK++){
-            isSourceBlock[blockK] = true;
-         }
-         
-         //store target blocks
-         for (int blockK = firstBlockIndexK; blockK <= lastBlockIndexK; blockK++){
-            isTargetBlock[blockK]=true;
+               for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+                  const int targetBlock =
+                     setFirstBlockIndices[0] * block_indices_to_id[0] +
+                     setFirstBlockIndices[1] * block_indices_to_id[1] +
+                     blockK                  * block_indices_to_id[2];
+                  if(isTargetBlock[blockK] && !isSourceBlock[blockK] )  {
+                     newBlocks.push_back(targetBlock);
+                  }
+                  if(!isTargetBlock[blockK] && isSourceBlock[blockK] )  {
+                     removedBlocks.push_back(targetBlock);
+                  }
+               }
+            }
+            spatial_cell->add_velocity_blocks(newBlocks, popID);
          }
 
-         //store also for each column firstBlockIndexK, and lastBlockIndexK
-         columnMinBlockK.push_back(firstBlockIndexK);
-         columnMaxBlockK.push_back(lastBlockIndexK);
-      }
+         #pragma omp for schedule(dynamic,1)
+         for (uint setIndex=batchBegin; setIndex < batchEnd; ++setIndex) {
+            uint8_t refLevel = 0;
+            //init 
+            for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+               blockIndexToBlockData[blockK] =  NULL;
+               isTargetBlock[blockK] = false;
+            }
 
-      //now add target blocks that do not yet exist and remove source blocks
-      //that are not target blocks
-      for (uint blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
-         if(isTargetBlock[blockK] && !isSourceBlock[blockK] )  {
-            const int targetBlock =
-               setFirstBlockIndices[0] * block_indices_to_id[0] +
-               setFirstBlockIndices[1] * block_indices_to_id[1] +
-               blockK                  * block_indices_to_id[2];
-            addVelocityBlock(targetBlock, vmesh, blockContainer);
-            
-         }
-         if(!isTargetBlock[blockK] && isSourceBlock[blockK] )  {
-            const int targetBlock =
-               setFirstBlockIndices[0] * block_indices_to_id[0] +
-               setFirstBlockIndices[1] * block_indices_to_id[1] +
-               blockK                  * block_indices_to_id[2];
+            //Load data into values array (this also zeroes the original data)
+            uint valuesColumnOffset = 0; //offset to values array for data in a column in this set
+            for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
+               const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
+               vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
+               loadColumnBlockData(vmesh, blockContainer, cblocks, n_cblocks, dimension, values + valuesColumnOffset);
+               valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL); // there are WID3/VECL elements of type Vec per block
+               for (int blockK = columnMinBlockK[columnIndex]; blockK <= columnMaxBlockK[columnIndex]; blockK++){
+                  isTargetBlock[blockK]=true;
+               }
+            }
 
-            spatial_cell->remove_velocity_block(targetBlock, popID);
-         }
-      }
+            velocity_block_indices_t setFirstBlockIndices;
+            vmesh.getIndices(blocks[columnBlockOffsets[setColumnOffsets[setIndex]]],
+                             refLevel,
+                             setFirstBlockIndices[0], setFirstBlockIndices[1], setFirstBlockIndices[2]);
+            swapBlockIndices(setFirstBlockIndices, dimension);
+
+            /*now store pointer to blocks, all target blocks exist and the mesh is not
+              modified until all sets of the batch have been mapped*/
+            for (int blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+               if(isTargetBlock[blockK])  {
+                  const int targetBlock =
+                     setFirstBlockIndices[0] * block_indices_to_id[0] +
+                     setFirstBlockIndices[1] * block_indices_to_id[1] +
+                     blockK                  * block_indices_to_id[2];
+                  const vmesh::LocalID tblockLID = vmesh.getLocalID(targetBlock);
+                  // Get pointer to target block data.
+                  blockIndexToBlockData[blockK] = blockContainer.getData(tblockLID);
+               }
+            }
 
-     /*now store pointer to blocks, cannot do it at the same time as adding
-      them since they might move due to re-allocations or migrated when
-      removing blocks*/
-      for (int blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
-         if(isTargetBlock[blockK])  {
-            const int targetBlock =
-               setFirstBlockIndices[0] * block_indices_to_id[0] +
-               setFirstBlockIndices[1] * block_indices_to_id[1] +
-               blockK                  * block_indices_to_id[2];
-            const vmesh::LocalID tblockLID = vmesh.getLocalID(targetBlock);
-            // Get pointer to target block data.
-            blockIndexToBlockData[blockK] = blockContainer.getData(tblockLID);
-         }
-      }
-      
-      
+            // loop over columns in set and do the mapping
+            valuesColumnOffset = 0; //offset to values array for data in a column in this set
+            for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
+               const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
+               vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
       
-      // loop over columns in set and do the mapping
-      valuesColumnOffset = 0; //offset to values array for data in a column in this set
-      for(uint columnIndex = setColumnOffsets[setIndex]; columnIndex < setColumnOffsets[setIndex] + setNumColumns[setIndex] ; columnIndex ++){
-         const vmesh::LocalID n_cblocks = columnNumBlocks[columnIndex];
-         vmesh::GlobalID* cblocks = blocks + columnBlockOffsets[columnIndex]; //column blocks
-      
-         // compute the common indices for this block column set
-         //First block in column
-         velocity_block_indices_t block_indices_begin;
-         uint8_t refLevel;
-         vmesh.getIndices(cblocks[0],refLevel,block_indices_begin[0],block_indices_begin[1],block_indices_begin[2]);
+               // compute the common indices for this block column set
+               //First block in column
+               velocity_block_indices_t block_indices_begin;
+               uint8_t refLevel;
+               vmesh.getIndices(cblocks[0],refLevel,block_indices_begin[0],block_indices_begin[1],block_indices_begin[2]);
          
-         // Switch block indices according to dimensions, the algorithm has
-         // been written for integrating along z.
-         swapBlockIndices(block_indices_begin, dimension);
+               // Switch block indices according to dimensions, the algorithm has
+               // been written for integrating along z.
+               swapBlockIndices(block_indices_begin, dimension);
 
-         /*  i,j,k are now relative to the order in which we copied data to the values array. 
-             After this point in the k,j,i loops there should be no branches based on dimensions
+               /*  i,j,k are now relative to the order in which we copied data to the values array. 
+                   After this point in the k,j,i loops there should be no branches based on dimensions
           
-             Note that the i dimension is vectorized, and thus there are no loops over i
-         */
-         for (uint j = 0; j < WID; j += VECL/WID){ 
-            // create vectors with the i and j indices in the vector position on the plane.
-            #if VECL == 4       
-            const Veci i_indices = Veci(0, 1, 2, 3);
-            const Veci j_indices = Veci(j, j, j, j);
-            #elif VECL == 8
-            const Veci i_indices = Veci(0, 1, 2, 3,
-                                        0, 1, 2, 3);
-            const Veci j_indices = Veci(j, j, j, j,
-                                        j + 1, j + 1, j + 1, j + 1);
-            #elif VECL == 16
-            const Veci i_indices = Veci(0, 1, 2, 3,
-                                        0, 1, 2, 3,
-                                        0, 1, 2, 3,
-                                        0, 1, 2, 3);
-            const Veci j_indices = Veci(j, j, j, j,
-                                        j + 1, j + 1, j + 1, j + 1,
-                                        j + 2, j + 2, j + 2, j + 2,
-                                        j + 3, j + 3, j + 3, j + 3);
-            #endif
-
-            const Veci  target_cell_index_common =
-               i_indices * cell_indices_to_id[0] +
-               j_indices * cell_indices_to_id[1];
-       
-            const int target_block_index_common =
-               block_indices_begin[0] * block_indices_to_id[0] +
-               block_indices_begin[1] * block_indices_to_id[1];
+                   Note that the i dimension is vectorized, and thus there are no loops over i
+               */
+               for (uint j = 0; j < WID; j += VECL/WID){ 
+                  // create vectors with the i and j indices in the vector position on the plane.
+                  #if VECL == 4       
+                  const Veci i_indices = Veci(0, 1, 2, 3);
+                  const Veci j_indices = Veci(j, j, j, j);
+                  #elif VECL == 8
+                  const Veci i_indices = Veci(0, 1, 2, 3,
+                                              0, 1, 2, 3);
+                  const Veci j_indices = Veci(j, j, j, j,
+                                              j + 1, j + 1, j + 1, j + 1);
+                  #elif VECL == 16
+                  const Veci i_indices = Veci(0, 1, 2, 3,
+                                              0, 1, 2, 3,
+                                              0, 1, 2, 3,
+                                              0, 1, 2, 3);
+                  const Veci j_indices = Veci(j, j, j, j,
+                                              j + 1, j + 1, j + 1, j + 1,
+                                              j + 2, j + 2, j + 2, j + 2,
+                                              j + 3, j + 3, j + 3, j + 3);
+                  #endif
+
+                  const Veci  target_cell_index_common =
+                     i_indices * cell_indices_to_id[0] +
+                     j_indices * cell_indices_to_id[1];
        
-            /* 
-               intersection_min is the intersection z coordinate (z after
-               swaps that is) of the lowest possible z plane for each i,j
-               index (i in vector)
-            */
+                  const int target_block_index_common =
+                     block_indices_begin[0] * block_indices_to_id[0] +
+                     block_indices_begin[1] * block_indices_to_id[1];
        
-            const Vec intersection_min =
-               intersection +
-               (block_indices_begin[0] * WID + to_realv(i_indices)) * intersection_di + 
-               (block_indices_begin[1] * WID + to_realv(j_indices)) * intersection_dj;
-            
-            /*compute some initial values, that are used to set up the
-             * shifting of values as we go through all blocks in
-             * order. See comments where they are shifted for
-             * explanations of their meaning*/
-            Vec v_r((WID * block_indices_begin[2]) * dv + v_min);
-            Vec lagrangian_v_r((v_r-intersection_min)/intersection_dk);
-#if VECTORCLASS_H >= 20000
-            Veci lagrangian_gk_r=truncatei(lagrangian_v_r);
-#else
-            Veci lagrangian_gk_r=truncate_to_int(lagrangian_v_r);
-#endif
-
-            /*compute location of min and max, this does not change for one
-             * column (or even for this set of intersections, and can be used
-             * to quickly compute max and min later on*/
-            //TODO, these can be computed much earlier, since they are
-            //identiacal for each set of intersections
-            int minGkIndex=0, maxGkIndex=0; // 0 for compiler
-            {
-               Realv maxV = std::numeric_limits<Realv>::min();
-               Realv minV = std::numeric_limits<Realv>::max();
-               for(int i = 0; i < VECL; i++) {
-                  if ( lagrangian_v_r[i] > maxV) {
-                     maxV = lagrangian_v_r[i];
-                     maxGkIndex = i;
+                  /* 
+                     lagrangian_start is the coordinate of the lower edge of the
+                     column in the Lagrangian grid, in units of target cells, for
+                     each i,j index (i in vector). The intersection z coordinate
+                     (z after swaps that is) of the lowest possible z plane and the
+                     velocity are both large compared to their difference, so
+                     the difference is computed in Real. The vectors, which may be
+                     single precision, only handle Lagrangian coordinates that
+                     are offsets from it.
+                  */
+                  Realv lagrangian_start_array[VECL];
+                  for (int i = 0; i < VECL; i++) {
+                     const Real intersection_min =
+                        intersection +
+                        (block_indices_begin[0] * WID + (Real)i_indices[i]) * intersection_di + 
+                        (block_indices_begin[1] * WID + (Real)j_indices[i]) * intersection_dj;
+                     lagrangian_start_array[i] = ((WID * block_indices_begin[2]) * dv + v_min - intersection_min) / intersection_dk;
                   }
-                  if ( lagrangian_v_r[i] < minV) {
-                     minV = lagrangian_v_r[i];
-                     minGkIndex = i;
+                  Vec lagrangian_start;
+                  lagrangian_start.load(lagrangian_start_array);
+                  // Length of one source cell, and of one target cell relative to a source cell
+                  const Realv lagrangian_dv = dv / intersection_dk;
+                  const Realv target_dv = intersection_dk * i_dv;
+
+                  /*compute some initial values, that are used to set up the
+                   * shifting of values as we go through all blocks in
+                   * order. See comments where they are shifted for
+                   * explanations of their meaning*/
+                  Vec lagrangian_v_r(lagrangian_start);
+      #if VECTORCLASS_H >= 20000
+                  Veci lagrangian_gk_r=truncatei(lagrangian_v_r);
+      #else
+                  Veci lagrangian_gk_r=truncate_to_int(lagrangian_v_r);
+      #endif
+
+                  /*compute location of min and max, this does not change for one
+                   * column (or even for this set of intersections, and can be used
+                   * to quickly compute max and min later on*/
+                  //TODO, these can be computed much earlier, since they are
+                  //identiacal for each set of intersections
+                  int minGkIndex=0, maxGkIndex=0; // 0 for compiler
+                  {
+                     Realv maxV = std::numeric_limits<Realv>::min();
+                     Realv minV = std::numeric_limits<Realv>::max();
+                     for(int i = 0; i < VECL; i++) {
+                        if ( lagrangian_v_r[i] > maxV) {
+                           maxV = lagrangian_v_r[i];
+                           maxGkIndex = i;
+                        }
+                        if ( lagrangian_v_r[i] < minV) {
+                           minV = lagrangian_v_r[i];
+                           minGkIndex = i;
+                        }
+                     }
                   }
-               }
-            }
             
             
-            // loop through all blocks in column and compute the mapping as integrals.
-            for (uint k=0; k < WID * n_cblocks; ++k ){
-               // Compute reconstructions 
-               // values + i_pcolumnv(n_cblocks, -1, j, 0) is the starting point of the column data for fixed j
-               // k + WID is the index where we have stored k index, WID amount of padding.
-               #ifdef ACC_SEMILAG_PLM
-               Vec a[2];
-               compute_plm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), k + WID , a, spatial_cell->getVelocityBlockMinValue(popID));
-               #endif
-               #ifdef ACC_SEMILAG_PPM
-               Vec a[3];
-               compute_ppm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), h4, k + WID, a, spatial_cell->getVelocityBlockMinValue(popID));
-               #endif
-               #ifdef ACC_SEMILAG_PQM
-               Vec a[5];
-               compute_pqm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), h8, k + WID, a, spatial_cell->getVelocityBlockMinValue(popID));
-               #endif
+                  // loop through all blocks in column and compute the mapping as integrals.
+                  for (uint k=0; k < WID * n_cblocks; ++k ){
+                     // Compute reconstructions 
+                     // values + i_pcolumnv(n_cblocks, -1, j, 0) is the starting point of the column data for fixed j
+                     // k + WID is the index where we have stored k index, WID amount of padding.
+                     Vec a[order + 1];
+                     if (order == 1) {
+                        compute_plm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), k + WID , a, spatial_cell->getVelocityBlockMinValue(popID));
+                     } else if (order == 2) {
+                        compute_ppm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), h4, k + WID, a, spatial_cell->getVelocityBlockMinValue(popID));
+                     } else {
+                        compute_pqm_coeff(values + valuesColumnOffset + i_pcolumnv(j, 0, -1, n_cblocks), h8, k + WID, a, spatial_cell->getVelocityBlockMinValue(popID));
+                     }
                
-               // set the initial value for the integrand at the boundary at v = 0 
-               // (in reduced cell units), this will be shifted to target_density_1, see below.
-               Vec target_density_r(0.0);
-               // v_l, v_r are the left and right velocity coordinates of source cell. Left is the old right.
-               Vec v_l = v_r; 
-               v_r += dv;
+                     // set the initial value for the integrand at the boundary at v = 0 
+                     // (in reduced cell units), this will be shifted to target_density_1, see below.
+                     Vec target_density_r(0.0);
+                     // lagrangian_v_l, lagrangian_v_r are the left and right coordinates of the source
+                     // cell in the Lagrangian grid. Left is the old right. The right one is computed
+                     // from the start of the column so that rounding errors do not accumulate.
+                     const Vec lagrangian_v_l = lagrangian_v_r;
+                     lagrangian_v_r = lagrangian_start + (Realv)(k + 1) * lagrangian_dv;
                
-               // left(l) and right(r) k values (global index) in the target
-               // Lagrangian grid, the intersecting cells. Again old right is new left.
-               const Veci lagrangian_gk_l = lagrangian_gk_r;
-#if VECTORCLASS_H >= 20000
-               lagrangian_gk_r = truncatei((v_r-intersection_min)/intersection_dk);
-#else
-               lagrangian_gk_r = truncate_to_int((v_r-intersection_min)/intersection_dk);
-#endif
+                     // left(l) and right(r) k values (global index) in the target
+                     // Lagrangian grid, the intersecting cells. Again old right is new left.
+                     const Veci lagrangian_gk_l = lagrangian_gk_r;
+      #if VECTORCLASS_H >= 20000
+                     lagrangian_gk_r = truncatei(lagrangian_v_r);
+      #else
+                     lagrangian_gk_r = truncate_to_int(lagrangian_v_r);
+      #endif
                
-               //limits in lagrangian k for target column. Also take into
-               //account limits of target column
-               int minGk = std::max(int(lagrangian_gk_l[minGkIndex]), int(columnMinBlockK[columnIndex] * WID));
-               int maxGk = std::min(int(lagrangian_gk_r[maxGkIndex]), int((columnMaxBlockK[columnIndex] + 1) * WID - 1));
+                     //limits in lagrangian k for target column. Also take into
+                     //account limits of target column
+                     int minGk = std::max(int(lagrangian_gk_l[minGkIndex]), int(columnMinBlockK[columnIndex] * WID));
+                     int maxGk = std::min(int(lagrangian_gk_r[maxGkIndex]), int((columnMaxBlockK[columnIndex] + 1) * WID - 1));
                
-               for(int gk = minGk; gk <= maxGk; gk++){ 
-                  const int blockK = gk/WID;
-                  const int gk_mod_WID = (gk - blockK * WID);
-                  //the block of the Lagrangian cell to which we map
-                  const int target_block(target_block_index_common + blockK * block_indices_to_id[2]);
+                     for(int gk = minGk; gk <= maxGk; gk++){ 
+                        const int blockK = gk/WID;
+                        const int gk_mod_WID = (gk - blockK * WID);
+                        //the block of the Lagrangian cell to which we map
+                        const int target_block(target_block_index_common + blockK * block_indices_to_id[2]);
                   
-                  //cell indices in the target block  (TODO: to be replaced by
-                  //compile time generated scatter write operation)
-                  const Veci target_cell(target_cell_index_common + gk_mod_WID * cell_indices_to_id[2]);
+                        //cell indices in the target block  (TODO: to be replaced by
+                        //compile time generated scatter write operation)
+                        const Veci target_cell(target_cell_index_common + gk_mod_WID * cell_indices_to_id[2]);
                
-                  //the velocity between which we will integrate to put mass
-                  //in the targe cell. If both v_r and v_l are in same cell
-                  //then v_1,v_2 should be between v_l and v_r.
-                  //v_1 and v_2 normalized to be between 0 and 1 in the cell.
-                  //For vector elements where gk is already larger than needed (lagrangian_gk_r), v_2=v_1=v_r and thus the value is zero.
-                  const Vec v_norm_r = (  min(  max( (gk + 1) * intersection_dk + intersection_min, v_l), v_r) - v_l) * i_dv;
-                  /*shift, old right is new left*/
-                  const Vec target_density_l = target_density_r;
-
-                  // compute right integrand
-                  #ifdef ACC_SEMILAG_PLM
-                  target_density_r =
-                     v_norm_r * ( a[0] + v_norm_r * a[1] );
-                  #endif
-                  #ifdef ACC_SEMILAG_PPM
-                  target_density_r =
-                     v_norm_r * ( a[0] + v_norm_r * ( a[1] + v_norm_r * a[2] ) );
-
-                  #endif
-                  #ifdef ACC_SEMILAG_PQM
-                  target_density_r =
-                     v_norm_r * ( a[0] + v_norm_r * ( a[1] + v_norm_r * ( a[2] + v_norm_r * ( a[3] + v_norm_r * a[4] ) ) ) );
-                  #endif
+                        //the velocity between which we will integrate to put mass
+                        //in the targe cell. If both v_r and v_l are in same cell
+                        //then v_1,v_2 should be between v_l and v_r.
+                        //v_1 and v_2 normalized to be between 0 and 1 in the cell.
+                        //For vector elements where gk is already larger than needed (lagrangian_gk_r), v_2=v_1=v_r and thus the value is zero.
+                        const Vec v_norm_r = (  min(  max( Vec((Realv)(gk + 1)), lagrangian_v_l), lagrangian_v_r) - lagrangian_v_l) * target_dv;
+                        /*shift, old right is new left*/
+                        const Vec target_density_l = target_density_r;
+
+                        // compute right integrand, v_norm_r * ( a[0] + v_norm_r * ( a[1] + ... + v_norm_r * a[order] ) )
+                        Vec integrand = a[order];
+                        for (int c = order - 1; c >= 0; --c) {
+                           integrand = a[c] + v_norm_r * integrand;
+                        }
+                        target_density_r = v_norm_r * integrand;
                   
-                  //store values, one element at a time. All blocks
-                  //have been created by now.
-                  //TODO replace by vector version & scatter & gather operation
+                        //store values, one element at a time. All blocks
+                        //have been created by now.
+                        //TODO replace by vector version & scatter & gather operation
                   
                   
-                  if(dimension == 2) {
-                     Realf* targetDataPointer = blockIndexToBlockData[blockK] + j * cell_indices_to_id[1] + gk_mod_WID * cell_indices_to_id[2];
-                     Vec targetData;
-                     targetData.load_a(targetDataPointer);
-                     targetData += target_density_r - target_density_l;                  
-                     targetData.store_a(targetDataPointer);
-                  }
-                  else{
-                     // total value of integrand
-                     const Vec target_density = target_density_r - target_density_l;                  
-#pragma ivdep
-#pragma GCC ivdep                     
-                     for (int target_i=0; target_i < VECL; ++target_i) {
-                        // do the conversion from Realv to Realf here, faster than doing it in accumulation
-                        const Realf tval = target_density[target_i];
-                        const uint tcell = target_cell[target_i];
-                        blockIndexToBlockData[blockK][tcell] += tval;
-                     }  // for-loop over vector elements
-                  }
+                        if (dimension == 2) {
+                           // Along z the vector is contiguous in the target block
+                           Realf* targetDataPointer = blockIndexToBlockData[blockK] + j * cell_indices_to_id[1] + gk_mod_WID * cell_indices_to_id[2];
+                           Vec targetData;
+                           targetData.load_a(targetDataPointer);
+                           targetData += target_density_r - target_density_l;                  
+                           targetData.store_a(targetDataPointer);
+                        }
+                        else{
+                           // total value of integrand
+                           const Vec target_density = target_density_r - target_density_l;                  
+      #pragma ivdep
+      #pragma GCC ivdep                     
+                           for (int target_i=0; target_i < VECL; ++target_i) {
+                              // do the conversion from Realv to Realf here, faster than doing it in accumulation
+                              const Realf tval = target_density[target_i];
+                              const uint tcell = target_cell[target_i];
+                              blockIndexToBlockData[blockK][tcell] += tval;
+                           }  // for-loop over vector elements
+                        }
                   
-               } // for loop over target k-indices of current source block
-            } // for-loop over source blocks
-         } //for loop over j index
-         valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL) ;// there are WID3/VECL elements of type Vec per block    
-      } //for loop over columns
-      
+                     } // for loop over target k-indices of current source block
+                  } // for-loop over source blocks
+               } //for loop over j index
+               valuesColumnOffset += (n_cblocks + 2) * (WID3/VECL) ;// there are WID3/VECL elements of type Vec per block    
+            } //for loop over columns
+
+            if (recordBlockMaxima) {
+               // The target blocks of the set are complete, no other set writes them
+               for (int blockK = 0; blockK < MAX_BLOCKS_PER_DIM; blockK++){
+                  if(isTargetBlock[blockK])  {
+                     const vmesh::GlobalID targetBlock =
+                        setFirstBlockIndices[0] * block_indices_to_id[0] +
+                        setFirstBlockIndices[1] * block_indices_to_id[1] +
+                        blockK                  * block_indices_to_id[2];
+                     const Realf* data = blockIndexToBlockData[blockK];
+                     Realf maxValue = data[0];
+                     for (uint i = 1; i < WID3; ++i) {
+                        maxValue = std::max(maxValue, data[i]);
+                     }
+                     threadBlockMaxima.push_back(std::make_pair(targetBlock, maxValue));
+                  }
+               }
+            }
+         } //for loop over column sets
+
+         //remove the emptied source blocks of the batch that are not target blocks
+         #pragma omp single
+         {
+            for (size_t b = 0; b < removedBlocks.size(); ++b) {
+               spatial_cell->remove_velocity_block(removedBlocks[b], popID);
+            }
+            removedBlocks.clear();
+         }
+      } //for loop over batches of column sets
+
+      if (recordBlockMaxima) {
+         if (threaded) {
+            #pragma omp critical(accBlockMaxima)
+            pop.blockMaxima.insert(pop.blockMaxima.end(), threadBlockMaxima.begin(), threadBlockMaxima.end());
+         } else {
+            pop.blockMaxima.swap(threadBlockMaxima);
+         }
+      }
+   }
+   if (recordBlockMaxima) {
+      pop.blockMaximaModifications = vmesh.getModificationCount();
+      pop.blockMaximaValid = true;
+   }
+   if (!Parameters::vlasovAccelerationColumnCache) {
+      delete [] blocks;
    }
-   delete [] blocks;
    return true;
 }
 
+// Degree of the reconstruction polynomial of the acceleration, set in the Makefile
+#if defined(ACC_SEMILAG_PLM)
+#define ACC_SEMILAG_ORDER 1
+#elif defined(ACC_SEMILAG_PPM)
+#define ACC_SEMILAG_ORDER 2
+#elif defined(ACC_SEMILAG_PQM)
+#define ACC_SEMILAG_ORDER 4
+#else
+#error "No acceleration reconstruction selected, define ACC_SEMILAG_PLM, ACC_SEMILAG_PPM or ACC_SEMILAG_PQM"
+#endif
+
+/* Map the velocity distribution of a cell along one dimension, see map_1d_kernel.
+ *
+ * @param spatial_cell Spatial cell
+ * @param popID ID of the particle species
+ * @param intersection Intersection of the Lagrangian and Eulerian grids
+ * @param intersection_di Change of the intersection per cell in i
+ * @param intersection_dj Change of the intersection per cell in j
+ * @param intersection_dk Change of the intersection per cell in k
+ * @param dimension Dimension of the mapping
+ * @param threaded If true, the column sets of the cell are mapped in parallel by the threads
+ * of a new OpenMP parallel region. Must then be called outside parallel regions.
+ * @param recordBlockMaxima If true, record the maximum value of each block for the content lists,
+ * see map_1d_kernel. Only useful in the last mapping of an acceleration step.
+ */
+bool map_1d(SpatialCell* spatial_cell,
+            const uint popID,     
+            Real intersection, Real intersection_di, Real intersection_dj,Real intersection_dk,
+            const uint dimension,
+            const bool threaded,
+            const bool recordBlockMaxima) {
+   switch (dimension) {
+    case 0:
+      return map_1d_kernel<0,ACC_SEMILAG_ORDER>(spatial_cell, popID, intersection, intersection_di, intersection_dj, intersection_dk, threaded, recordBlockMaxima);
+    case 1:
+      return map_1d_kernel<1,ACC_SEMILAG_ORDER>(spatial_cell, popID, intersection, intersection_di, intersection_dj, intersection_dk, threaded, recordBlockMaxima);
+    case 2:
+      return map_1d_kernel<2,ACC_SEMILAG_ORDER>(spatial_cell, popID, intersection, intersection_di, intersection_dj, intersection_dk, threaded, recordBlockMaxima);
+    default:
+      std::cerr << __FILE__ << ":" << __LINE__ << " map_1d: invalid dimension " << dimension << std::endl;
+      abort();
+   }
+}
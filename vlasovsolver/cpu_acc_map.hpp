@@ -30,7 +30,9 @@
 using namespace spatial_cell;
 
 bool map_1d(SpatialCell* spatial_cell, const uint popID,     
-            Realv intersection, Realv intersection_di, Realv intersection_dj,Realv intersection_dk,
-            const uint dimension) ;
+            Real intersection, Real intersection_di, Real intersection_dj,Real intersection_dk,
+            const uint dimension,
+            const bool threaded=false,
+            const bool recordBlockMaxima=false) ;
 
 #endif
@@ -0,0 +1,81 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef CPU_ACC_RADIX_SORT_H
+#define CPU_ACC_RADIX_SORT_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "../definitions.h"
+
+// Number of bits sorted in one pass of the radix sort
+#define RADIX_SORT_BITS 11
+
+/* Number of passes radixSortBlockPairs needs for keys up to maxKey, one per
+ * RADIX_SORT_BITS digit of maxKey, but at least one.
+ */
+inline uint radixSortPasses(const vmesh::GlobalID maxKey) {
+   const uint keyBits = 8 * sizeof(vmesh::GlobalID);
+   uint nPasses = 1;
+   while (nPasses * RADIX_SORT_BITS < keyBits && (maxKey >> (nPasses * RADIX_SORT_BITS)) > 0) {
+      ++nPasses;
+   }
+   return nPasses;
+}
+
+/* Sort block pairs by their first element with a least significant digit radix sort. The
+ * mapped block IDs are bounded by the number of blocks in the velocity mesh, so only as
+ * many passes are needed as there are digits in maxKey. The sort is stable.
+ *
+ * @param pairs Pairs to sort, sorted in place
+ * @param maxKey Upper bound (inclusive) of the first elements of the pairs
+ */
+inline void radixSortBlockPairs(std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> >& pairs,
+                                const vmesh::GlobalID maxKey) {
+   const uint nBuckets = 1 << RADIX_SORT_BITS;
+   std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > sorted(pairs.size());
+   std::vector<uint> bucketOffsets(nBuckets);
+
+   const uint nPasses = radixSortPasses(maxKey);
+   for (uint pass = 0; pass < nPasses; ++pass) {
+      const uint shift = pass * RADIX_SORT_BITS;
+      std::fill(bucketOffsets.begin(), bucketOffsets.end(), 0);
+      for (size_t i = 0; i < pairs.size(); ++i) {
+         ++bucketOffsets[(pairs[i].first >> shift) & (nBuckets - 1)];
+      }
+      uint offset = 0;
+      for (uint b = 0; b < nBuckets; ++b) {
+         const uint count = bucketOffsets[b];
+         bucketOffsets[b] = offset;
+         offset += count;
+      }
+      for (size_t i = 0; i < pairs.size(); ++i) {
+         sorted[bucketOffsets[(pairs[i].first >> shift) & (nBuckets - 1)]++] = pairs[i];
+      }
+      pairs.swap(sorted);
+   }
+}
+
+#endif
@@ -31,6 +31,7 @@
 #include "cpu_acc_transform.hpp"
 #include "cpu_acc_intersections.hpp"
 #include "cpu_acc_map.hpp"
+#include "cpu_kernel_counters.hpp"
 
 using namespace std;
 using namespace spatial_cell;
@@ -79,32 +80,59 @@ uint getAccelerationSubcycles(SpatialCell* spatial_cell, Real dt, const uint pop
  * @param blockContainer Velocity block data container.
  * @param map_order Order in which vx,vy,vz mappings are performed. 
  * @param dt Time step of one subcycle.
+ * @param threaded If true, the column sets of the cell are mapped in parallel, see map_1d.
 */
 
 void cpu_accelerate_cell(SpatialCell* spatial_cell,
                          const uint popID,     
                          const uint map_order,
-                         const Real& dt) {
+                         const Real& dt,
+                         const bool threaded) {
    double t1 = MPI_Wtime();
 
    vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh    = spatial_cell->get_velocity_mesh(popID);
    vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainer = spatial_cell->get_velocity_blocks(popID);
 
+   const uint8_t refLevel = 0;
+   Real intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk;
+   Real intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk;
+   Real intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk;
+
+   // The kernels are timed with the per-thread counters, phiprof timers
+   // inside the parallel cell loop would only record the master thread.
+   const double tTransform = MPI_Wtime();
+
    // compute transform, forward in time and backward in time
-   phiprof::start("compute-transform");
 
    //compute the transform performed in this acceleration
-   Transform<Real,3,Affine> fwd_transform= compute_acceleration_transformation(spatial_cell,popID,dt);
+   Transform<Real,3,Affine> fwd_transform;
+   if (P::vlasovAccelerationTransformCache) {
+      // The part of the transform that depends on the fields and dt is reused while
+      // they are unchanged, e.g. on consecutive subcycles of equal length. The bulk
+      // velocity and charge density, which change every subcycle, are folded in here.
+      Population& pop = spatial_cell->get_population(popID);
+      Real inputs[Population::N_ACC_TRANSFORM_INPUTS];
+      get_acceleration_transformation_inputs(spatial_cell,dt,inputs);
+      bool reuseTransform = pop.accTransformValid;
+      for (uint i=0; i<Population::N_ACC_TRANSFORM_INPUTS && reuseTransform; ++i) {
+         const Real maxValue = max(fabs(inputs[i]),fabs(pop.accTransformInputs[i]));
+         if (fabs(inputs[i] - pop.accTransformInputs[i]) > P::vlasovAccelerationTransformCacheTolerance * maxValue) {
+            reuseTransform = false;
+         }
+      }
+      if (!reuseTransform) {
+         compute_acceleration_transformation_parts(spatial_cell,popID,dt,pop.accTransformParts);
+         for (uint i=0; i<Population::N_ACC_TRANSFORM_INPUTS; ++i) pop.accTransformInputs[i] = inputs[i];
+         pop.accTransformValid = true;
+      }
+      fwd_transform = compose_acceleration_transformation(spatial_cell,pop.accTransformParts);
+   } else {
+      fwd_transform = compute_acceleration_transformation(spatial_cell,popID,dt);
+   }
    Transform<Real,3,Affine> bwd_transform= fwd_transform.inverse();
-   phiprof::stop("compute-transform");
 
-   const uint8_t refLevel = 0;
-   Real intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk;
-   Real intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk;
-   Real intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk;
    switch(map_order){
        case 0:
-          phiprof::start("compute-intersections");
           //Map order XYZ
           compute_intersections_1st(vmesh,bwd_transform, fwd_transform, 0, refLevel,
                                     intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk);
@@ -112,16 +140,8 @@ void cpu_accelerate_cell(SpatialCell* spatial_cell,
                                     intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk);
           compute_intersections_3rd(vmesh,bwd_transform, fwd_transform, 2, refLevel,
                                     intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk);
-          phiprof::stop("compute-intersections");
-          phiprof::start("compute-mapping");
-          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0); // map along x
-          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1); // map along y
-          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2); // map along z
-          phiprof::stop("compute-mapping");
           break;
-          
        case 1:
-          phiprof::start("compute-intersections");
           //Map order YZX
           compute_intersections_1st(vmesh, bwd_transform, fwd_transform, 1, refLevel,
                                     intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk);
@@ -129,17 +149,8 @@ void cpu_accelerate_cell(SpatialCell* spatial_cell,
                                     intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk);
           compute_intersections_3rd(vmesh, bwd_transform, fwd_transform, 0, refLevel,
                                     intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk);
-      
-          phiprof::stop("compute-intersections");
-          phiprof::start("compute-mapping");
-          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1); // map along y
-          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2); // map along z
-          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0); // map along x
-          phiprof::stop("compute-mapping");
           break;
-
        case 2:
-          phiprof::start("compute-intersections");
           //Map order Z X Y
           compute_intersections_1st(vmesh, bwd_transform, fwd_transform, 2, refLevel,
                                     intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk);
@@ -147,14 +158,37 @@ void cpu_accelerate_cell(SpatialCell* spatial_cell,
                                     intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk);
           compute_intersections_3rd(vmesh, bwd_transform, fwd_transform, 1, refLevel,
                                     intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk);
-          phiprof::stop("compute-intersections");
-          phiprof::start("compute-mapping");
-          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2); // map along z
-          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0); // map along x
-          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1); // map along y
-          phiprof::stop("compute-mapping");
           break;
    }
+   kernelcounters::add(kernelcounters::ACC_TRANSFORM, MPI_Wtime() - tTransform, 0);
+
+   const double tMapping = MPI_Wtime();
+   const vmesh::LocalID nBlocks = vmesh.size();
+   // The last mapping records the block maxima used to build the content lists
+   const bool recordMaxima = Parameters::vlasovAccelerationContentLists;
+   switch(map_order){
+       case 0:
+          //Map order XYZ
+          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0,threaded); // map along x
+          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1,threaded); // map along y
+          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2,threaded,recordMaxima); // map along z
+          break;
+          
+       case 1:
+          //Map order YZX
+          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1,threaded); // map along y
+          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2,threaded); // map along z
+          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0,threaded,recordMaxima); // map along x
+          break;
+
+       case 2:
+          //Map order Z X Y
+          map_1d(spatial_cell, popID, intersection_z,intersection_z_di,intersection_z_dj,intersection_z_dk,2,threaded); // map along z
+          map_1d(spatial_cell, popID, intersection_x,intersection_x_di,intersection_x_dj,intersection_x_dk,0,threaded); // map along x
+          map_1d(spatial_cell, popID, intersection_y,intersection_y_di,intersection_y_dj,intersection_y_dk,1,threaded,recordMaxima); // map along y
+          break;
+   }
+   kernelcounters::add(kernelcounters::ACC_MAPPING, MPI_Wtime() - tMapping, 3 * nBlocks);
 
    if (Parameters::prepareForRebalance == true) {
 //       spatial_cell->parameters[CellParams::LBWEIGHTCOUNTER] += (MPI_Wtime() - t1);
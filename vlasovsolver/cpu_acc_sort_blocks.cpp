@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "cpu_acc_sort_blocks.hpp"
+#include "cpu_acc_radix_sort.hpp"
 
 using namespace std;
 using namespace spatial_cell;
@@ -36,104 +37,234 @@ inline bool paircomparator( const std::pair<uint, uint> & l, const std::pair<uin
    return l.first < r.first;
 }
 
-/*
-   This function returns a sorted list of blocks in a cell.
-
-   The sorted list is sorted according to the location, along the given dimension.
-   
-*/
-#warning "unfinished documentation"
-void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell,
-                               const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
-                               const uint dimension,
-                               uint* blocks,
-                               std::vector<uint> & columnBlockOffsets,
-                               std::vector<uint> & columnNumBlocks,
-                               std::vector<uint> & setColumnOffsets,
-                               std::vector<uint> & setNumColumns) {
-   //const uint nBlocks = spatial_cell->get_number_of_velocity_blocks(); // Number of blocks
-   const vmesh::LocalID nBlocks = vmesh.size();
+// Lists shorter than this are sorted with std::sort, the histograms of the radix sort
+// would dominate for them
+#define RADIX_SORT_MIN_LENGTH 512
 
+/* Map a block ID to the coordinate system where the given dimension is the fastest running
+ * one, so that sorting by the mapped ID sorts the blocks into columns along the dimension.
+ *
+ * @param vmesh Velocity mesh
+ * @param block Global ID of the block
+ * @param dimension Dimension of the columns
+ */
+static inline vmesh::GlobalID mapBlockIdToDimension(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                                                    const vmesh::GlobalID block,
+                                                    const uint dimension) {
    // Velocity mesh refinement level, has no effect here
    // but is needed in some vmesh::VelocityMesh function calls.
    const uint8_t REFLEVEL = 0;
-   
-   // Copy block data to vector
-   std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > block_pairs;
-   block_pairs.resize( nBlocks );
+
+   switch( dimension ) {
+    case 0: {
+       const vmesh::GlobalID blockId_mapped = block; // Mapping the block id to different coordinate system if dimension is not zero:
+       return blockId_mapped;
+    }
+    case 1: {
+       // Do operation: 
+       //   block = x + y*x_max + z*y_max*x_max 
+       //=> block' = block - (x + y*x_max) + y + x*y_max = x + y*x_max + z*y_max*x_max - (x + y*x_max) + y + x*y_max
+       //          = y + x*y_max + z*y_max*x_max
+       const vmesh::LocalID x_index = block % vmesh.getGridLength(REFLEVEL)[0];
+       const vmesh::LocalID y_index = (block / vmesh.getGridLength(REFLEVEL)[0]) % vmesh.getGridLength(REFLEVEL)[1];
+
+       // Mapping the block id to different coordinate system if dimension is not zero:
+       const vmesh::GlobalID blockId_mapped 
+               = block - (x_index + y_index*vmesh.getGridLength(REFLEVEL)[0])
+               + y_index 
+               + x_index * vmesh.getGridLength(REFLEVEL)[1];
+       return blockId_mapped;
+    }
+    case 2: {
+       // Do operation: 
+       //   block = x + y*x_max + z*y_max*x_max 
+       //=> block' = z + y*z_max + x*z_max*y_max
+       const vmesh::LocalID x_index = block % vmesh.getGridLength(REFLEVEL)[0];
+       const vmesh::LocalID y_index = (block / vmesh.getGridLength(REFLEVEL)[0]) % vmesh.getGridLength(REFLEVEL)[1];
+       const vmesh::LocalID z_index = (block / (vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1]));
+
+       // Mapping the block id to different coordinate system if dimension is not zero:
+       const vmesh::GlobalID blockId_mapped 
+         = z_index 
+         + y_index*vmesh.getGridLength(REFLEVEL)[2]
+         + x_index*vmesh.getGridLength(REFLEVEL)[1]*vmesh.getGridLength(REFLEVEL)[2];
+       return blockId_mapped;
+    }
+   }
+   return block;
+}
+
+/* Sort pairs of mapped and original block IDs by the mapped ID. The mapped IDs are bounded
+ * by the size of the mesh, so long lists are sorted in linear time.
+ */
+static void sortBlockPairs(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                           std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> >& block_pairs) {
+   const uint8_t REFLEVEL = 0;
+   if (block_pairs.size() < RADIX_SORT_MIN_LENGTH) {
+      std::sort( block_pairs.begin(), block_pairs.end(), paircomparator );
+   } else {
+      const vmesh::GlobalID maxKey = vmesh.getGridLength(REFLEVEL)[0] * vmesh.getGridLength(REFLEVEL)[1]
+                                   * vmesh.getGridLength(REFLEVEL)[2] - 1;
+      radixSortBlockPairs(block_pairs, maxKey);
+   }
+}
+
+#ifndef AMR
+/* Collect the blocks of a velocity mesh with a dense lookup table (see
+ * VelocityMesh::usesDenseLookup) in the order of their mapped IDs. The table is walked
+ * with the given dimension running fastest, which yields the same order as sorting by
+ * mapBlockIdToDimension without any sorting.
+ *
+ * @param vmesh Velocity mesh with a dense lookup table
+ * @param dimension Dimension of the columns
+ * @param sortedBlocks Global IDs of all blocks in the mesh, sorted. Must hold vmesh.size() elements.
+ */
+static void collectDenseBlocksByDimension(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                                          const uint dimension,
+                                          vmesh::GlobalID* sortedBlocks) {
+   const uint8_t REFLEVEL = 0;
+   const vmesh::LocalID* gridLength = vmesh.getGridLength(REFLEVEL);
+   const vmesh::GlobalID stride[3] = {1, gridLength[0], gridLength[0]*gridLength[1]};
+
+   // Dimensions in the order of the mapped ID, fastest running first
+   const uint order[3][3] = {{0,1,2}, {1,0,2}, {2,1,0}};
+   const uint* o = order[dimension];
+
+   vmesh::LocalID n = 0;
+   for (vmesh::LocalID c = 0; c < gridLength[o[2]]; ++c) {
+      for (vmesh::LocalID b = 0; b < gridLength[o[1]]; ++b) {
+         const vmesh::GlobalID rowStart = c*stride[o[2]] + b*stride[o[1]];
+         for (vmesh::LocalID a = 0; a < gridLength[o[0]]; ++a) {
+            const vmesh::GlobalID block = rowStart + a*stride[o[0]];
+            if (vmesh.getLocalID(block) != vmesh::INVALID_LOCALID) {
+               sortedBlocks[n++] = block;
+            }
+         }
+      }
+   }
+}
+#endif
+
+/* Sort the blocks of a velocity mesh into columns along the given dimension.
+ *
+ * @param vmesh Velocity mesh
+ * @param dimension Dimension of the columns
+ * @param sortedBlocks Global IDs of all blocks in the mesh, sorted
+ */
+void sortBlocksByDimension(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                           const uint dimension,
+                           std::vector<vmesh::GlobalID>& sortedBlocks) {
+   const vmesh::LocalID nBlocks = vmesh.size();
+   #ifndef AMR
+   if (vmesh.usesDenseLookup()) {
+      sortedBlocks.resize(nBlocks);
+      collectDenseBlocksByDimension(vmesh, dimension, sortedBlocks.data());
+      return;
+   }
+   #endif
+   std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > block_pairs(nBlocks);
    for (vmesh::LocalID i = 0; i < nBlocks; ++i ) {
-      //const vmesh::GlobalID block = spatial_cell->get_velocity_block_global_id(i);
       const vmesh::GlobalID block = vmesh.getGlobalID(i);
-      switch( dimension ) {
-       case 0: {
-          const vmesh::GlobalID blockId_mapped = block; // Mapping the block id to different coordinate system if dimension is not zero:
-          block_pairs[i] = std::make_pair( blockId_mapped, block );
-       }
-         break;
-       case 1: {
-          // Do operation: 
-          //   block = x + y*x_max + z*y_max*x_max 
-          //=> block' = block - (x + y*x_max) + y + x*y_max = x + y*x_max + z*y_max*x_max - (x + y*x_max) + y + x*y_max
-          //          = y + x*y_max + z*y_max*x_max
-          //const uint x_indice = block%SpatialCell::get_velocity_grid_length()[0];
-          //const uint y_indice = (block/SpatialCell::get_velocity_grid_length()[0])%SpatialCell::SpatialCell::get_velocity_grid_length()[1];
-          const vmesh::LocalID x_index = block % vmesh.getGridLength(REFLEVEL)[0];
-          const vmesh::LocalID y_index = (block / vmesh.getGridLength(REFLEVEL)[0]) % vmesh.getGridLength(REFLEVEL)[1];
-
-          // Mapping the block id to different coordinate system if dimension is not zero:
-          //const uint blockId_mapped 
-          //        = block - (x_indice + y_indice*SpatialCell::get_velocity_grid_length()[0]) 
-          //        + y_indice 
-          //        + x_indice * SpatialCell::SpatialCell::get_velocity_grid_length()[1];
-          const vmesh::GlobalID blockId_mapped 
-                  = block - (x_index + y_index*vmesh.getGridLength(REFLEVEL)[0])
-                  + y_index 
-                  + x_index * vmesh.getGridLength(REFLEVEL)[1];
-          block_pairs[i] = std::make_pair( blockId_mapped, block );
-       }
-         break;
-       case 2: {
-          // Do operation: 
-          //   block = x + y*x_max + z*y_max*x_max 
-          //=> block' = z + y*z_max + x*z_max*y_max
-          //const uint x_indice = block%SpatialCell::get_velocity_grid_length()[0];
-          //const uint y_indice = (block/SpatialCell::get_velocity_grid_length()[0])%SpatialCell::SpatialCell::get_velocity_grid_length()[1];
-          //const uint z_indice =  (block/(SpatialCell::get_velocity_grid_length()[0]*SpatialCell::SpatialCell::get_velocity_grid_length()[1]));
-          const vmesh::LocalID x_index = block % vmesh.getGridLength(REFLEVEL)[0];
-          const vmesh::LocalID y_index = (block / vmesh.getGridLength(REFLEVEL)[0]) % vmesh.getGridLength(REFLEVEL)[1];
-          const vmesh::LocalID z_index = (block / (vmesh.getGridLength(REFLEVEL)[0]*vmesh.getGridLength(REFLEVEL)[1]));
-
-          // Mapping the block id to different coordinate system if dimension is not zero:
-          //const uint blockId_mapped 
-          //  = z_indice 
-          //  + y_indice * SpatialCell::SpatialCell::get_velocity_grid_length()[2] 
-          //  + x_indice*SpatialCell::SpatialCell::get_velocity_grid_length()[1]*SpatialCell::SpatialCell::get_velocity_grid_length()[2];
-          const vmesh::GlobalID blockId_mapped 
-            = z_index 
-            + y_index*vmesh.getGridLength(REFLEVEL)[2]
-            + x_index*vmesh.getGridLength(REFLEVEL)[1]*vmesh.getGridLength(REFLEVEL)[2];
-          block_pairs[i] = std::make_pair( blockId_mapped, block );
-       }
-         break;
+      block_pairs[i] = std::make_pair( mapBlockIdToDimension(vmesh, block, dimension), block );
+   }
+   sortBlockPairs(vmesh, block_pairs);
+
+   sortedBlocks.resize(nBlocks);
+   for (vmesh::LocalID i = 0; i < nBlocks; ++i ) {
+      sortedBlocks[i] = block_pairs[i].second;
+   }
+}
+
+/* Update block lists sorted by sortBlocksByDimension after blocks have been added to or
+ * removed from the mesh. Only the changed blocks are sorted, the lists are patched with a
+ * linear merge.
+ *
+ * @param vmesh Velocity mesh, with the changes applied
+ * @param changes Blocks added (true) or removed (false) in the order of the changes. A block
+ * may appear several times, the last change is the one that holds.
+ * @param sortedBlocks Block lists sorted along each of the three dimensions
+ */
+void patchSortedBlocks(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                       const std::vector<std::pair<vmesh::GlobalID,bool> >& changes,
+                       std::vector<vmesh::GlobalID> sortedBlocks[3]) {
+   if (changes.empty()) return;
+
+   // Net changes: all changed blocks sorted by ID, and the ones that exist after the changes
+   std::vector<std::pair<vmesh::GlobalID,bool> > netChanges(changes);
+   std::stable_sort(netChanges.begin(), netChanges.end(),
+                    [](const std::pair<vmesh::GlobalID,bool>& l, const std::pair<vmesh::GlobalID,bool>& r) {
+                       return l.first < r.first;
+                    });
+   std::vector<vmesh::GlobalID> changedBlocks;
+   std::vector<vmesh::GlobalID> addedBlocks;
+   for (size_t i = 0; i < netChanges.size(); ++i) {
+      if (i + 1 < netChanges.size() && netChanges[i + 1].first == netChanges[i].first) continue;
+      changedBlocks.push_back(netChanges[i].first);
+      if (netChanges[i].second) addedBlocks.push_back(netChanges[i].first);
+   }
+
+   std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > added_pairs(addedBlocks.size());
+   std::vector<vmesh::GlobalID> patched;
+   for (uint dimension = 0; dimension < 3; ++dimension) {
+      for (size_t i = 0; i < addedBlocks.size(); ++i) {
+         added_pairs[i] = std::make_pair( mapBlockIdToDimension(vmesh, addedBlocks[i], dimension), addedBlocks[i] );
       }
+      std::sort( added_pairs.begin(), added_pairs.end(), paircomparator );
+
+      // Merge the kept blocks of the old list with the added blocks
+      const std::vector<vmesh::GlobalID>& old = sortedBlocks[dimension];
+      patched.clear();
+      patched.reserve(vmesh.size());
+      size_t a = 0;
+      for (size_t i = 0; i < old.size(); ++i) {
+         if (std::binary_search(changedBlocks.begin(), changedBlocks.end(), old[i])) continue;
+         const vmesh::GlobalID key = mapBlockIdToDimension(vmesh, old[i], dimension);
+         while (a < added_pairs.size() && added_pairs[a].first < key) {
+            patched.push_back(added_pairs[a++].second);
+         }
+         patched.push_back(old[i]);
+      }
+      while (a < added_pairs.size()) {
+         patched.push_back(added_pairs[a++].second);
+      }
+      sortedBlocks[dimension].swap(patched);
    }
-   // Sort the list:
-   std::sort( block_pairs.begin(), block_pairs.end(), paircomparator );
+}
 
-   // Put in the sorted blocks, and also compute column offsets and lengths:
+/* Divide a block list sorted along the given dimension into columns, and the columns into
+ * column sets. A column is a contiguous run of blocks along the dimension, a column set
+ * contains all columns with the same indices in the two other dimensions.
+ *
+ * @param vmesh Velocity mesh
+ * @param dimension Dimension of the columns
+ * @param blocks Global IDs of the blocks, sorted by sortBlocksByDimension
+ * @param nBlocks Number of blocks
+ */
+void computeColumnOffsets(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                          const uint dimension,
+                          const vmesh::GlobalID* blocks,
+                          const vmesh::LocalID nBlocks,
+                          std::vector<uint> & columnBlockOffsets,
+                          std::vector<uint> & columnNumBlocks,
+                          std::vector<uint> & setColumnOffsets,
+                          std::vector<uint> & setNumColumns) {
+   // Velocity mesh refinement level, has no effect here
+   // but is needed in some vmesh::VelocityMesh function calls.
+   const uint8_t REFLEVEL = 0;
+
+   // Compute column offsets and lengths:
    columnBlockOffsets.push_back(0); //first offset
    setColumnOffsets.push_back(0); //first offset   
    uint prev_column_id, prev_dimension_id;
 
    for (vmesh::LocalID i=0; i<nBlocks; ++i) {
+       const vmesh::GlobalID blockId_mapped = mapBlockIdToDimension(vmesh, blocks[i], dimension);
+
        // identifies a particular column
-       vmesh::LocalID column_id = block_pairs[i].first / vmesh.getGridLength(REFLEVEL)[dimension];     
+       vmesh::LocalID column_id = blockId_mapped / vmesh.getGridLength(REFLEVEL)[dimension];     
        
        // identifies a particular block in a column (along the dimension)
-       vmesh::LocalID dimension_id = block_pairs[i].first % vmesh.getGridLength(REFLEVEL)[dimension];
-      
-       //sorted list
-       blocks[i] = block_pairs[i].second;
+       vmesh::LocalID dimension_id = blockId_mapped % vmesh.getGridLength(REFLEVEL)[dimension];
 
       if ( i > 0 &&  ( column_id != prev_column_id || dimension_id != (prev_dimension_id + 1) )){
          //encountered new column! For i=0, we already entered the correct offset (0).
@@ -157,3 +288,49 @@ void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell,
    columnNumBlocks.push_back(nBlocks - columnBlockOffsets[columnBlockOffsets.size()-1]);
    setNumColumns.push_back(columnNumBlocks.size() - setColumnOffsets[setColumnOffsets.size()-1]);
 }
+
+/*
+   This function returns a sorted list of blocks in a cell.
+
+   The sorted list is sorted according to the location, along the given dimension.
+   
+*/
+#warning "unfinished documentation"
+void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell,
+                               const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                               const uint dimension,
+                               uint* blocks,
+                               std::vector<uint> & columnBlockOffsets,
+                               std::vector<uint> & columnNumBlocks,
+                               std::vector<uint> & setColumnOffsets,
+                               std::vector<uint> & setNumColumns) {
+   //const uint nBlocks = spatial_cell->get_number_of_velocity_blocks(); // Number of blocks
+   const vmesh::LocalID nBlocks = vmesh.size();
+
+   #ifndef AMR
+   if (vmesh.usesDenseLookup()) {
+      // The lookup table is already in block order, no sorting needed
+      collectDenseBlocksByDimension(vmesh, dimension, blocks);
+   } else
+   #endif
+   {
+      // Copy block data to vector
+      std::vector<std::pair<vmesh::GlobalID,vmesh::GlobalID> > block_pairs;
+      block_pairs.resize( nBlocks );
+      for (vmesh::LocalID i = 0; i < nBlocks; ++i ) {
+         const vmesh::GlobalID block = vmesh.getGlobalID(i);
+         block_pairs[i] = std::make_pair( mapBlockIdToDimension(vmesh, block, dimension), block );
+      }
+      // Sort the list
+      sortBlockPairs(vmesh, block_pairs);
+
+      // Put in the sorted blocks
+      for (vmesh::LocalID i=0; i<nBlocks; ++i) {
+         blocks[i] = block_pairs[i].second;
+      }
+   }
+   // Compute column offsets and lengths:
+   computeColumnOffsets(vmesh, dimension, blocks, nBlocks,
+                        columnBlockOffsets, columnNumBlocks,
+                        setColumnOffsets, setNumColumns);
+}
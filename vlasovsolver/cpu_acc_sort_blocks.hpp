@@ -24,11 +24,29 @@
 #ifndef CPU_SORT_BLOCKS_FOR_ACC_H
 #define CPU_SORT_BLOCKS_FOR_ACC_H
 
+#include <utility>
 #include <vector>
 
 #include "../common.h"
 #include "../spatial_cell.hpp"
 
+void sortBlocksByDimension(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                           const uint dimension,
+                           std::vector<vmesh::GlobalID>& sortedBlocks);
+
+void patchSortedBlocks(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                       const std::vector<std::pair<vmesh::GlobalID,bool> >& changes,
+                       std::vector<vmesh::GlobalID> sortedBlocks[3]);
+
+void computeColumnOffsets(const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
+                          const uint dimension,
+                          const vmesh::GlobalID* blocks,
+                          const vmesh::LocalID nBlocks,
+                          std::vector<uint> & columnBlockOffsets,
+                          std::vector<uint> & columnNumBlocks,
+                          std::vector<uint> & setColumnOffsets,
+                          std::vector<uint> & setNumColumns);
+
 void sortBlocklistByDimension( //const spatial_cell::SpatialCell* spatial_cell, 
                                const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh,
                                const uint dimension,
@@ -54,6 +54,133 @@ void updateAccelerationMaxdt(
 }
 
 
+/*!
+ Gather the cell values that compute_acceleration_transformation_parts depends on.
+ If they are unchanged, the parts are unchanged as well.
+ * @param spatial_cell Spatial cell containing the accelerated population.
+ * @param dt Time step of one subcycle.
+ * @param inputs Array of Population::N_ACC_TRANSFORM_INPUTS values.
+*/
+void get_acceleration_transformation_inputs(
+        SpatialCell* spatial_cell,
+        const Real& dt,
+        Real* inputs) {
+   inputs[0]  = spatial_cell->parameters[CellParams::BGBXVOL]+spatial_cell->parameters[CellParams::PERBXVOL];
+   inputs[1]  = spatial_cell->parameters[CellParams::BGBYVOL]+spatial_cell->parameters[CellParams::PERBYVOL];
+   inputs[2]  = spatial_cell->parameters[CellParams::BGBZVOL]+spatial_cell->parameters[CellParams::PERBZVOL];
+   inputs[3]  = spatial_cell->derivativesBVOL[bvolderivatives::dPERBXVOLdy];
+   inputs[4]  = spatial_cell->derivativesBVOL[bvolderivatives::dPERBXVOLdz];
+   inputs[5]  = spatial_cell->derivativesBVOL[bvolderivatives::dPERBYVOLdx];
+   inputs[6]  = spatial_cell->derivativesBVOL[bvolderivatives::dPERBYVOLdz];
+   inputs[7]  = spatial_cell->derivativesBVOL[bvolderivatives::dPERBZVOLdx];
+   inputs[8]  = spatial_cell->derivativesBVOL[bvolderivatives::dPERBZVOLdy];
+   inputs[9]  = spatial_cell->parameters[CellParams::EXGRADPE];
+   inputs[10] = spatial_cell->parameters[CellParams::EYGRADPE];
+   inputs[11] = spatial_cell->parameters[CellParams::EZGRADPE];
+   inputs[12] = dt;
+}
+
+/*!
+ Prefactor of the Hall term, 1/(mu_0 rhoq), with rhoq limited from below by
+ Parameters::hallMinimumRhoq.
+ * @param spatial_cell Spatial cell containing the accelerated population.
+*/
+static Real get_hall_prefactor(SpatialCell* spatial_cell) {
+   // scale rho for hall term, if user requests
+   const Real EPSILON = 1e10 * numeric_limits<Real>::min();
+   const Real rhoq = spatial_cell->parameters[CellParams::RHOQ_V] + EPSILON;
+   const Real hallRhoq =  (rhoq <= Parameters::hallMinimumRhoq ) ? Parameters::hallMinimumRhoq : rhoq ;
+   return 1.0 / (physicalconstants::MU_0 * hallRhoq );
+}
+
+/*!
+ Compute the parts of the acceleration transform that do not depend on the bulk
+ velocity V or the charge density of the cell. Each substep of
+ compute_acceleration_transformation rotates by the same matrix R around a pivot
+ that moves with V, so after n substeps the transform maps x to
+ A x + (I - A) V - hallPrefactor h + g, where A = R^n, h = n (I - R) curl(B) and
+ g is the translation by the electron pressure gradient term.
+ * @param spatial_cell Spatial cell containing the accelerated population.
+ * @param popID ID of the accelerated particle species.
+ * @param dt Time step of one subcycle.
+ * @param parts Array of Population::N_ACC_TRANSFORM_PARTS values, A in row-major order followed by h and g.
+*/
+void compute_acceleration_transformation_parts(
+        SpatialCell* spatial_cell,
+        const uint popID,
+        const Real& dt,
+        Real* parts) {
+   const Real Bx = spatial_cell->parameters[CellParams::BGBXVOL]+spatial_cell->parameters[CellParams::PERBXVOL];
+   const Real By = spatial_cell->parameters[CellParams::BGBYVOL]+spatial_cell->parameters[CellParams::PERBYVOL];
+   const Real Bz = spatial_cell->parameters[CellParams::BGBZVOL]+spatial_cell->parameters[CellParams::PERBZVOL];
+   const Real dBXdy = spatial_cell->derivativesBVOL[bvolderivatives::dPERBXVOLdy];
+   const Real dBXdz = spatial_cell->derivativesBVOL[bvolderivatives::dPERBXVOLdz];
+   const Real dBYdx = spatial_cell->derivativesBVOL[bvolderivatives::dPERBYVOLdx];
+   const Real dBYdz = spatial_cell->derivativesBVOL[bvolderivatives::dPERBYVOLdz];
+   const Real dBZdx = spatial_cell->derivativesBVOL[bvolderivatives::dPERBZVOLdx];
+   const Real dBZdy = spatial_cell->derivativesBVOL[bvolderivatives::dPERBZVOLdy];
+
+   const Eigen::Matrix<Real,3,1> B(Bx,By,Bz);
+   Eigen::Matrix<Real,3,1> unit_B(B.normalized());
+   const Real B_mag = B.norm() + 1e-30;
+   if (B_mag < 1e-28) {
+      unit_B(0,0) = 0; unit_B(1,0) = 0; unit_B(2,0) = 1;
+   }
+   const Real gyro_period
+     = 2 * M_PI * getObjectWrapper().particleSpecies[popID].mass
+     / (getObjectWrapper().particleSpecies[popID].charge * B_mag);
+
+   // Same substeps as in compute_acceleration_transformation
+   unsigned int bulk_velocity_substeps = fabs(dt) / fabs(gyro_period*(0.1/360.0));
+   if (bulk_velocity_substeps < 1) bulk_velocity_substeps=1;
+   const Real substeps_radians = -(2.0*M_PI*dt/gyro_period)/bulk_velocity_substeps;
+
+   const Matrix<Real,3,3> rotation(AngleAxis<Real>(substeps_radians,unit_B).toRotationMatrix());
+   Matrix<Real,3,3> linear(Matrix<Real,3,3>::Identity());
+   for (uint i=0; i<bulk_velocity_substeps; ++i) {
+      linear = rotation*linear;
+   }
+   const Eigen::Matrix<Real,3,1> curlB(dBZdy - dBYdz, dBXdz - dBZdx, dBYdx - dBXdy);
+   const Eigen::Matrix<Real,3,1> hall(Real(bulk_velocity_substeps) * ((Matrix<Real,3,3>::Identity() - rotation)*curlB));
+   Eigen::Matrix<Real,3,1> gradPe(0,0,0);
+   if(Parameters::ohmGradPeTerm > 0) {
+      gradPe = (fabs(getObjectWrapper().particleSpecies[popID].charge)/getObjectWrapper().particleSpecies[popID].mass) * dt *
+         Eigen::Matrix<Real,3,1>(spatial_cell->parameters[CellParams::EXGRADPE],
+                                 spatial_cell->parameters[CellParams::EYGRADPE],
+                                 spatial_cell->parameters[CellParams::EZGRADPE]);
+   }
+
+   for (int i=0; i<3; ++i) {
+      for (int j=0; j<3; ++j) parts[3*i+j] = linear(i,j);
+      parts[9+i]  = hall(i);
+      parts[12+i] = gradPe(i);
+   }
+}
+
+/*!
+ Compose the acceleration transform from the parts computed by
+ compute_acceleration_transformation_parts and the current bulk velocity and
+ charge density of the cell.
+ * @param spatial_cell Spatial cell containing the accelerated population.
+ * @param parts Array of Population::N_ACC_TRANSFORM_PARTS values.
+*/
+Eigen::Transform<Real,3,Eigen::Affine> compose_acceleration_transformation(
+        SpatialCell* spatial_cell,
+        const Real* parts) {
+   const Map<const Matrix<Real,3,3,RowMajor> > linear(parts);
+   const Map<const Matrix<Real,3,1> > hall(parts+9);
+   const Map<const Matrix<Real,3,1> > gradPe(parts+12);
+   const Eigen::Matrix<Real,3,1> bulk_velocity(spatial_cell->parameters[CellParams::VX_V],
+                                               spatial_cell->parameters[CellParams::VY_V],
+                                               spatial_cell->parameters[CellParams::VZ_V]);
+
+   Transform<Real,3,Affine> total_transform(Matrix<Real, 4, 4>::Identity());
+   total_transform.linear() = linear;
+   total_transform.translation() = (Matrix<Real,3,3>::Identity() - linear)*bulk_velocity
+                                 - get_hall_prefactor(spatial_cell)*hall + gradPe;
+   return total_transform;
+}
+
 /*!
  Compute transform during on timestep, and update the bulk velocity of the
  cell
@@ -99,11 +226,7 @@ Eigen::Transform<Real,3,Eigen::Affine> compute_acceleration_transformation(
      = 2 * M_PI * getObjectWrapper().particleSpecies[popID].mass
      / (getObjectWrapper().particleSpecies[popID].charge * B_mag);
 
-   // scale rho for hall term, if user requests
-   const Real EPSILON = 1e10 * numeric_limits<Real>::min();
-   const Real rhoq = spatial_cell->parameters[CellParams::RHOQ_V] + EPSILON;
-   const Real hallRhoq =  (rhoq <= Parameters::hallMinimumRhoq ) ? Parameters::hallMinimumRhoq : rhoq ;
-   const Real hallPrefactor = 1.0 / (physicalconstants::MU_0 * hallRhoq );
+   const Real hallPrefactor = get_hall_prefactor(spatial_cell);
 
    Eigen::Matrix<Real,3,1> bulk_velocity(spatial_cell->parameters[CellParams::VX_V],
                                          spatial_cell->parameters[CellParams::VY_V],
@@ -32,6 +32,15 @@
 Eigen::Transform<Real,3,Eigen::Affine> compute_acceleration_transformation(
    spatial_cell::SpatialCell* spatial_cell,const uint popID,const Real& dt);
 
+void get_acceleration_transformation_inputs(
+   spatial_cell::SpatialCell* spatial_cell,const Real& dt,Real* inputs);
+
+void compute_acceleration_transformation_parts(
+   spatial_cell::SpatialCell* spatial_cell,const uint popID,const Real& dt,Real* parts);
+
+Eigen::Transform<Real,3,Eigen::Affine> compose_acceleration_transformation(
+   spatial_cell::SpatialCell* spatial_cell,const Real* parts);
+
 void updateAccelerationMaxdt(spatial_cell::SpatialCell* spatial_cell, 
                              const uint popID);
 
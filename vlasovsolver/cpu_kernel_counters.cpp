@@ -0,0 +1,95 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <algorithm>
+#include <mpi.h>
+
+#include "../logger.h"
+#include "cpu_kernel_counters.hpp"
+
+using namespace std;
+
+extern Logger logFile;
+
+namespace kernelcounters {
+   std::vector<ThreadCounters> threadCounters;
+}
+
+void initializeKernelCounters() {
+   #ifdef _OPENMP
+      const size_t nThreads = omp_get_max_threads();
+   #else
+      const size_t nThreads = 1;
+   #endif
+   kernelcounters::ThreadCounters zero;
+   for (int k=0; k<kernelcounters::N_KERNELS; ++k) {
+      zero.seconds[k] = 0.0;
+      zero.blocks[k] = 0;
+      zero.calls[k] = 0;
+   }
+   kernelcounters::threadCounters.assign(nThreads,zero);
+}
+
+void reportKernelCounters() {
+   using namespace kernelcounters;
+   const char* names[N_KERNELS] = {"acc-transform","acc-mapping","trans-mapping"};
+
+   // Per-process values: total thread time, maximum thread time, blocks and calls
+   double localSum[N_KERNELS*3];
+   double localMax[N_KERNELS];
+   for (int k=0; k<N_KERNELS; ++k) {
+      localSum[3*k+0] = 0.0;
+      localSum[3*k+1] = 0.0;
+      localSum[3*k+2] = 0.0;
+      localMax[k] = 0.0;
+      for (size_t t=0; t<threadCounters.size(); ++t) {
+         localSum[3*k+0] += threadCounters[t].seconds[k];
+         localSum[3*k+1] += threadCounters[t].blocks[k];
+         localSum[3*k+2] += threadCounters[t].calls[k];
+         localMax[k] = max(localMax[k],threadCounters[t].seconds[k]);
+      }
+   }
+   double sum[N_KERNELS*3];
+   double maxThread[N_KERNELS];
+   int nProcs;
+   MPI_Comm_size(MPI_COMM_WORLD,&nProcs);
+   MPI_Reduce(localSum,sum,N_KERNELS*3,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+   MPI_Reduce(localMax,maxThread,N_KERNELS,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+
+   int myRank;
+   MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+   if (myRank == 0) {
+      const double nThreads = max((size_t)1,threadCounters.size()) * nProcs;
+      for (int k=0; k<N_KERNELS; ++k) {
+         if (sum[3*k+2] == 0) continue;
+         const double meanThread = sum[3*k+0] / nThreads;
+         logFile << "(KERNELS) " << names[k] << ": " << sum[3*k+2] << " calls, " << sum[3*k+1] << " blocks, ";
+         logFile << sum[3*k+1] / (sum[3*k+0] + 1e-30) << " blocks/s per thread, ";
+         logFile << "thread time mean " << meanThread << " s max " << maxThread[k] << " s";
+         logFile << ", imbalance " << maxThread[k] / (meanThread + 1e-30) << endl;
+      }
+   }
+   logFile << writeVerbose;
+
+   initializeKernelCounters();
+}
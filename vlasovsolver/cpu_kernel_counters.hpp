@@ -0,0 +1,82 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef CPU_KERNEL_COUNTERS_H
+#define CPU_KERNEL_COUNTERS_H
+
+#include <stdint.h>
+#include <vector>
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
+
+/*! Per-thread time and block counters of the Vlasov solver kernels. phiprof
+ * only records the timers of the master thread, and starting a timer for every
+ * cell inside an OpenMP loop is expensive. Instead each thread adds its time and
+ * number of processed blocks into its own cache line, without locks. The counters
+ * are merged over threads and processes and written into the logfile together with
+ * the phiprof report, see reportKernelCounters.
+ */
+namespace kernelcounters {
+   enum Kernel {
+      ACC_TRANSFORM,      /*!< Acceleration transform and intersections.*/
+      ACC_MAPPING,        /*!< Acceleration mapping, three map_1d calls per cell.*/
+      TRANS_MAPPING,      /*!< Translation of pencils or columns.*/
+      N_KERNELS
+   };
+
+   struct ThreadCounters {
+      double seconds[N_KERNELS];
+      uint64_t blocks[N_KERNELS];
+      uint64_t calls[N_KERNELS];
+      char padding[64];  /*!< Keeps the counters of different threads on different cache lines.*/
+   };
+
+   extern std::vector<ThreadCounters> threadCounters;
+
+   /*! Add time and processed blocks of one kernel call to the counters of the calling thread.
+    * @param kernel The kernel.
+    * @param seconds Time used by the call.
+    * @param blocks Number of velocity blocks processed by the call.*/
+   inline void add(const Kernel kernel,const double seconds,const uint64_t blocks) {
+      #ifdef _OPENMP
+         const size_t thread = omp_get_thread_num();
+      #else
+         const size_t thread = 0;
+      #endif
+      if (thread >= threadCounters.size()) return;
+      threadCounters[thread].seconds[kernel] += seconds;
+      threadCounters[thread].blocks[kernel] += blocks;
+      threadCounters[thread].calls[kernel] += 1;
+   }
+}
+
+/*! Allocate and zero the counters for all OpenMP threads. Must be called outside of parallel regions.*/
+void initializeKernelCounters();
+
+/*! Write the kernel counters accumulated since the previous report into the logfile and reset them.
+ * For each kernel the blocks per second, and the per-thread load imbalance (maximum thread time 
+ * divided by the mean thread time) are reported. Collective operation on MPI_COMM_WORLD.*/
+void reportKernelCounters();
+
+#endif
@@ -21,7 +21,9 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <limits>
 #include <utility>
 
 #ifdef _OPENMP
@@ -29,6 +31,7 @@
 #endif
 
 #include "../grid.h"
+#include "../memoryallocation.h"
 #include "../object_wrapper.h"
 #include "vec.h"
 #include "cpu_1d_plm.hpp"
@@ -36,6 +39,7 @@
 #include "cpu_1d_ppm_nonuniform.hpp"
 #include "cpu_1d_pqm.hpp"
 #include "cpu_trans_map.hpp"
+#include "cpu_kernel_counters.hpp"
 
 using namespace std;
 using namespace spatial_cell;
@@ -64,6 +68,86 @@ bool do_translate_cell(SpatialCell* SC){
       return true;
 }
 
+/* Get a sorted list of the velocity blocks that exist in any of the given cells.
+ * The blocks are marked in a bitmap over the global id space of the velocity mesh
+ * using atomic updates, and the list is then extracted from the bitmap in parallel.
+ *
+ * @param cells Spatial cells
+ * @param popID Particle population ID
+ * @param unionOfBlocks Union of the velocity block global ids of the cells, in increasing order
+ */
+void get_union_of_blocks(const std::vector<SpatialCell*>& cells,
+                         const uint popID,
+                         std::vector<vmesh::GlobalID>& unionOfBlocks) {
+   unionOfBlocks.clear();
+   if (cells.size() == 0) return;
+
+   const vmesh::GlobalID maxBlocks = cells[0]->get_velocity_mesh(popID).getMaxVelocityBlocks();
+   const size_t nWords = (maxBlocks + 63) / 64;
+   std::vector<uint64_t> blockBits(nWords, 0);
+   // Start index of the blocks found by each thread in unionOfBlocks
+   std::vector<size_t> threadStart(omp_get_max_threads() + 1, 0);
+   bool outOfRange = false;
+
+#pragma omp parallel
+   {
+#pragma omp for schedule(guided)
+      for (size_t celli = 0; celli < cells.size(); ++celli) {
+         const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = cells[celli]->get_velocity_mesh(popID);
+         for (vmesh::LocalID block_i = 0; block_i < vmesh.size(); ++block_i) {
+            const vmesh::GlobalID blockGID = vmesh.getGlobalID(block_i);
+            if (blockGID >= maxBlocks) {
+#pragma omp atomic write
+               outOfRange = true;
+               continue;
+            }
+            const uint64_t bit = (uint64_t)1 << (blockGID % 64);
+            uint64_t word;
+#pragma omp atomic read
+            word = blockBits[blockGID / 64];
+            // Most blocks exist in neighboring cells too, skip the atomic update when already set
+            if ((word & bit) == 0) {
+#pragma omp atomic update
+               blockBits[blockGID / 64] |= bit;
+            }
+         }
+      }
+
+      // Both loops below use the same static schedule, so each thread counts and
+      // extracts the blocks of the same range of words.
+      const int threadID = omp_get_thread_num();
+      size_t nThreadBlocks = 0;
+#pragma omp for schedule(static)
+      for (size_t w = 0; w < nWords; ++w) {
+         nThreadBlocks += __builtin_popcountll(blockBits[w]);
+      }
+      threadStart[threadID + 1] = nThreadBlocks;
+#pragma omp barrier
+#pragma omp single
+      {
+         for (size_t t = 1; t < threadStart.size(); ++t) {
+            threadStart[t] += threadStart[t - 1];
+         }
+         unionOfBlocks.resize(threadStart.back());
+      }
+
+      size_t blocki = threadStart[threadID];
+#pragma omp for schedule(static)
+      for (size_t w = 0; w < nWords; ++w) {
+         uint64_t word = blockBits[w];
+         while (word != 0) {
+            unionOfBlocks[blocki++] = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+         }
+      }
+   }
+
+   if (outOfRange) {
+      std::cerr << __FILE__ << ":" << __LINE__ << " Velocity block global id out of range of the velocity mesh" << std::endl;
+      abort();
+   }
+}
+
 /*
  * return INVALID_CELLID if the spatial neighbor does not exist, or if
  * it is a cell that is not computed. If the
@@ -228,6 +312,50 @@ void compute_spatial_target_neighbors(const dccrg::Dccrg<SpatialCell,dccrg::Cart
 
 }
 
+/* Load the data of a block and of the same block in its spatial
+ * neighbors into the values array, transposed with cellid_transpose. A
+ * NULL block is loaded as zeros.
+ *
+ * @param blockDatas Data of the block in the 2 * VLASOV_STENCIL_WIDTH + 1 cells of the stencil
+ */
+static inline void load_trans_block_data(const Realf* const* blockDatas,
+                                         Vec* values,
+                                         const unsigned char* const cellid_transpose) {
+   //  Copy volume averages of this block from all spatial cells:
+   for (int b = -VLASOV_STENCIL_WIDTH; b <= VLASOV_STENCIL_WIDTH; ++b) {
+      if(blockDatas[b + VLASOV_STENCIL_WIDTH] != NULL) {
+         Realv blockValues[WID3];
+         const Realf* block_data = blockDatas[b + VLASOV_STENCIL_WIDTH];
+         // Copy data to a temporary array and transpose values so that mapping is along k direction.
+         // spatial source_neighbors already taken care of when
+         // creating source_neighbors table. If a normal spatial cell does not
+         // simply have the block, its value will be its null_block which
+         // is fine. This null_block has a value of zero in data, and that
+         // is thus the velocity space boundary
+         for (uint i=0; i<WID3; ++i) {
+            blockValues[i] = block_data[cellid_transpose[i]];
+         }
+      
+         // now load values into the actual values table..
+         uint offset =0;
+         for (uint k=0; k<WID; ++k) {
+            for(uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++){
+               // store data, when reading data from data we swap dimensions 
+               // using precomputed plane_index_to_id and cell_indices_to_id
+               values[i_trans_ps_blockv(planeVector, k, b)].load(blockValues + offset);
+               offset += VECL;
+            }
+         }
+      } else {
+         for (uint k=0; k<WID; ++k) {
+            for(uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+               values[i_trans_ps_blockv(planeVector, k, b)] = Vec(0);
+            }
+         }
+      }
+   }
+}
+
 /* Copy the data to the temporary values array, so that the
  * dimensions are correctly swapped. Also, copy the same block for
  * then neighboring spatial cells (in the dimension). neighbors
@@ -274,41 +402,165 @@ void copy_trans_block_data(
       }
    }
  
-   //  Copy volume averages of this block from all spatial cells:
-   for (int b = -VLASOV_STENCIL_WIDTH; b <= VLASOV_STENCIL_WIDTH; ++b) {
-      if(blockDatas[b + VLASOV_STENCIL_WIDTH] != NULL) {
-         Realv blockValues[WID3];
-         const Realf* block_data = blockDatas[b + VLASOV_STENCIL_WIDTH];
-         // Copy data to a temporary array and transpose values so that mapping is along k direction.
-         // spatial source_neighbors already taken care of when
-         // creating source_neighbors table. If a normal spatial cell does not
-         // simply have the block, its value will be its null_block which
-         // is fine. This null_block has a value of zero in data, and that
-         // is thus the velocity space boundary
-         for (uint i=0; i<WID3; ++i) {
-            blockValues[i] = block_data[cellid_transpose[i]];
-         }
-      
-         // now load values into the actual values table..
-         uint offset =0;
-         for (uint k=0; k<WID; ++k) {
-            for(uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++){
-               // store data, when reading data from data we swap dimensions 
-               // using precomputed plane_index_to_id and cell_indices_to_id
-               values[i_trans_ps_blockv(planeVector, k, b)].load(blockValues + offset);
-               offset += VECL;
-            }
+   load_trans_block_data(blockDatas, values, cellid_transpose);
+}
+
+/* Set the cell size in ordinary space along the dimension, and the
+ * transpose from the solver internal (transposed) id i + j*WID + k*WID2,
+ * where k is along the dimension, to the actual id of the cell in a block.
+ */
+static void set_trans_dimension(const uint dimension,
+                                Realv& dz,
+                                unsigned char* cellid_transpose) {
+   uint cell_indices_to_id[3]; /*< used when computing id of target cell in block*/
+   switch (dimension) {
+   case 0:
+      dz = P::dx_ini;
+      // set values in array that is used to convert block indices 
+      // to global ID using a dot product.
+      cell_indices_to_id[0]=WID2;
+      cell_indices_to_id[1]=WID;
+      cell_indices_to_id[2]=1;
+      break;
+   case 1:
+      dz = P::dy_ini;
+      // set values in array that is used to convert block indices 
+      // to global ID using a dot product
+      cell_indices_to_id[0]=1;
+      cell_indices_to_id[1]=WID2;
+      cell_indices_to_id[2]=WID;
+      break;
+   case 2:
+      dz = P::dz_ini;
+      // set values in array that is used to convert block indices
+      // to global id using a dot product.
+      cell_indices_to_id[0]=1;
+      cell_indices_to_id[1]=WID;
+      cell_indices_to_id[2]=WID2;
+      break;
+   default:
+      cerr << __FILE__ << ":"<< __LINE__ << " Wrong dimension, abort"<<endl;
+      abort();
+      break;
+   }
+         
+   // init plane_index_to_id
+   for (uint k=0; k<WID; ++k) {
+      for (uint j=0; j<WID; ++j) {
+         for (uint i=0; i<WID; ++i) {
+            const uint cell =
+               i * cell_indices_to_id[0] +
+               j * cell_indices_to_id[1] +
+               k * cell_indices_to_id[2];
+            cellid_transpose[ i + j * WID + k * WID2] = cell;
          }
+      }
+   }
+}
+
+/* Map one block of a cell along the dimension. The block and its spatial
+ * neighbors have been loaded into values by copy_trans_block_data, and the
+ * mapped data of the block and its neighbors at -1 and +1 is added to
+ * targetVecValues, which is indexed with i_trans_pt_blockv.
+ *
+ * @param blockIndex Index of the block along the dimension in velocity space
+ * @param minValue Sparsity threshold of the source cell
+ */
+static inline void compute_trans_block_targets(Vec* values,
+                                               Vec* targetVecValues,
+                                               const uint blockIndex,
+                                               const Realv dvz,
+                                               const Realv vz_min,
+                                               const Realv dt,
+                                               const Realv i_dz,
+                                               const Realv minValue) {
+   //i,j,k are now relative to the order in which we copied data to the values array. 
+   //After this point in the k,j,i loops there should be no branches based on dimensions
+   //
+   //Note that the i dimension is vectorized, and thus there are no loops over i
+   for (uint k=0; k<WID; ++k) {
+      const Realv cell_vz = (blockIndex * WID + k + 0.5) * dvz + vz_min; //cell centered velocity
+      const Realv z_translation = cell_vz * dt * i_dz; // how much it moved in time dt (reduced units)
+      const int target_scell_index = (z_translation > 0) ? 1: -1; //part of density goes here (cell index change along spatial direcion)
+    
+      //the coordinates (scaled units from 0 to 1) between which we will
+      //integrate to put mass in the target  neighboring cell. 
+      //As we are below CFL<1, we know
+      //that mass will go to two cells: current and the new one.
+      Realv z_1,z_2;
+      if ( z_translation < 0 ) {
+         z_1 = 0;
+         z_2 = -z_translation; 
       } else {
-         for (uint k=0; k<WID; ++k) {
-            for(uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
-               values[i_trans_ps_blockv(planeVector, k, b)] = Vec(0);
-            }
-         }
+         z_1 = 1.0 - z_translation;
+         z_2 = 1.0;
+      }
+      
+      for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+         //compute reconstruction
+#ifdef TRANS_SEMILAG_PLM
+         Vec a[3];
+         compute_plm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), VLASOV_STENCIL_WIDTH, a, minValue);
+#endif
+#ifdef TRANS_SEMILAG_PPM
+         Vec a[3];
+         //Check that stencil width VLASOV_STENCIL_WIDTH in grid.h corresponds to order of face estimates  (h4 & h5 =2, H6=3, h8=4)
+         compute_ppm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), h4, VLASOV_STENCIL_WIDTH, a, minValue);
+#endif
+#ifdef TRANS_SEMILAG_PQM
+         Vec a[5];
+         //Check that stencil width VLASOV_STENCIL_WIDTH in grid.h corresponds to order of face estimates (h4 & h5 =2, H6=3, h8=4)
+         compute_pqm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), h6, VLASOV_STENCIL_WIDTH, a, minValue);
+#endif
+ 
+#ifdef TRANS_SEMILAG_PLM
+         const Vec ngbr_target_density =
+            z_2 * ( a[0] + z_2 * a[1] ) -
+            z_1 * ( a[0] + z_1 * a[1] );
+#endif
+#ifdef TRANS_SEMILAG_PPM
+         const Vec ngbr_target_density =
+            z_2 * ( a[0] + z_2 * ( a[1] + z_2 * a[2] ) ) -
+            z_1 * ( a[0] + z_1 * ( a[1] + z_1 * a[2] ) );
+#endif
+#ifdef TRANS_SEMILAG_PQM
+         const Vec ngbr_target_density =
+            z_2 * ( a[0] + z_2 * ( a[1] + z_2 * ( a[2] + z_2 * ( a[3] + z_2 * a[4] ) ) ) ) -
+            z_1 * ( a[0] + z_1 * ( a[1] + z_1 * ( a[2] + z_1 * ( a[3] + z_1 * a[4] ) ) ) );
+#endif
+         targetVecValues[i_trans_pt_blockv(planeVector, k, target_scell_index)] +=  ngbr_target_density;                     //in the current original cells we will put this density        
+         targetVecValues[i_trans_pt_blockv(planeVector, k, 0)] +=  values[i_trans_ps_blockv(planeVector, k, 0)] - ngbr_target_density; //in the current original cells we will put the rest of the original density
       }
    }
 }
 
+/* Returns true if all cells in the source stencil of the cell are
+ * local, i.e., the cell can be mapped before the ghost cell data has
+ * been received.
+ */
+bool trans_source_neighbors_are_local(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                      const CellID& cellID,
+                                      const uint dimension) {
+   for(int i = -VLASOV_STENCIL_WIDTH; i <= VLASOV_STENCIL_WIDTH; i++){
+      CellID nbrID = INVALID_CELLID;
+      switch (dimension){
+      case 0:
+         nbrID = get_spatial_neighbor(mpiGrid, cellID, true, i, 0, 0);
+         break;
+      case 1:
+         nbrID = get_spatial_neighbor(mpiGrid, cellID, true, 0, i, 0);
+         break;
+      case 2:
+         nbrID = get_spatial_neighbor(mpiGrid, cellID, true, 0, 0, i);
+         break;
+      }
+      if (nbrID != INVALID_CELLID && !mpiGrid.is_local(nbrID)) {
+         return false;
+      }
+   }
+   return true;
+}
+
 /* 
    Here we map from the current time step grid, to a target grid which
    is the lagrangian departure grid (so th grid at timestep +dt,
@@ -316,25 +568,44 @@ void copy_trans_block_data(
 
    This function can, and should be, safely called in a parallel
    OpenMP region (as long as it does only one dimension per parallel
-   refion). It is safe as each thread only computes certain blocks (blockID%tnum_threads = thread_num */
+   refion). It is safe as each thread only computes certain blocks (blockID%tnum_threads = thread_num 
+
+   With phase translationphase::INTERIOR (BOUNDARY) only the cells whose
+   source stencil is (is not) local are mapped, and the results are
+   added to the temporary block containers of the target cells instead
+   of the actual blocks. */
 
 bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                  const vector<CellID>& localPropagatedCells,
+                  const vector<CellID>& propagatedCells,
                   const vector<CellID>& remoteTargetCells,
                   const uint dimension,
                   const Realv dt,
-                  const uint popID) {
+                  const uint popID,
+                  const uint phase) {
    // values used with an stencil in 1 dimension, initialized to 0. 
    // Contains a block, and its spatial neighbours in one dimension.
-   Realv dz,z_min, dvz,vz_min;
-   uint cell_indices_to_id[3]; /*< used when computing id of target cell in block*/
+   Realv dz, dvz,vz_min;
    unsigned char  cellid_transpose[WID3]; /*< defines the transpose for the solver internal (transposed) id: i + j*WID + k*WID2 to actual one*/
 
+   // In split-phase mode pick the cells belonging to this phase. Target
+   // cells are not reset here, so remote targets need not be included.
+   vector<CellID> phaseCells;
+   if (phase != translationphase::ALL) {
+      for (const auto cellID : propagatedCells) {
+         if (trans_source_neighbors_are_local(mpiGrid, cellID, dimension) == (phase == translationphase::INTERIOR)) {
+            phaseCells.push_back(cellID);
+         }
+      }
+   }
+   const vector<CellID>& localPropagatedCells = (phase == translationphase::ALL) ? propagatedCells : phaseCells;
+
    if(localPropagatedCells.size() == 0) 
       return true; 
 //vector with all cells
    vector<CellID> allCells(localPropagatedCells);
-   allCells.insert(allCells.end(), remoteTargetCells.begin(), remoteTargetCells.end());
+   if (phase == translationphase::ALL) {
+      allCells.insert(allCells.end(), remoteTargetCells.begin(), remoteTargetCells.end());
+   }
    
    const uint nSourceNeighborsPerCell = 1 + 2 * VLASOV_STENCIL_WIDTH;
    std::vector<SpatialCell*> allCellsPointer(allCells.size());
@@ -359,81 +630,17 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
    }
    
     
-   //Get a unique sorted list of blockids that are in any of the
-   // propagated cells. First use set for this, then add to vector (may not
-   // be the most nice way to do this and in any case we could do it along
-   // dimension for data locality reasons => copy acc map column code, TODO: FIXME
-   std::unordered_set<vmesh::GlobalID> unionOfBlocksSet;
-   
-
-
-   for(uint celli = 0; celli < allCellsPointer.size(); celli++) {
-      vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = allCellsPointer[celli]->get_velocity_mesh(popID);
-      for (vmesh::LocalID block_i=0; block_i< vmesh.size(); ++block_i) {
-         unionOfBlocksSet.insert(vmesh.getGlobalID(block_i));
-      }
-   }
-   
+   // Get a unique sorted list of blockids that are in any of the
+   // propagated cells.
    std::vector<vmesh::GlobalID> unionOfBlocks;
-   unionOfBlocks.reserve(unionOfBlocksSet.size());
-   for(const auto blockGID:  unionOfBlocksSet) {
-      unionOfBlocks.push_back(blockGID);
-   }
-   
-    
+   get_union_of_blocks(allCellsPointer, popID, unionOfBlocks);
 
-   
    const uint8_t REFLEVEL=0;
    const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = allCellsPointer[0]->get_velocity_mesh(popID);
    // set cell size in dimension direction
    dvz = vmesh.getCellSize(REFLEVEL)[dimension];
    vz_min = vmesh.getMeshMinLimits()[dimension];
-   switch (dimension) {
-   case 0:
-      dz = P::dx_ini;
-      z_min = P::xmin;
-      // set values in array that is used to convert block indices 
-      // to global ID using a dot product.
-      cell_indices_to_id[0]=WID2;
-      cell_indices_to_id[1]=WID;
-      cell_indices_to_id[2]=1;
-      break;
-   case 1:
-      dz = P::dy_ini;
-      z_min = P::ymin;
-      // set values in array that is used to convert block indices 
-      // to global ID using a dot product
-      cell_indices_to_id[0]=1;
-      cell_indices_to_id[1]=WID2;
-      cell_indices_to_id[2]=WID;
-      break;
-   case 2:
-      dz = P::dz_ini;
-      z_min = P::zmin;
-      // set values in array that is used to convert block indices
-      // to global id using a dot product.
-      cell_indices_to_id[0]=1;
-      cell_indices_to_id[1]=WID;
-      cell_indices_to_id[2]=WID2;
-      break;
-   default:
-      cerr << __FILE__ << ":"<< __LINE__ << " Wrong dimension, abort"<<endl;
-      abort();
-      break;
-   }
-         
-   // init plane_index_to_id
-   for (uint k=0; k<WID; ++k) {
-      for (uint j=0; j<WID; ++j) {
-         for (uint i=0; i<WID; ++i) {
-            const uint cell =
-               i * cell_indices_to_id[0] +
-               j * cell_indices_to_id[1] +
-               k * cell_indices_to_id[2];
-            cellid_transpose[ i + j * WID + k * WID2] = cell;
-         }
-      }
-   }
+   set_trans_dimension(dimension, dz, cellid_transpose);
 
    const Realv i_dz=1.0/dz;
    
@@ -453,6 +660,8 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
       for(uint blocki = 0; blocki < unionOfBlocks.size(); blocki++){
          vmesh::GlobalID blockGID = unionOfBlocks[blocki];
          phiprof::start(t1);
+         const double tMapping = MPI_Wtime();
+         uint64_t nMappedBlocks = 0;
          
          for(uint celli = 0; celli < allCellsPointer.size(); celli++){
             allCellsBlockLocalID[celli] = allCellsPointer[celli]->get_velocity_block_local_id(blockGID, popID);
@@ -491,69 +700,14 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
             uint8_t refLevel;
             vmesh.getIndices(blockGID,refLevel, block_indices[0], block_indices[1], block_indices[2]);
           
-            //i,j,k are now relative to the order in which we copied data to the values array. 
-            //After this point in the k,j,i loops there should be no branches based on dimensions
-            //
-            //Note that the i dimension is vectorized, and thus there are no loops over i
-            for (uint k=0; k<WID; ++k) {
-               const Realv cell_vz = (block_indices[dimension] * WID + k + 0.5) * dvz + vz_min; //cell centered velocity
-               const Realv z_translation = cell_vz * dt * i_dz; // how much it moved in time dt (reduced units)
-               const int target_scell_index = (z_translation > 0) ? 1: -1; //part of density goes here (cell index change along spatial direcion)
-             
-               //the coordinates (scaled units from 0 to 1) between which we will
-               //integrate to put mass in the target  neighboring cell. 
-               //As we are below CFL<1, we know
-               //that mass will go to two cells: current and the new one.
-               Realv z_1,z_2;
-               if ( z_translation < 0 ) {
-                  z_1 = 0;
-                  z_2 = -z_translation; 
-               } else {
-                  z_1 = 1.0 - z_translation;
-                  z_2 = 1.0;
-               }
-               
-               for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
-                  //compute reconstruction
-#ifdef TRANS_SEMILAG_PLM
-                  Vec a[3];
-                  compute_plm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), VLASOV_STENCIL_WIDTH, a, spatial_cell->getVelocityBlockMinValue(popID));
-#endif
-#ifdef TRANS_SEMILAG_PPM
-                  Vec a[3];
-                  //Check that stencil width VLASOV_STENCIL_WIDTH in grid.h corresponds to order of face estimates  (h4 & h5 =2, H6=3, h8=4)
-                  compute_ppm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), h4, VLASOV_STENCIL_WIDTH, a, spatial_cell->getVelocityBlockMinValue(popID));
-#endif
-#ifdef TRANS_SEMILAG_PQM
-                  Vec a[5];
-                  //Check that stencil width VLASOV_STENCIL_WIDTH in grid.h corresponds to order of face estimates (h4 & h5 =2, H6=3, h8=4)
-                  compute_pqm_coeff(values + i_trans_ps_blockv(planeVector, k, -VLASOV_STENCIL_WIDTH), h6, VLASOV_STENCIL_WIDTH, a, spatial_cell->getVelocityBlockMinValue(popID));
-#endif
-          
-#ifdef TRANS_SEMILAG_PLM
-                  const Vec ngbr_target_density =
-                     z_2 * ( a[0] + z_2 * a[1] ) -
-                     z_1 * ( a[0] + z_1 * a[1] );
-#endif
-#ifdef TRANS_SEMILAG_PPM
-                  const Vec ngbr_target_density =
-                     z_2 * ( a[0] + z_2 * ( a[1] + z_2 * a[2] ) ) -
-                     z_1 * ( a[0] + z_1 * ( a[1] + z_1 * a[2] ) );
-#endif
-#ifdef TRANS_SEMILAG_PQM
-                  const Vec ngbr_target_density =
-                     z_2 * ( a[0] + z_2 * ( a[1] + z_2 * ( a[2] + z_2 * ( a[3] + z_2 * a[4] ) ) ) ) -
-                     z_1 * ( a[0] + z_1 * ( a[1] + z_1 * ( a[2] + z_1 * ( a[3] + z_1 * a[4] ) ) ) );
-#endif
-                  targetVecValues[i_trans_pt_blockv(planeVector, k, target_scell_index)] +=  ngbr_target_density;                     //in the current original cells we will put this density        
-                  targetVecValues[i_trans_pt_blockv(planeVector, k, 0)] +=  values[i_trans_ps_blockv(planeVector, k, 0)] - ngbr_target_density; //in the current original cells we will put the rest of the original density
-               }
-            }
+            compute_trans_block_targets(values, targetVecValues, block_indices[dimension], dvz, vz_min, dt, i_dz,
+                                        spatial_cell->getVelocityBlockMinValue(popID));
          
             //Store final vector data in temporary data for all target blocks,
             //and mark that this celli produced valid targets
          
             targetsValid[celli] = true;
+            ++nMappedBlocks;
             for (int b = -1; b< 2 ; ++b) {
                Realv vector[VECL];
                for (uint k=0; k<WID; ++k) {
@@ -574,8 +728,31 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
             }
          }
       
+         kernelcounters::add(kernelcounters::TRANS_MAPPING, MPI_Wtime() - tMapping, nMappedBlocks);
          phiprof::stop(t1);
          phiprof::start(t2);
+
+         if (phase != translationphase::ALL) {
+            //add values from target_values array to the temporary blocks,
+            //they are stored to the actual blocks in store_trans_target_blocks
+            for(uint celli = 0; celli < localPropagatedCells.size(); celli++){
+               if(!targetsValid[celli]) continue;
+               for(uint ti = 0; ti < 3; ti++) {
+                  SpatialCell* spatial_cell = targetNeighbors[celli * 3 + ti];
+                  if(spatial_cell == NULL) continue;
+
+                  const vmesh::LocalID blockLID = spatial_cell->get_velocity_block_local_id(blockGID, popID);
+                  if (blockLID == vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>::invalidLocalID()) continue;
+
+                  Realf* blockData = spatial_cell->get_velocity_blocks_temporary().getData(blockLID);
+                  for(int i = 0; i < WID3 ; i++) {
+                     blockData[i] += targetBlockData[(celli * 3 + ti) * WID3 + i];
+                  }
+               }
+            }
+            phiprof::stop(t2);
+            continue;
+         }
                
          //reset blocks in all non-sysboundary spatial cells for this block id
          for(uint celli = 0; celli < allCellsPointer.size(); celli++){
@@ -627,6 +804,507 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
    return true;
 }
 
+/* Prepare the temporary block containers of all non-sysboundary cells
+   for split-phase translation. The containers get the same number of
+   blocks as the population, initialized to zero, and use the same
+   local IDs. This corresponds to resetting the target blocks in
+   trans_map_1d. */
+
+void reset_trans_target_blocks(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const vector<CellID>& localPropagatedCells,
+                               const vector<CellID>& remoteTargetCells,
+                               const uint popID) {
+   vector<CellID> allCells(localPropagatedCells);
+   allCells.insert(allCells.end(), remoteTargetCells.begin(), remoteTargetCells.end());
+
+#pragma omp parallel for schedule(dynamic,1)
+   for(uint celli = 0; celli < allCells.size(); celli++){
+      SpatialCell* spatial_cell = mpiGrid[allCells[celli]];
+      vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainerTemp = spatial_cell->get_velocity_blocks_temporary();
+      blockContainerTemp.clear();
+      if(spatial_cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) {
+         blockContainerTemp.push_back(spatial_cell->get_number_of_velocity_blocks(popID));
+      }
+   }
+}
+
+/* Store the values accumulated into the temporary block containers
+   during split-phase translation to the actual blocks, and free the
+   temporary containers. Must not be called before the sends of the
+   ghost cell exchange have completed, as the block data of local cells
+   may still be in use by MPI. */
+
+void store_trans_target_blocks(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const vector<CellID>& localPropagatedCells,
+                               const vector<CellID>& remoteTargetCells,
+                               const uint popID) {
+   vector<CellID> allCells(localPropagatedCells);
+   allCells.insert(allCells.end(), remoteTargetCells.begin(), remoteTargetCells.end());
+
+#pragma omp parallel for schedule(dynamic,1)
+   for(uint celli = 0; celli < allCells.size(); celli++){
+      SpatialCell* spatial_cell = mpiGrid[allCells[celli]];
+      vmesh::VelocityBlockContainer<vmesh::LocalID>& blockContainerTemp = spatial_cell->get_velocity_blocks_temporary();
+      if(spatial_cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) {
+         const Realf* source = blockContainerTemp.getData();
+         Realf* target = spatial_cell->get_data(popID);
+         const size_t nValues = spatial_cell->get_number_of_velocity_blocks(popID) * WID3;
+         for(size_t i = 0; i < nValues; i++) {
+            target[i] = source[i];
+         }
+      }
+      blockContainerTemp.clear();
+   }
+}
+
+/* Chebyshev distance, counted in the translated dimensions, from each cell
+ * of the box to the nearest cell that is not in the set, capped to
+ * maxLevel. Cells outside the box are not in the set.
+ */
+static void get_trans_box_levels(const vector<uint8_t>& inSet,
+                                 const int* boxSize,
+                                 const bool* translated,
+                                 const int maxLevel,
+                                 vector<int>& level) {
+   const size_t stride[3] = {1, (size_t)boxSize[0], (size_t)boxSize[0] * boxSize[1]};
+   level.resize(inSet.size());
+   for (size_t i = 0; i < inSet.size(); ++i) {
+      level[i] = inSet[i] ? maxLevel : 0;
+   }
+
+   vector<int> boxMin, previous;
+   for (int iteration = 0; iteration < maxLevel; ++iteration) {
+      // minimum over the 3x3x3 neighborhood, one dimension at a time
+      boxMin = level;
+      for (uint d = 0; d < 3; ++d) {
+         if (!translated[d]) continue;
+         previous = boxMin;
+         for (int k = 0; k < boxSize[2]; ++k) {
+            for (int j = 0; j < boxSize[1]; ++j) {
+               for (int i = 0; i < boxSize[0]; ++i) {
+                  const int coordinate[3] = {i, j, k};
+                  const size_t c = i + j * stride[1] + k * stride[2];
+                  const int lower = coordinate[d] > 0 ? previous[c - stride[d]] : 0;
+                  const int upper = coordinate[d] < boxSize[d] - 1 ? previous[c + stride[d]] : 0;
+                  boxMin[c] = min(previous[c], min(lower, upper));
+               }
+            }
+         }
+      }
+      for (size_t c = 0; c < level.size(); ++c) {
+         level[c] = min(level[c], boxMin[c] + 1);
+      }
+   }
+}
+
+/* Find the tiles of local cells on a uniform grid that can be translated
+   in the given dimensions at once by trans_map_fused_tiles. A tile qualifies
+   if every cell within VLASOV_STENCIL_WIDTH + 1 cells of it, in the fused
+   dimensions, is a local non-sysboundary cell, so that none of the ghost
+   cell exchanges or remote contributions between the dimensions affect it.
+
+   The cells of the tiles are only mapped by trans_map_1d where their
+   intermediate values are still needed by the other cells, i.e., within
+   (VLASOV_STENCIL_WIDTH + 1) cells per remaining dimension from the
+   edge of the tiles. The cells to map in each dimension are stored in
+   tiles.propagatedCells.
+
+   @param dimensions Fused dimensions, the first ones in the order they are mapped
+   @param tileSize Size of the tiles in cells in each fused dimension, the
+   tiles are one cell thick in the other dimensions
+*/
+void prepare_fused_trans_tiles(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const vector<CellID>& localPropagatedCells,
+                               const vector<uint>& dimensions,
+                               const uint tileSize,
+                               FusedTransTiles& tiles) {
+   tiles.dimensions = dimensions;
+   tiles.boxCells.clear();
+   tiles.tileStart.clear();
+   tiles.fusedCells.clear();
+   for (uint d = 0; d < 3; ++d) {
+      tiles.propagatedCells[d] = localPropagatedCells;
+   }
+   if (localPropagatedCells.size() == 0 || dimensions.size() == 0 || tileSize == 0) return;
+
+   const int halo = VLASOV_STENCIL_WIDTH + 1;
+   bool translated[3] = {false, false, false};
+   for (const uint d : dimensions) {
+      translated[d] = true;
+   }
+
+   vector<array<int,3> > cellIndices(localPropagatedCells.size());
+   int boxEnd[3];
+   for (uint d = 0; d < 3; ++d) {
+      tiles.boxStart[d] = numeric_limits<int>::max();
+      boxEnd[d] = numeric_limits<int>::min();
+      tiles.tileSize[d] = translated[d] ? tileSize : 1;
+   }
+   for (size_t c = 0; c < localPropagatedCells.size(); ++c) {
+      const dccrg::Types<3>::indices_t indices = mpiGrid.mapping.get_indices(localPropagatedCells[c]);
+      for (uint d = 0; d < 3; ++d) {
+         cellIndices[c][d] = indices[d];
+         tiles.boxStart[d] = min(tiles.boxStart[d], cellIndices[c][d]);
+         boxEnd[d] = max(boxEnd[d], cellIndices[c][d]);
+      }
+   }
+   for (uint d = 0; d < 3; ++d) {
+      tiles.boxSize[d] = boxEnd[d] - tiles.boxStart[d] + 1;
+   }
+   const size_t stride[3] = {1, (size_t)tiles.boxSize[0], (size_t)tiles.boxSize[0] * tiles.boxSize[1]};
+   const size_t nBoxCells = stride[2] * tiles.boxSize[2];
+
+   vector<size_t> boxIndex(localPropagatedCells.size());
+   vector<uint8_t> valid(nBoxCells, 0);
+   tiles.boxCells.assign(nBoxCells, NULL);
+   for (size_t c = 0; c < localPropagatedCells.size(); ++c) {
+      boxIndex[c] = 0;
+      for (uint d = 0; d < 3; ++d) {
+         boxIndex[c] += (cellIndices[c][d] - tiles.boxStart[d]) * stride[d];
+      }
+      SpatialCell* cell = mpiGrid[localPropagatedCells[c]];
+      if (cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) {
+         valid[boxIndex[c]] = 1;
+         tiles.boxCells[boxIndex[c]] = cell;
+      }
+   }
+
+   // Tiles whose cells all have a full halo of valid cells
+   vector<int> level;
+   get_trans_box_levels(valid, tiles.boxSize, translated, halo + 1, level);
+   vector<uint8_t> fused(nBoxCells, 0);
+   int nTiles[3];
+   for (uint d = 0; d < 3; ++d) {
+      nTiles[d] = tiles.boxSize[d] / tiles.tileSize[d];
+   }
+   for (int tk = 0; tk < nTiles[2]; ++tk) {
+      for (int tj = 0; tj < nTiles[1]; ++tj) {
+         for (int ti = 0; ti < nTiles[0]; ++ti) {
+            const array<int,3> start = {{ti * tiles.tileSize[0], tj * tiles.tileSize[1], tk * tiles.tileSize[2]}};
+            bool interior = true;
+            for (int k = start[2]; k < start[2] + tiles.tileSize[2] && interior; ++k) {
+               for (int j = start[1]; j < start[1] + tiles.tileSize[1] && interior; ++j) {
+                  for (int i = start[0]; i < start[0] + tiles.tileSize[0] && interior; ++i) {
+                     interior = level[i + j * stride[1] + k * stride[2]] > halo;
+                  }
+               }
+            }
+            if (!interior) continue;
+
+            tiles.tileStart.push_back(start);
+            for (int k = start[2]; k < start[2] + tiles.tileSize[2]; ++k) {
+               for (int j = start[1]; j < start[1] + tiles.tileSize[1]; ++j) {
+                  for (int i = start[0]; i < start[0] + tiles.tileSize[0]; ++i) {
+                     fused[i + j * stride[1] + k * stride[2]] = 1;
+                  }
+               }
+            }
+         }
+      }
+   }
+   if (tiles.tileStart.size() == 0) return;
+
+   // Cells of the tiles are mapped by trans_map_1d in a dimension as long
+   // as the later dimensions read their values, or the values of their
+   // targets, from outside the tiles
+   const int nPasses = dimensions.size();
+   vector<int> fusedLevel;
+   get_trans_box_levels(fused, tiles.boxSize, translated, 1 + nPasses * halo, fusedLevel);
+   for (int pass = 0; pass < nPasses; ++pass) {
+      const int maxLevel = 1 + (nPasses - 1 - pass) * halo;
+      vector<CellID>& propagatedCells = tiles.propagatedCells[dimensions[pass]];
+      propagatedCells.clear();
+      for (size_t c = 0; c < localPropagatedCells.size(); ++c) {
+         if (fusedLevel[boxIndex[c]] <= maxLevel) {
+            propagatedCells.push_back(localPropagatedCells[c]);
+         }
+      }
+   }
+   for (size_t c = 0; c < localPropagatedCells.size(); ++c) {
+      if (fused[boxIndex[c]]) {
+         tiles.fusedCells.push_back(localPropagatedCells[c]);
+      }
+   }
+}
+
+/* Scratch buffers of one thread in trans_map_fused_tiles, holding one
+ * velocity block of a tile and its halo. The buffers are kept between
+ * calls and only grow.
+ */
+struct FusedTileScratchBuffers {
+   std::vector<Realf, aligned_allocator<Realf, WID3>> values;
+   std::vector<Realf, aligned_allocator<Realf, WID3>> targetValues;
+   std::vector<SpatialCell*> bufferCells;
+   std::vector<vmesh::LocalID> bufferBlockLID;
+};
+
+// One set of scratch buffers per OpenMP thread, indexed by omp_get_thread_num()
+static std::vector<FusedTileScratchBuffers> fusedTileScratchBuffers;
+
+/* Translate the cells of the tiles found by prepare_fused_trans_tiles in
+   the fused dimensions at once. For each tile and velocity block the block
+   data of the tile and its halo is gathered into per-thread scratch
+   buffers, and the dimensions are mapped one after another in the buffers,
+   the first ones also in the halo of the later ones. With tiles one cell
+   thick in the other dimensions the buffers hold (tileSize + 2 *
+   (VLASOV_STENCIL_WIDTH + 1))^2 blocks each, so that all passes over them
+   stay in the L2 cache. The data is read from the blocks of the cells
+   before any fused dimension has been mapped by trans_map_1d, and the
+   result is written into new block containers of the fused cells, which
+   replace theirs in store_fused_trans_tiles. Up to round-off this gives
+   the same result as mapping the dimensions with trans_map_1d, as the
+   tiles see no ghost or boundary cells. */
+
+void trans_map_fused_tiles(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                           FusedTransTiles& tiles,
+                           const Realv dt,
+                           const uint popID) {
+   if (tiles.mappedBlocks.size() <= popID) {
+      tiles.mappedBlocks.resize(popID + 1);
+   }
+   vector<vmesh::VelocityBlockContainer<vmesh::LocalID> >& mappedBlocks = tiles.mappedBlocks[popID];
+   mappedBlocks.clear();
+   if (tiles.tileStart.size() == 0) return;
+
+   // The mapped blocks get the block parameters of the cells, every block
+   // is written by the tile of its cell
+   vector<SpatialCell*> fusedCells(tiles.fusedCells.size());
+   mappedBlocks.resize(tiles.fusedCells.size());
+#pragma omp parallel for schedule(dynamic,1)
+   for (size_t c = 0; c < tiles.fusedCells.size(); ++c) {
+      fusedCells[c] = mpiGrid[tiles.fusedCells[c]];
+      const vmesh::VelocityBlockContainer<vmesh::LocalID>& blocks = fusedCells[c]->get_velocity_blocks(popID);
+      mappedBlocks[c].push_back(blocks.size());
+      const Real* parameters = blocks.getParameters();
+      Real* mappedParameters = mappedBlocks[c].getParameters();
+      for (size_t i = 0; i < blocks.size() * BlockParams::N_VELOCITY_BLOCK_PARAMS; ++i) {
+         mappedParameters[i] = parameters[i];
+      }
+   }
+
+   std::vector<vmesh::GlobalID> unionOfBlocks;
+   get_union_of_blocks(fusedCells, popID, unionOfBlocks);
+   if (unionOfBlocks.size() == 0) return;
+
+   // Position of each fused cell in the box, to find its mapped blocks
+   const size_t stride[3] = {1, (size_t)tiles.boxSize[0], (size_t)tiles.boxSize[0] * tiles.boxSize[1]};
+   vector<size_t> fusedCellOfBox(tiles.boxCells.size(), 0);
+   for (size_t c = 0; c < tiles.fusedCells.size(); ++c) {
+      const dccrg::Types<3>::indices_t indices = mpiGrid.mapping.get_indices(tiles.fusedCells[c]);
+      size_t boxIndex = 0;
+      for (uint d = 0; d < 3; ++d) {
+         boxIndex += (indices[d] - tiles.boxStart[d]) * stride[d];
+      }
+      fusedCellOfBox[boxIndex] = c;
+   }
+
+   const uint nPasses = tiles.dimensions.size();
+   const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = fusedCells[0]->get_velocity_mesh(popID);
+   Realv dz[3], dvz[3], vz_min[3], i_dz[3];
+   unsigned char cellid_transpose[3][WID3];
+   for (uint pass = 0; pass < nPasses; ++pass) {
+      const uint dimension = tiles.dimensions[pass];
+      set_trans_dimension(dimension, dz[pass], cellid_transpose[pass]);
+      dvz[pass] = vmesh.getCellSize(0)[dimension];
+      vz_min[pass] = vmesh.getMeshMinLimits()[dimension];
+      i_dz[pass] = 1.0 / dz[pass];
+   }
+
+   // The buffer holds the tile and its halo in the translated dimensions
+   const int halo = VLASOV_STENCIL_WIDTH + 1;
+   int haloWidth[3] = {0, 0, 0};
+   for (const uint d : tiles.dimensions) {
+      haloWidth[d] = halo;
+   }
+   int bufferSize[3];
+   for (uint d = 0; d < 3; ++d) {
+      bufferSize[d] = tiles.tileSize[d] + 2 * haloWidth[d];
+   }
+   const size_t bufferStride[3] = {1, (size_t)bufferSize[0], (size_t)bufferSize[0] * bufferSize[1]};
+   const size_t nBufferCells = bufferStride[2] * bufferSize[2];
+   const size_t nTiles = tiles.tileStart.size();
+   const size_t nBlocks = unionOfBlocks.size();
+
+   if (fusedTileScratchBuffers.size() < (size_t)omp_get_max_threads()) {
+      fusedTileScratchBuffers.resize(omp_get_max_threads());
+   }
+
+#pragma omp parallel
+   {
+      FusedTileScratchBuffers& scratch = fusedTileScratchBuffers[omp_get_thread_num()];
+      growScratchBuffer(scratch.values, nBufferCells * WID3);
+      growScratchBuffer(scratch.targetValues, nBufferCells * WID3);
+      growScratchBuffer(scratch.bufferCells, nBufferCells);
+      growScratchBuffer(scratch.bufferBlockLID, nBufferCells);
+      Realf* values = scratch.values.data();
+      Realf* targetValues = scratch.targetValues.data();
+      SpatialCell** bufferCells = scratch.bufferCells.data();
+      vmesh::LocalID* bufferBlockLID = scratch.bufferBlockLID.data();
+
+#pragma omp for schedule(dynamic,1)
+      for (size_t item = 0; item < nTiles * nBlocks; ++item) {
+         const double tMapping = MPI_Wtime();
+         uint64_t nMappedBlocks = 0;
+         const array<int,3>& tileStart = tiles.tileStart[item / nBlocks];
+         const vmesh::GlobalID blockGID = unionOfBlocks[item % nBlocks];
+         velocity_block_indices_t block_indices;
+         uint8_t refLevel;
+         vmesh.getIndices(blockGID, refLevel, block_indices[0], block_indices[1], block_indices[2]);
+
+         // Gather the block of the tile and its halo, missing blocks are zero
+         for (int k = 0; k < bufferSize[2]; ++k) {
+            for (int j = 0; j < bufferSize[1]; ++j) {
+               for (int i = 0; i < bufferSize[0]; ++i) {
+                  const size_t b = i + j * bufferStride[1] + k * bufferStride[2];
+                  const size_t boxIndex =
+                     (tileStart[0] + i - haloWidth[0]) * stride[0] +
+                     (tileStart[1] + j - haloWidth[1]) * stride[1] +
+                     (tileStart[2] + k - haloWidth[2]) * stride[2];
+                  SpatialCell* cell = tiles.boxCells[boxIndex];
+                  bufferCells[b] = cell;
+                  bufferBlockLID[b] = cell->get_velocity_block_local_id(blockGID, popID);
+                  if (bufferBlockLID[b] != cell->invalid_local_id()) {
+                     const Realf* data = cell->get_data(bufferBlockLID[b], popID);
+                     for (uint c = 0; c < WID3; ++c) {
+                        values[b * WID3 + c] = data[c];
+                     }
+                  } else {
+                     for (uint c = 0; c < WID3; ++c) {
+                        values[b * WID3 + c] = 0.0;
+                     }
+                  }
+               }
+            }
+         }
+
+         // Range of cells with valid values, shrinks to the tile in each
+         // dimension once it has been mapped
+         int begin[3] = {0, 0, 0};
+         int end[3] = {bufferSize[0], bufferSize[1], bufferSize[2]};
+         for (uint pass = 0; pass < nPasses; ++pass) {
+            const uint dimension = tiles.dimensions[pass];
+            int targetBegin[3] = {begin[0], begin[1], begin[2]};
+            int targetEnd[3] = {end[0], end[1], end[2]};
+            targetBegin[dimension] = haloWidth[dimension];
+            targetEnd[dimension] = haloWidth[dimension] + tiles.tileSize[dimension];
+            int sourceBegin[3] = {begin[0], begin[1], begin[2]};
+            int sourceEnd[3] = {end[0], end[1], end[2]};
+            sourceBegin[dimension] = targetBegin[dimension] - 1;
+            sourceEnd[dimension] = targetEnd[dimension] + 1;
+
+            for (int k = targetBegin[2]; k < targetEnd[2]; ++k) {
+               for (int j = targetBegin[1]; j < targetEnd[1]; ++j) {
+                  for (int i = targetBegin[0]; i < targetEnd[0]; ++i) {
+                     const size_t b = i + j * bufferStride[1] + k * bufferStride[2];
+                     for (uint c = 0; c < WID3; ++c) {
+                        targetValues[b * WID3 + c] = 0.0;
+                     }
+                  }
+               }
+            }
+
+            for (int k = sourceBegin[2]; k < sourceEnd[2]; ++k) {
+               for (int j = sourceBegin[1]; j < sourceEnd[1]; ++j) {
+                  for (int i = sourceBegin[0]; i < sourceEnd[0]; ++i) {
+                     const int position[3] = {i, j, k};
+                     const size_t b = i + j * bufferStride[1] + k * bufferStride[2];
+                     if (bufferBlockLID[b] == bufferCells[b]->invalid_local_id()) continue;
+
+                     const Realf* blockDatas[VLASOV_STENCIL_WIDTH * 2 + 1];
+                     for (int s = -VLASOV_STENCIL_WIDTH; s <= VLASOV_STENCIL_WIDTH; ++s) {
+                        const size_t sb = b + s * bufferStride[dimension];
+                        blockDatas[s + VLASOV_STENCIL_WIDTH] =
+                           bufferBlockLID[sb] != bufferCells[sb]->invalid_local_id() ? &values[sb * WID3] : NULL;
+                     }
+                     Vec sourceVecValues[(1 + 2 * VLASOV_STENCIL_WIDTH) * WID3 / VECL];
+                     load_trans_block_data(blockDatas, sourceVecValues, cellid_transpose[pass]);
+
+                     Vec targetVecValues[3 * WID3 / VECL];
+                     for (uint v = 0; v < 3 * WID3 / VECL; ++v) {
+                        targetVecValues[v] = Vec(0.0);
+                     }
+                     compute_trans_block_targets(sourceVecValues, targetVecValues, block_indices[dimension],
+                                                 dvz[pass], vz_min[pass], dt, i_dz[pass],
+                                                 bufferCells[b]->getVelocityBlockMinValue(popID));
+                     ++nMappedBlocks;
+
+                     // Add to the targets in the tile, blocks that do not exist
+                     // in the target cell are not created, as in trans_map_1d
+                     for (int t = -1; t < 2; ++t) {
+                        if (position[dimension] + t < targetBegin[dimension] ||
+                            position[dimension] + t >= targetEnd[dimension]) continue;
+                        const size_t tb = b + t * bufferStride[dimension];
+                        if (bufferBlockLID[tb] == bufferCells[tb]->invalid_local_id()) continue;
+                        Realf* targetData = &targetValues[tb * WID3];
+                        for (uint kv = 0; kv < WID; ++kv) {
+                           for (uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++) {
+                              Realv vector[VECL];
+                              targetVecValues[i_trans_pt_blockv(planeVector, kv, t)].store(vector);
+                              for (uint iv = 0; iv < VECL; iv++) {
+                                 targetData[cellid_transpose[pass][iv + planeVector * VECL + kv * WID2]] += vector[iv];
+                              }
+                           }
+                        }
+                     }
+                  }
+               }
+            }
+
+            for (int k = targetBegin[2]; k < targetEnd[2]; ++k) {
+               for (int j = targetBegin[1]; j < targetEnd[1]; ++j) {
+                  for (int i = targetBegin[0]; i < targetEnd[0]; ++i) {
+                     const size_t b = i + j * bufferStride[1] + k * bufferStride[2];
+                     for (uint c = 0; c < WID3; ++c) {
+                        values[b * WID3 + c] = targetValues[b * WID3 + c];
+                     }
+                  }
+               }
+            }
+            begin[dimension] = targetBegin[dimension];
+            end[dimension] = targetEnd[dimension];
+         }
+
+         // Store the tile, each (cell, block) pair is written by one thread only
+         for (int k = haloWidth[2]; k < haloWidth[2] + tiles.tileSize[2]; ++k) {
+            for (int j = haloWidth[1]; j < haloWidth[1] + tiles.tileSize[1]; ++j) {
+               for (int i = haloWidth[0]; i < haloWidth[0] + tiles.tileSize[0]; ++i) {
+                  const size_t b = i + j * bufferStride[1] + k * bufferStride[2];
+                  if (bufferBlockLID[b] == bufferCells[b]->invalid_local_id()) continue;
+                  const size_t boxIndex =
+                     (tileStart[0] + i - haloWidth[0]) * stride[0] +
+                     (tileStart[1] + j - haloWidth[1]) * stride[1] +
+                     (tileStart[2] + k - haloWidth[2]) * stride[2];
+                  Realf* target = mappedBlocks[fusedCellOfBox[boxIndex]].getData(bufferBlockLID[b]);
+                  for (uint c = 0; c < WID3; ++c) {
+                     target[c] = values[b * WID3 + c];
+                  }
+               }
+            }
+         }
+         kernelcounters::add(kernelcounters::TRANS_MAPPING, MPI_Wtime() - tMapping, nMappedBlocks);
+      }
+   }
+}
+
+/* Replace the blocks of the fused cells with the ones mapped by
+   trans_map_fused_tiles, the old blocks are freed. Must be called after
+   the fused dimensions have been mapped by trans_map_1d, which still reads
+   the original data of the tiles, and before the next dimension. */
+
+void store_fused_trans_tiles(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             FusedTransTiles& tiles,
+                             const uint popID) {
+   if (tiles.mappedBlocks.size() <= popID || tiles.mappedBlocks[popID].size() == 0) return;
+   vector<vmesh::VelocityBlockContainer<vmesh::LocalID> >& mappedBlocks = tiles.mappedBlocks[popID];
+
+#pragma omp parallel for schedule(dynamic,1)
+   for (size_t c = 0; c < tiles.fusedCells.size(); ++c) {
+      mpiGrid[tiles.fusedCells[c]]->get_velocity_blocks(popID).swap(mappedBlocks[c]);
+      mappedBlocks[c].clear();
+   }
+   vector<vmesh::VelocityBlockContainer<vmesh::LocalID> >().swap(mappedBlocks);
+}
+
 /*!
 
   This function communicates the mapping on process boundaries, and then updates the data to their correct values.
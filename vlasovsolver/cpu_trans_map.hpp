@@ -22,6 +22,7 @@
 #ifndef CPU_TRANS_MAP_H
 #define CPU_TRANS_MAP_H
 
+#include <array>
 #include <vector>
 
 #include "vec.h"
@@ -44,13 +45,84 @@ void store_trans_block_data(SpatialCell** target_neighbors,const vmesh::GlobalID
                             Vec* __restrict__ target_values,
                             const unsigned char* const cellid_transpose,const uint popID);
 
+/*! Make sure a scratch buffer holds at least size elements. The old
+ * buffer is freed before the new one is allocated, its contents are
+ * not preserved.
+ *
+ * @param buffer Scratch buffer
+ * @param size Required number of elements
+ */
+template <typename Buffer>
+void growScratchBuffer(Buffer& buffer, const size_t size) {
+   if (buffer.size() < size) {
+      Buffer().swap(buffer);
+      buffer.resize(size);
+   }
+}
+
+/*! Phases of the translation in one dimension. With ALL the mapping
+ * is done in one go and the target blocks are updated in place. In
+ * split-phase translation the cells (or pencils) whose source stencil
+ * is local are mapped as INTERIOR while the ghost cell data is still in
+ * flight, and the rest as BOUNDARY once it has arrived. Both phases
+ * accumulate into the temporary block containers of the target cells,
+ * see reset_trans_target_blocks and store_trans_target_blocks.
+ */
+namespace translationphase {
+   enum {
+      ALL,
+      INTERIOR,
+      BOUNDARY
+   };
+}
+
 bool do_translate_cell(spatial_cell::SpatialCell* SC);
+void get_union_of_blocks(const std::vector<SpatialCell*>& cells,
+                         const uint popID,
+                         std::vector<vmesh::GlobalID>& unionOfBlocks);
 bool trans_map_1d(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                   const std::vector<CellID>& localPropagatedCells,
                   const std::vector<CellID>& remoteTargetCells,
                   const uint dimension,
                   const Realv dt,
-                  const uint popID);
+                  const uint popID,
+                  const uint phase = translationphase::ALL);
+void reset_trans_target_blocks(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const std::vector<CellID>& localPropagatedCells,
+                               const std::vector<CellID>& remoteTargetCells,
+                               const uint popID);
+void store_trans_target_blocks(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const std::vector<CellID>& localPropagatedCells,
+                               const std::vector<CellID>& remoteTargetCells,
+                               const uint popID);
+/*! Tiles of local cells translated in several dimensions at once on
+ * uniform grids, see prepare_fused_trans_tiles. Cells are addressed by
+ * their position in the bounding box of the local propagated cells.
+ */
+struct FusedTransTiles {
+   std::vector<uint> dimensions;                           /*!< Fused dimensions in mapping order*/
+   int boxStart[3];                                        /*!< Cell indices of the first cell of the box*/
+   int boxSize[3];                                         /*!< Size of the box in cells*/
+   int tileSize[3];                                        /*!< Size of the tiles in cells*/
+   std::vector<spatial_cell::SpatialCell*> boxCells;       /*!< Valid source cells in the box, NULL elsewhere*/
+   std::vector<std::array<int,3> > tileStart;              /*!< Position of the first cell of each tile in the box*/
+   std::vector<CellID> fusedCells;                         /*!< Cells of the tiles*/
+   std::vector<CellID> propagatedCells[3];                 /*!< Cells still mapped by trans_map_1d in each dimension*/
+   std::vector<std::vector<vmesh::VelocityBlockContainer<vmesh::LocalID> > > mappedBlocks; /*!< Mapped blocks of the fused cells of each population, swapped into the cells by store_fused_trans_tiles*/
+};
+
+void prepare_fused_trans_tiles(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const std::vector<CellID>& localPropagatedCells,
+                               const std::vector<uint>& dimensions,
+                               const uint tileSize,
+                               FusedTransTiles& tiles);
+void trans_map_fused_tiles(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                           FusedTransTiles& tiles,
+                           const Realv dt,
+                           const uint popID);
+void store_fused_trans_tiles(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             FusedTransTiles& tiles,
+                             const uint popID);
 void update_remote_mapping_contribution(dccrg::Dccrg<spatial_cell::SpatialCell,
                                         dccrg::Cartesian_Geometry>& mpiGrid,
                                         const uint dimension,
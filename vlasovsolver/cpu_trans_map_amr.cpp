@@ -6,6 +6,7 @@
 #include "../memoryallocation.h"
 #include "cpu_trans_map_amr.hpp"
 #include "cpu_trans_map.hpp"
+#include "cpu_kernel_counters.hpp"
 
 // use DCCRG version Nov 8th 2018 01482cfba8
 
@@ -28,6 +29,21 @@ using namespace spatial_cell;
 #define i_trans_ps_blockv_pencil(planeVectorIndex, planeIndex, blockIndex, lengthOfPencil) ( (blockIndex) + VLASOV_STENCIL_WIDTH  +  ( (planeVectorIndex) + (planeIndex) * VEC_PER_PLANE ) * ( lengthOfPencil + 2 * VLASOV_STENCIL_WIDTH) )
 
 
+/* Scratch buffers of one thread in trans_map_1d_amr. The buffers are kept between calls and
+ * only grow, so they are allocated, and first touched, by the thread that uses them.
+ */
+struct TransScratchBuffers {
+   std::vector<Realf, aligned_allocator<Realf, WID3>> targetBlockData;
+   std::vector<Vec, aligned_allocator<Vec,WID3>> targetValues;
+   std::vector<Vec, aligned_allocator<Vec,WID3>> sourceVecData;
+   std::vector<uint8_t> sourcePlaneMasks;
+};
+
+static_assert(WID <= 8, "Plane occupancy masks of the translation hold one bit per plane in a uint8_t");
+
+// One set of scratch buffers per OpenMP thread, indexed by omp_get_thread_num()
+static std::vector<TransScratchBuffers> transScratchBuffers;
+
 /* Get the one-dimensional neighborhood index for a given direction and neighborhood size.
  * 
  * @param dimension spatial dimension of neighborhood
@@ -179,6 +195,52 @@ void flagSpatialCellsForAmrCommunication(const dccrg::Dccrg<SpatialCell,dccrg::C
    return;
 }
 
+/* Find the smallest neighbor distance in the given direction that is larger than previous.
+ *
+ * @param [in] nbrPairs Neighbor list of a cell from dccrg
+ * @param [in] dimension spatial dimension
+ * @param [in] sign direction, -1 or +1
+ * @param [in] previous previous distance, 0 to get the first one
+ * @return the distance in refined cells, 0 if there are no more neighbors
+ */
+template <typename NbrPairs>
+int nextNeighborDistance(const NbrPairs& nbrPairs, const uint dimension, const int sign, const int previous) {
+   int next = 0;
+   for (const auto& nbrPair : nbrPairs) {
+      const int distance = sign * nbrPair.second[dimension];
+      if (distance > previous && (next == 0 || distance < next)) {
+         next = distance;
+      }
+   }
+   return next;
+}
+
+/* Select the neighbor a pencil passes through among the neighbors accepted by match.
+ * Consecutive duplicates in the neighbor list are counted once. If there is only one
+ * neighbor it is selected, otherwise the one given by the path step of the pencil.
+ *
+ * @param [in] nbrPairs Neighbor list of a cell from dccrg
+ * @param [in] match Predicate selecting the neighbors to consider
+ * @param [in] step Path step of the pencil at the refinement level of the cell
+ * @param [out] nNeighbors Number of neighbors accepted by match
+ * @return the selected neighbor, INVALID_CELLID if there are too few neighbors for the path
+ */
+template <typename NbrPairs, typename Match>
+CellID selectNeighborOnPath(const NbrPairs& nbrPairs, Match match, const uint step, uint& nNeighbors) {
+   nNeighbors = 0;
+   CellID first = INVALID_CELLID;
+   CellID selected = INVALID_CELLID;
+   CellID last = INVALID_CELLID;
+   for (const auto& nbrPair : nbrPairs) {
+      if (!match(nbrPair) || nbrPair.first == last) continue;
+      if (nNeighbors == 0) first = nbrPair.first;
+      if (nNeighbors == step) selected = nbrPair.first;
+      last = nbrPair.first;
+      ++nNeighbors;
+   }
+   return (nNeighbors == 1) ? first : selected;
+}
+
 /* Get pointers to spatial cells that are considered source cells for a pencil.
  * Source cells are cells that the pencil reads data from to compute polynomial
  * fits that are used for propagation in the vlasov solver. All cells included
@@ -193,14 +255,14 @@ void flagSpatialCellsForAmrCommunication(const dccrg::Dccrg<SpatialCell,dccrg::C
  * @param [out] sourceCells pointer to an array of pointers to SpatialCell objects for the source cells
  */
 void computeSpatialSourceCellsForPencil(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                                        setOfPencils& pencils,
+                                        const setOfPencils& pencils,
                                         const uint iPencil,
                                         const uint dimension,
                                         SpatialCell **sourceCells){
 
    // L = length of the pencil iPencil
    int L = pencils.lengthOfPencils[iPencil];
-   vector<CellID> ids = pencils.getIds(iPencil);
+   const PencilIds ids = pencils.getIds(iPencil);
 
    // These neighborhoods now include the AMR addition beyond the regular vlasov stencil
    int neighborhood = getNeighborhood(dimension,VLASOV_STENCIL_WIDTH);
@@ -214,111 +276,46 @@ void computeSpatialSourceCellsForPencil(const dccrg::Dccrg<SpatialCell,dccrg::Ca
    const auto* frontNbrPairs = mpiGrid.get_neighbors_of(ids.front(), neighborhood);
    const auto* backNbrPairs  = mpiGrid.get_neighbors_of(ids.back(),  neighborhood);
 
-   // Create list of unique distances in the negative direction from the first cell in pencil
-   std::set< int > distances;
-   for (const auto nbrPair : *frontNbrPairs) {
-      if(nbrPair.second[dimension] < 0) {
-         // gather positive distance values
-         distances.insert(-nbrPair.second[dimension]);
-      }
-   }
-
    int iSrc = VLASOV_STENCIL_WIDTH - 1;
-
-   // Iterate through distances for VLASOV_STENCIL_WIDTH elements starting from the smallest distance.
-   for (auto it = distances.begin(); it != distances.end(); ++it) {
+   uint nNeighbors;
+
+   // Iterate through the distances in the negative direction from the first cell in pencil
+   // for VLASOV_STENCIL_WIDTH elements starting from the smallest distance.
+   int refLvl = mpiGrid.get_refinement_level(ids.front());
+   for (int distance = nextNeighborDistance(*frontNbrPairs, dimension, -1, 0);
+        distance > 0;
+        distance = nextNeighborDistance(*frontNbrPairs, dimension, -1, distance)) {
       if (iSrc < 0) break; // found enough elements
 
-      // Collect all neighbors at distance *it to a vector
-      std::vector< CellID > neighbors;
-      for (const auto nbrPair : *frontNbrPairs) {
-         int distanceInRefinedCells = -nbrPair.second[dimension];
-         if(distanceInRefinedCells == *it) neighbors.push_back(nbrPair.first);
-      }
-      // Get rid of duplicate neighbor cells at single distance
-      neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
-
-      int refLvl = mpiGrid.get_refinement_level(ids.front());
-      if (neighbors.size() == 1) {
-         if (sourceCells[iSrc+1] == mpiGrid[neighbors.at(0)]) continue; // already found this cell for different distance         
-         sourceCells[iSrc--] = mpiGrid[neighbors.at(0)];
-      } else if ( pencils.path[iPencil][refLvl] < neighbors.size() ) {
-         if (sourceCells[iSrc+1] == mpiGrid[neighbors.at(pencils.path[iPencil][refLvl])]) continue; // already found this cell for different distance (should not happen)
-         sourceCells[iSrc--] = mpiGrid[neighbors.at(pencils.path[iPencil][refLvl])];
-         // Code for alternate approach to verify that multiple neighbors are in correct ordering (z-y-x)
-         // int ix=0,iy=0;
-         // switch(dimension) {
-         //    case 0:
-         //       ix = 1;
-         //       iy = 2;
-         //       break;
-         //    case 1:
-         //       ix = 0;
-         //       iy = 2;
-         //       break;
-         //    case 2:
-         //       ix = 0;
-         //       iy = 1;
-         //       break;
-         // }
-         // bool accept = false;
-         // std::array<double, 3> parentCoords = mpiGrid.get_center(ids.front());
-         // for (CellID n : neighbors) {
-         //    std::array<double, 3> myCoords = mpiGrid.get_center(n);
-         //    switch (pencils.path[iPencil][refLvl]) {
-         //       case 0:
-         //          if (myCoords[ix] < parentCoords[ix] && myCoords[iy] < parentCoords[iy]) accept=true;
-         //          break;
-         //       case 1:
-         //          if (myCoords[ix] > parentCoords[ix] && myCoords[iy] < parentCoords[iy]) accept=true;
-         //             break;
-         //       case 2:
-         //          if (myCoords[ix] < parentCoords[ix] && myCoords[iy] > parentCoords[iy]) accept=true;
-         //          break;
-         //       case 3:
-         //          if (myCoords[ix] > parentCoords[ix] && myCoords[iy] > parentCoords[iy]) accept=true;
-         //          break;
-         //    }
-         //    if (accept) {
-         //       sourceCells[iSrc--] = mpiGrid[n];
-         //       break;
-         //    }
-         // }
+      // Select the neighbor at this distance on the path of the pencil
+      const CellID nbr = selectNeighborOnPath(*frontNbrPairs,
+                                              [dimension,distance](const auto& nbrPair){return -nbrPair.second[dimension] == distance;},
+                                              pencils.getPathStep(iPencil, refLvl), nNeighbors);
+      if (nbr != INVALID_CELLID) {
+         if (sourceCells[iSrc+1] == mpiGrid[nbr]) continue; // already found this cell for different distance
+         sourceCells[iSrc--] = mpiGrid[nbr];
       } else {
          std::cerr<<"error too few neighbors for path! "<<std::endl; 
       }
    }
 
    iSrc = L + VLASOV_STENCIL_WIDTH;
-   distances.clear();
-   // Create list of unique distances in the positive direction from the last cell in pencil
-   for (const auto nbrPair : *backNbrPairs) {
-      if(nbrPair.second[dimension] > 0) {
-         distances.insert(nbrPair.second[dimension]);
-      }
-   }
 
-   // Iterate through distances for VLASOV_STENCIL_WIDTH elements starting from the smallest distance.
-   // Distances are positive here so smallest distance has smallest value.
-   for (auto it = distances.begin(); it != distances.end(); ++it) {
+   // Iterate through the distances in the positive direction from the last cell in pencil
+   // for VLASOV_STENCIL_WIDTH elements starting from the smallest distance.
+   refLvl = mpiGrid.get_refinement_level(ids.back());
+   for (int distance = nextNeighborDistance(*backNbrPairs, dimension, 1, 0);
+        distance > 0;
+        distance = nextNeighborDistance(*backNbrPairs, dimension, 1, distance)) {
       if (iSrc >= L+2*VLASOV_STENCIL_WIDTH) break; // Found enough cells
 
-      // Collect all neighbors at distance *it to a vector
-      std::vector< CellID > neighbors;
-      for (const auto nbrPair : *backNbrPairs) {
-         int distanceInRefinedCells = nbrPair.second[dimension];
-         if(distanceInRefinedCells == *it) neighbors.push_back(nbrPair.first);
-      }
-      // Get rid of duplicate neighbor cells at single distance
-      neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
-
-      int refLvl = mpiGrid.get_refinement_level(ids.back());
-      if (neighbors.size() == 1) {
-         if (sourceCells[iSrc-1] == mpiGrid[neighbors.at(0)]) continue; // already found this cell for different distance
-         sourceCells[iSrc++] = mpiGrid[neighbors.at(0)];
-      } else if ( pencils.path[iPencil][refLvl] < neighbors.size() ) {
-         if (sourceCells[iSrc-1] == mpiGrid[neighbors.at(pencils.path[iPencil][refLvl])]) continue; // already found this cell for different distance (should not happen)
-         sourceCells[iSrc++] = mpiGrid[neighbors.at(pencils.path[iPencil][refLvl])];
+      // Select the neighbor at this distance on the path of the pencil
+      const CellID nbr = selectNeighborOnPath(*backNbrPairs,
+                                              [dimension,distance](const auto& nbrPair){return nbrPair.second[dimension] == distance;},
+                                              pencils.getPathStep(iPencil, refLvl), nNeighbors);
+      if (nbr != INVALID_CELLID) {
+         if (sourceCells[iSrc-1] == mpiGrid[nbr]) continue; // already found this cell for different distance
+         sourceCells[iSrc++] = mpiGrid[nbr];
       } else {
          std::cerr<<"error too few neighbors for path!"<<std::endl;
       }
@@ -356,15 +353,19 @@ void computeSpatialSourceCellsForPencil(const dccrg::Dccrg<SpatialCell,dccrg::Ca
  *
  */
 void computeSpatialTargetCellsForPencilsWithFaces(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                                         setOfPencils& pencils,
+                                         const setOfPencils& pencils,
                                          const uint dimension,
                                          SpatialCell **targetCells){
 
-   uint GID = 0;
-   // Loop over pencils
+   const int frontDirection = -((int)dimension + 1);
+   const int backDirection = (int)dimension + 1;
+
+   // Loop over pencils, the targets of pencil iPencil start at GID = idsStart + 2 ghost cells per preceding pencil
+#pragma omp parallel for schedule(guided)
    for(uint iPencil = 0; iPencil < pencils.N; iPencil++){
       int L = pencils.lengthOfPencils[iPencil];
-      vector<CellID> ids = pencils.getIds(iPencil);
+      const PencilIds ids = pencils.getIds(iPencil);
+      const uint GID = pencils.idsStart[iPencil] + 2 * iPencil;
 
       // Get pointers for each cell id of the pencil
       for (int i = 0; i < L; ++i) {
@@ -372,63 +373,51 @@ void computeSpatialTargetCellsForPencilsWithFaces(const dccrg::Dccrg<SpatialCell
       }
 
       int refLvl;
-      vector <CellID> frontNeighborIds;
-      vector <CellID> backNeighborIds;
+      uint nNeighbors;
+      CellID nbr;
       const auto frontNeighbors = mpiGrid.get_face_neighbors_of(ids.front());
       if (frontNeighbors.size() > 0) {
-         for (const auto nbr: frontNeighbors) {
-            if(nbr.second == (-((int)dimension + 1))) {
-               frontNeighborIds.push_back(nbr.first);
-            }
-         }
          refLvl = mpiGrid.get_refinement_level(ids.front());
+         nbr = selectNeighborOnPath(frontNeighbors,
+                                    [frontDirection](const auto& nbrPair){return nbrPair.second == frontDirection;},
+                                    pencils.getPathStep(iPencil, refLvl), nNeighbors);
          
-         if (frontNeighborIds.size() == 0) {
+         if (nNeighbors == 0) {
             std::cerr<<"abort frontNeighborIds.size() == 0 at "<<ids.front()<<std::endl;
             for( const auto nbrPair: frontNeighbors ) {
                std::cerr<<ids.front()<<" dim "<<dimension<<" "<<nbrPair.first<<" "<<nbrPair.second<<std::endl;
             }
          }
-         if (frontNeighborIds.size() == 1) {
-            targetCells[GID] = mpiGrid[frontNeighborIds[0]];
-         } else if ( pencils.path[iPencil][refLvl] < frontNeighborIds.size() ) {
-            targetCells[GID] = mpiGrid[frontNeighborIds[pencils.path[iPencil][refLvl]]];
+         if (nbr != INVALID_CELLID) {
+            targetCells[GID] = mpiGrid[nbr];
          }
       } else {
          std::cerr<<"error, found cell without any face neighbors"<<std::endl;
       }
-      frontNeighborIds.clear();
 
       const auto backNeighbors = mpiGrid.get_face_neighbors_of(ids.back());
       if (backNeighbors.size() > 0) {
-         for (const auto nbr: backNeighbors) {
-            if(nbr.second == ((int)dimension + 1)) {
-               backNeighborIds.push_back(nbr.first);
-            }
-         }
          refLvl = mpiGrid.get_refinement_level(ids.back());
-         if (backNeighborIds.size() == 0) {
+         nbr = selectNeighborOnPath(backNeighbors,
+                                    [backDirection](const auto& nbrPair){return nbrPair.second == backDirection;},
+                                    pencils.getPathStep(iPencil, refLvl), nNeighbors);
+         if (nNeighbors == 0) {
             std::cerr<<"abort backNeighborIds.size() == 0 at "<<ids.back()<<std::endl;
             for( const auto nbrPair: backNeighbors ) {
                std::cerr<<ids.back()<<" dim "<<dimension<<" "<<nbrPair.first<<" "<<nbrPair.second<<std::endl;
             }
          }
-         if (backNeighborIds.size() == 1) {
-            targetCells[GID + L + 1] = mpiGrid[backNeighborIds[0]];
-         } else if ( pencils.path[iPencil][refLvl] < backNeighborIds.size() ) {
-            targetCells[GID + L + 1] = mpiGrid[backNeighborIds[pencils.path[iPencil][refLvl]]];
+         if (nbr != INVALID_CELLID) {
+            targetCells[GID + L + 1] = mpiGrid[nbr];
          }
       } else {
          std::cerr<<"error, found cell without any face neighbors"<<std::endl;
       }
-      backNeighborIds.clear();
-
-      // Incerment global id by L + 2 ghost cells.
-      GID += (L + 2);
    }
 
    // Remove any boundary cells from the list of valid targets
-   for (uint i = 0; i < GID; ++i) {
+   const uint nTargets = pencils.sumOfLengths + 2 * pencils.N;
+   for (uint i = 0; i < nTargets; ++i) {
       if (targetCells[i] && targetCells[i]->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY ) {
          targetCells[i] = NULL;
       }
@@ -697,6 +686,19 @@ setOfPencils buildPencilsWithNeighbors( const dccrg::Dccrg<SpatialCell,dccrg::Ca
   
 }
 
+/* Check whether a velocity block holds any non-zero values. The data is read in storage order,
+ * which is much cheaper than the transposed load, so empty blocks are detected before transposing.
+ *
+ * @param data Data of the velocity block
+ */
+inline bool block_has_data(const Realf* data) {
+   Vecb nonZero = (Vec().load(data) != Vec(0));
+   for (uint i = VECL; i < WID3; i += VECL) {
+      nonZero = nonZero || (Vec().load(data + i) != Vec(0));
+   }
+   return horizontal_or(nonZero);
+}
+
 bool check_skip_remapping(Vec* values) {
    for (int index=0; index<2*VLASOV_STENCIL_WIDTH+1; ++index) {
       if (horizontal_or(values[index] > Vec(0))) return false;
@@ -712,6 +714,7 @@ bool check_skip_remapping(Vec* values) {
  * @param dt Time step
  * @param vmesh Velocity mesh object
  * @param lengthOfPencil Number of cells in the pencil
+ * @param planeMasks Plane occupancy masks of the source blocks, padded like values
  */
 void propagatePencil(
    Vec* dz,
@@ -722,7 +725,8 @@ void propagatePencil(
    const Realv dt,
    const vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID> &vmesh,
    const uint lengthOfPencil,
-   const Realv threshold
+   const Realv threshold,
+   const uint8_t* planeMasks
 ) {
    // Get velocity data from vmesh that we need later to calculate the translation
    velocity_block_indices_t block_indices;
@@ -749,9 +753,19 @@ void propagatePencil(
       
       // The source array is padded by VLASOV_STENCIL_WIDTH on both sides.
       uint i_source   = i + VLASOV_STENCIL_WIDTH;
+
+      // Planes with no positive values in the whole stencil would all be skipped by
+      // check_skip_remapping, skip them without touching the data.
+      uint8_t stencilMask = 0;
+      for (uint s = i; s <= i + 2 * VLASOV_STENCIL_WIDTH; ++s) {
+         stencilMask |= planeMasks[s];
+      }
+      if (stencilMask == 0) continue;
       
       for (uint k = 0; k < WID; ++k) {
 
+         if ((stencilMask & (1 << k)) == 0) continue;
+
          const Realv cell_vz = (block_indices[dimension] * WID + k + 0.5) * dvz + vz_min; //cell centered velocity
          const Vec z_translation = cell_vz * dt / dz[i_source]; // how much it moved in time dt (reduced units)
 
@@ -834,14 +848,15 @@ void getSeedIds(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGr
    // These neighborhoods now include the AMR addition beyond the regular vlasov stencil
    int neighborhood = getNeighborhood(dimension,VLASOV_STENCIL_WIDTH);
 
+   // Flag the seeds per cell, collected in order after the threaded loop
+   std::vector<uint8_t> isSeed(localPropagatedCells.size(), false);
 #pragma omp parallel for
    for (uint i=0; i<localPropagatedCells.size(); i++) {
       CellID celli = localPropagatedCells[i];
 
       bool addToSeedIds = P::amrTransShortPencils;
       if (addToSeedIds) {
-#pragma omp critical
-         seedIds.push_back(celli);
+         isSeed[i] = true;
          continue;
       }
       auto myIndices = mpiGrid.mapping.get_indices(celli);
@@ -878,8 +893,7 @@ void getSeedIds(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGr
          }
       } // finish check A
       if ( addToSeedIds ) {
-#pragma omp critical
-         seedIds.push_back(celli);
+         isSeed[i] = true;
          continue;
       }
       myRefLevel = mpiGrid.get_refinement_level(celli);
@@ -924,8 +938,7 @@ void getSeedIds(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGr
       } // Finish B check
 
       if ( addToSeedIds ) {
-#pragma omp critical
-         seedIds.push_back(celli);
+         isSeed[i] = true;
          continue;
       }
       /* Proceed with C, checking if the next two negative neighbours have the same refinement level as ccell, but the
@@ -953,10 +966,12 @@ void getSeedIds(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGr
       } // Finish C check
 
       if ( addToSeedIds ) {
-#pragma omp critical
-         seedIds.push_back(celli);
+         isSeed[i] = true;
       }
    }
+   for (uint i=0; i<localPropagatedCells.size(); i++) {
+      if (isSeed[i]) seedIds.push_back(localPropagatedCells[i]);
+   }
 
    if(debug) {
       cout << "Rank " << myRank << ", Seed ids are: ";
@@ -984,14 +999,18 @@ void getSeedIds(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGr
  * @param blockGID Global ID of the velocity block.
  * @param int lengthOfPencil Number of spatial cells in pencil
  * @param values Vector where loaded data is stored.
+ * @param planeMasks Plane occupancy masks of the loaded blocks, bit k is set if plane k
+ * of the transposed block holds positive values. Padded like values.
  * @param cellid_transpose
  * @param popID ID of the particle species.
+ * @return False if none of the cells have the block.
  */
 bool copy_trans_block_data_amr(
     SpatialCell** source_neighbors,
     const vmesh::GlobalID blockGID,
     int lengthOfPencil,
     Vec* values,
+    uint8_t* planeMasks,
     const unsigned char* const cellid_transpose,
     const uint popID) { 
 
@@ -1033,7 +1052,10 @@ bool copy_trans_block_data_amr(
    
    //  Copy volume averages of this block from all spatial cells:
    for (int b = -VLASOV_STENCIL_WIDTH; b < lengthOfPencil + VLASOV_STENCIL_WIDTH; b++) {
-      if(blockDataPointer[b + VLASOV_STENCIL_WIDTH] != NULL) {
+      uint8_t planeMask = 0;
+      // Blocks with only zeros are loaded like missing blocks, without the transpose
+      if(blockDataPointer[b + VLASOV_STENCIL_WIDTH] != NULL &&
+         block_has_data(blockDataPointer[b + VLASOV_STENCIL_WIDTH])) {
          Realf blockValues[WID3];
          const Realf* block_data = blockDataPointer[b + VLASOV_STENCIL_WIDTH];
          // Copy data to a temporary array and transpose values so that mapping is along k direction.
@@ -1049,12 +1071,16 @@ bool copy_trans_block_data_amr(
          // now load values into the actual values table..
          uint offset =0;
          for (uint k=0; k<WID; k++) {
+            Vecb planeHasData = Vecb(false);
             for(uint planeVector = 0; planeVector < VEC_PER_PLANE; planeVector++){
                // store data, when reading data from data we swap dimensions 
                // using precomputed plane_index_to_id and cell_indices_to_id
-               values[i_trans_ps_blockv_pencil(planeVector, k, b, lengthOfPencil)].load(blockValues + offset);
+               Vec& value = values[i_trans_ps_blockv_pencil(planeVector, k, b, lengthOfPencil)];
+               value.load(blockValues + offset);
+               planeHasData = planeHasData || (value > Vec(0));
                offset += VECL;
             }
+            if (horizontal_or(planeHasData)) planeMask |= (1 << k);
          }
       } else {
          for (uint k=0; k<WID; ++k) {
@@ -1063,6 +1089,7 @@ bool copy_trans_block_data_amr(
             }
          }
       }
+      planeMasks[b + VLASOV_STENCIL_WIDTH] = planeMask;
    }
    return true;
 }
@@ -1099,7 +1126,7 @@ void check_ghost_cells(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>
       // It is possible that the pencil has already been refined by the pencil building algorithm
       // and is on a higher refinement level than the refinement level of any of the cells it contains
       // due to e.g. process boundaries.
-      int maxPencilRefLvl = pencils.path[pencili].size();
+      int maxPencilRefLvl = pencils.getPathLength(pencili);
       int maxNbrRefLvl = 0;
 
       const auto* frontNeighbors = mpiGrid.get_neighbors_of(ids.front(),neighborhoodId);
@@ -1179,6 +1206,9 @@ void check_ghost_cells(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>
       }
    }
 
+   // The splits look up the pencils sharing cells with the split pencil from the index
+   if (idsToSplit.size() > 0) pencils.buildCellIndex();
+
 // No threading here, probably more efficient to thread inside the splitting
    for (auto pencili: idsToSplit) {
 
@@ -1201,7 +1231,6 @@ void check_ghost_cells(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>
          break;
       }
 
-// WARNING threading inside this function
       pencils.split(pencili,dx,dy);
          
    }
@@ -1238,7 +1267,7 @@ bool checkPencils(
    }
 
    for (uint ipencil = 0; ipencil < pencils.N; ++ipencil) {
-      cint nPencilsThroughThisCell = pow(pow(2,pencils.path[ipencil].size()),2);
+      cint nPencilsThroughThisCell = pow(pow(2,pencils.getPathLength(ipencil)),2);
       auto ids = pencils.getIds(ipencil);
       
       for (auto id : ids) {
@@ -1292,7 +1321,7 @@ void printPencilsFunc(const setOfPencils& pencils, const uint dimension, const i
       ibeg  = iend;
       
       std::cout << "{";         
-      for (auto step : pencils.path[i]) {
+      for (auto step : pencils.getPath(i)) {
          std::cout << step << ", ";
       }
       std::cout << "}";
@@ -1303,6 +1332,59 @@ void printPencilsFunc(const setOfPencils& pencils, const uint dimension, const i
    MPI_Barrier(MPI_COMM_WORLD);
 }
 
+/* Build the pencils starting from the given seeds, and add them to a set of pencils.
+ * Includes threading and gathering of pencils into thread-containers.
+ *
+ * @param [in] mpiGrid DCCRG grid object
+ * @param [in] dimension Spatial dimension
+ * @param [in] seedIds All seed cells, pencils terminate when they meet one of them
+ * @param [in] buildSeedIds Seed cells from which pencils are built
+ * @param [out] pencils Pencil data struct where the new pencils are added
+ */
+void buildPencilsFromSeeds(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                           const uint dimension,
+                           const vector<CellID>& seedIds,
+                           const vector<CellID>& buildSeedIds,
+                           setOfPencils& pencils) {
+
+#pragma omp parallel
+   {
+      // Empty vectors for internal use of buildPencilsWithNeighbors. Could be default values but
+      // default vectors are complicated. Should overload buildPencilsWithNeighbors like suggested here
+      // https://stackoverflow.com/questions/3147274/c-default-argument-for-vectorint
+      vector<CellID> ids;
+      vector<uint> path;
+      // thread-internal pencil set to be accumulated at the end
+      setOfPencils thread_pencils;
+
+#pragma omp for schedule(guided)
+      for (uint i=0; i<buildSeedIds.size(); i++) {
+         cuint seedId = buildSeedIds[i];
+         // Construct pencils from the seedIds into a set of pencils.
+         thread_pencils = buildPencilsWithNeighbors(mpiGrid, thread_pencils, seedId, ids, dimension, path, seedIds);
+      }
+
+      // accumulate thread results in global set of pencils
+#pragma omp critical(amrPencilMerge)
+      pencils.appendPencils(thread_pencils);
+   }
+}
+
+/* Get the list of local cells that are propagated. Result independent of particle species.
+ *
+ * @param [in] mpiGrid DCCRG grid object
+ * @param [out] localPropagatedCells Local cells that are translated
+ */
+void getLocalPropagatedCells(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             vector<CellID>& localPropagatedCells) {
+   const vector<CellID>& localCells = getLocalCells();
+   for (size_t c=0; c<localCells.size(); ++c) {
+      if (do_translate_cell(mpiGrid[localCells[c]])) {
+         localPropagatedCells.push_back(localCells[c]);
+      }
+   }
+}
+
 /* Wrapper function for calling seed ID selection and pencil generation, per dimension.
  * Includes threading and gathering of pencils into thread-containers.
  *
@@ -1316,15 +1398,8 @@ void prepareSeedIdsAndPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
    int myRank;
    if(printPencils) MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
 
-   const vector<CellID>& localCells = getLocalCells();
    vector<CellID> localPropagatedCells;
-   // Figure out which spatial cells are translated,
-   // result independent of particle species.
-   for (size_t c=0; c<localCells.size(); ++c) {
-      if (do_translate_cell(mpiGrid[localCells[c]])) {
-         localPropagatedCells.push_back(localCells[c]);
-      }
-   }
+   getLocalPropagatedCells(mpiGrid, localPropagatedCells);
 
    phiprof::start("getSeedIds");
    vector<CellID> seedIds;
@@ -1332,59 +1407,166 @@ void prepareSeedIdsAndPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
    phiprof::stop("getSeedIds");
 
    phiprof::start("buildPencils");
-   // Output vectors for ready pencils
-   //setOfPencils pencils;
 
    // Clear previous set
    DimensionPencils[dimension].removeAllPencils();
-   
-#pragma omp parallel
-   {
-      // Empty vectors for internal use of buildPencilsWithNeighbors. Could be default values but
-      // default vectors are complicated. Should overload buildPencilsWithNeighbors like suggested here
-      // https://stackoverflow.com/questions/3147274/c-default-argument-for-vectorint
-      vector<CellID> ids;
-      vector<uint> path;
-      // thread-internal pencil set to be accumulated at the end
-      setOfPencils thread_pencils;
-      // iterators used in the accumulation
-      std::vector<CellID>::iterator ibeg, iend;
 
-#pragma omp for schedule(guided)
-      for (uint i=0; i<seedIds.size(); i++) {
-         cuint seedId = seedIds[i];
-         // Construct pencils from the seedIds into a set of pencils.
-         thread_pencils = buildPencilsWithNeighbors(mpiGrid, thread_pencils, seedId, ids, dimension, path, seedIds);
-      }
+   buildPencilsFromSeeds(mpiGrid, dimension, seedIds, seedIds, DimensionPencils[dimension]);
 
-      // accumulate thread results in global set of pencils
-#pragma omp critical
-      {
-         for (uint i=0; i<thread_pencils.N; i++) {
-            // Use vector range constructor
-            ibeg = thread_pencils.ids.begin() + thread_pencils.idsStart[i];
-            iend = ibeg + thread_pencils.lengthOfPencils[i];
-            std::vector<CellID> pencilIds(ibeg, iend);
-            DimensionPencils[dimension].addPencil(pencilIds,thread_pencils.x[i],thread_pencils.y[i],thread_pencils.periodic[i],thread_pencils.path[i]);
+   phiprof::start("check_ghost_cells");
+   // Check refinement of two ghost cells on each end of each pencil
+   check_ghost_cells(mpiGrid,DimensionPencils[dimension],dimension);
+   phiprof::stop("check_ghost_cells");
+   DimensionPencils[dimension].buildCellIndex();
+
+   // ****************************************************************************
+
+   if(printPencils) printPencilsFunc(DimensionPencils[dimension],dimension,myRank);
+   phiprof::stop("buildPencils");
+}
+
+/* Update the pencils after load balancing, per dimension. Pencils are grouped by the seed
+ * cell they start from. A group is kept as it is if none of its cells, or their neighbors
+ * in the stencil, migrated or changed their seed status. Other groups are dropped and
+ * rebuilt from their seeds. If no pencils exist yet, all pencils are built.
+ *
+ * @param [in] mpiGrid DCCRG grid object
+ * @param [in] dimension Spatial dimension
+ * @param [in] migratedCells Cells that were moved to or from this process in load balancing
+ */
+void prepareSeedIdsAndPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                              const uint dimension,
+                              const std::unordered_set<CellID>& migratedCells) {
+
+   const bool printPencils = false;
+   int myRank;
+   if(printPencils) MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+
+   vector<CellID> localPropagatedCells;
+   getLocalPropagatedCells(mpiGrid, localPropagatedCells);
+
+   phiprof::start("getSeedIds");
+   vector<CellID> seedIds;
+   getSeedIds(mpiGrid, localPropagatedCells, dimension, seedIds);
+   phiprof::stop("getSeedIds");
+
+   phiprof::start("buildPencils");
+
+   setOfPencils& oldPencils = DimensionPencils[dimension];
+
+   // Cells whose seed status has changed
+   std::unordered_set<CellID> newSeeds(seedIds.begin(), seedIds.end());
+   std::unordered_set<CellID> oldSeeds;
+   for (uint pencili = 0; pencili < oldPencils.N; ++pencili) {
+      oldSeeds.insert(oldPencils.ids[oldPencils.idsStart[pencili]]);
+   }
+   std::unordered_set<CellID> changedCells(migratedCells);
+   for (const auto id : newSeeds) {
+      if (oldSeeds.count(id) == 0) changedCells.insert(id);
+   }
+   for (const auto id : oldSeeds) {
+      if (newSeeds.count(id) == 0) changedCells.insert(id);
+   }
+
+   // Find the seeds whose pencils are affected by the changes
+   const int neighborhood = getNeighborhood(dimension,VLASOV_STENCIL_WIDTH);
+   std::vector<uint8_t> dirtyPencil(oldPencils.N, false);
+#pragma omp parallel for schedule(guided)
+   for (uint pencili = 0; pencili < oldPencils.N; ++pencili) {
+      bool dirty = false;
+      for (uint i = oldPencils.idsStart[pencili]; i < oldPencils.idsStart[pencili] + oldPencils.lengthOfPencils[pencili]; ++i) {
+         const CellID id = oldPencils.ids[i];
+         if (changedCells.count(id) > 0 || !mpiGrid.is_local(id)) {
+            dirty = true;
+            break;
+         }
+         for (const auto nbrPair : *mpiGrid.get_neighbors_of(id, neighborhood)) {
+            if (changedCells.count(nbrPair.first) > 0) {
+               dirty = true;
+               break;
+            }
          }
+         if (dirty) break;
       }
+      dirtyPencil[pencili] = dirty;
+   }
+   std::unordered_set<CellID> dirtySeeds;
+   for (uint pencili = 0; pencili < oldPencils.N; ++pencili) {
+      if (dirtyPencil[pencili]) dirtySeeds.insert(oldPencils.ids[oldPencils.idsStart[pencili]]);
+   }
+
+   // Keep the pencils of unaffected seeds
+   setOfPencils pencils;
+   std::unordered_set<CellID> keptSeeds;
+   for (uint pencili = 0; pencili < oldPencils.N; ++pencili) {
+      const CellID seedId = oldPencils.ids[oldPencils.idsStart[pencili]];
+      if (dirtySeeds.count(seedId) > 0) continue;
+      keptSeeds.insert(seedId);
+      pencils.addPencil(oldPencils,pencili);
+   }
+
+   // Build pencils for the remaining seeds
+   vector<CellID> buildSeedIds;
+   for (const auto seedId : seedIds) {
+      if (keptSeeds.count(seedId) == 0) buildSeedIds.push_back(seedId);
    }
+   setOfPencils newPencils;
+   buildPencilsFromSeeds(mpiGrid, dimension, seedIds, buildSeedIds, newPencils);
 
    phiprof::start("check_ghost_cells");
-   // Check refinement of two ghost cells on each end of each pencil
-   check_ghost_cells(mpiGrid,DimensionPencils[dimension],dimension);
+   // Check refinement of two ghost cells on each end of each new pencil
+   check_ghost_cells(mpiGrid,newPencils,dimension);
    phiprof::stop("check_ghost_cells");
 
+   pencils.appendPencils(newPencils);
+   std::swap(DimensionPencils[dimension], pencils);
+   DimensionPencils[dimension].buildCellIndex();
+
    // ****************************************************************************
 
    if(printPencils) printPencilsFunc(DimensionPencils[dimension],dimension,myRank);
    phiprof::stop("buildPencils");
 }
 
+/* Check whether all source cells of a pencil are local to this process, ie. whether
+ * the pencil can be mapped before the ghost cell data has been received. The check
+ * is conservative, all neighbors of the end cells in the stencil are considered
+ * regardless of the path of the pencil.
+ *
+ * @param [in] mpiGrid DCCRG grid object
+ * @param [in] pencils pencil data struct
+ * @param [in] iPencil index of a pencil in the pencils data struct
+ * @param [in] dimension spatial dimension
+ */
+bool pencilSourceCellsAreLocal(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const setOfPencils& pencils,
+                               const uint iPencil,
+                               const uint dimension) {
+
+   const PencilIds ids = pencils.getIds(iPencil);
+   const uint L = ids.size();
+   for (uint i = 0; i < L; ++i) {
+      if (!mpiGrid.is_local(ids[i])) return false;
+   }
+
+   const int neighborhood = getNeighborhood(dimension,VLASOV_STENCIL_WIDTH);
+   for (const auto nbrPair : *mpiGrid.get_neighbors_of(ids[0], neighborhood)) {
+      if (nbrPair.second[dimension] < 0 && !mpiGrid.is_local(nbrPair.first)) return false;
+   }
+   for (const auto nbrPair : *mpiGrid.get_neighbors_of(ids[L-1], neighborhood)) {
+      if (nbrPair.second[dimension] > 0 && !mpiGrid.is_local(nbrPair.first)) return false;
+   }
+   return true;
+}
+
 /* Map velocity blocks in all local cells forward by one time step in one spatial dimension.
  * This function uses 1-cell wide pencils to update cells in-place to avoid allocating large
  * temporary buffers.
  *
+ * In split-phase translation (phase INTERIOR or BOUNDARY) only the pencils whose source
+ * cells are all local (or not) are mapped, and the results are added to the temporary
+ * block containers of the target cells, see reset_trans_target_blocks.
+ *
  * @param [in] mpiGrid DCCRG grid object
  * @param [in] localPropagatedCells List of local cells that get propagated
  * ie. not boundary or DO_NOT_COMPUTE
@@ -1392,6 +1574,7 @@ void prepareSeedIdsAndPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
  * @param [in] dimension Spatial dimension
  * @param [in] dt Time step
  * @param [in] popId Particle population ID
+ * @param [in] phase One of translationphase::ALL, INTERIOR, BOUNDARY
  */
 bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                       const vector<CellID>& localPropagatedCells,
@@ -1399,7 +1582,8 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
                       std::vector<uint>& nPencils,
                       const uint dimension,
                       const Realv dt,
-                      const uint popID) {
+                      const uint popID,
+                      const uint phase) {
    
    phiprof::start("setup");
 
@@ -1478,9 +1662,11 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
    //    abort();
    // }
    
-   if (Parameters::prepareForRebalance == true) {
+   // Pencils are counted only once also in split-phase translation
+   if (Parameters::prepareForRebalance == true && phase != translationphase::BOUNDARY) {
       for (uint i=0; i<localPropagatedCells.size(); i++) {
-         cuint myPencilCount = std::count(DimensionPencils[dimension].ids.begin(), DimensionPencils[dimension].ids.end(), localPropagatedCells[i]);
+         const uint* myPencilIds;
+         cuint myPencilCount = DimensionPencils[dimension].getPencilsOfCell(localPropagatedCells[i], myPencilIds);
          nPencils[i] += myPencilCount;
          nPencils[nPencils.size()-1] += myPencilCount;
       }
@@ -1491,33 +1677,10 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
    
    phiprof::start("buildBlockList");
    // Get a unique sorted list of blockids that are in any of the
-   // propagated cells. First use set for this, then add to vector (may not
-   // be the most nice way to do this and in any case we could do it along
-   // dimension for data locality reasons => copy acc map column code, TODO: FIXME
+   // propagated cells.
    // TODO: Do this separately for each pencil?
    std::vector<vmesh::GlobalID> unionOfBlocks;
-   std::unordered_set<vmesh::GlobalID> unionOfBlocksSet;
-//   unionOfBlocks.reserve(unionOfBlocksSet.size());
-#pragma omp parallel
-   {
-      std::unordered_set<vmesh::GlobalID> thread_unionOfBlocksSet;
-      
-#pragma omp for
-      for(unsigned int i=0; i<allCellsPointer.size(); i++) {
-         auto cell = &allCellsPointer[i];
-         vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& cvmesh = (*cell)->get_velocity_mesh(popID);
-         for (vmesh::LocalID block_i=0; block_i< cvmesh.size(); ++block_i) {
-            thread_unionOfBlocksSet.insert(cvmesh.getGlobalID(block_i));
-         }
-      }
-
-#pragma omp critical
-      {
-         unionOfBlocksSet.insert(thread_unionOfBlocksSet.begin(), thread_unionOfBlocksSet.end());
-      } // pragma omp critical
-   } // pragma omp parallel
-   
-   unionOfBlocks.insert(unionOfBlocks.end(), unionOfBlocksSet.begin(), unionOfBlocksSet.end());
+   get_union_of_blocks(allCellsPointer, popID, unionOfBlocks);
    
    phiprof::stop("buildBlockList");
    // ****************************************************************************
@@ -1525,57 +1688,68 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
    // Assuming 1 neighbor in the target array because of the CFL condition
    // In fact propagating to > 1 neighbor will give an error
    const uint nTargetNeighborsPerPencil = 1;
+
+   const setOfPencils& pencils = DimensionPencils[dimension];
    
    // Compute spatial neighbors for target cells.
    // For targets we need the local cells, plus a padding of 1 cell at both ends
    phiprof::start("computeSpatialTargetCellsForPencils");
-   std::vector<SpatialCell*> targetCells(DimensionPencils[dimension].sumOfLengths + DimensionPencils[dimension].N * 2 * nTargetNeighborsPerPencil );
-   computeSpatialTargetCellsForPencilsWithFaces(mpiGrid, DimensionPencils[dimension], dimension, targetCells.data());
+   const uint nTargetCells = pencils.sumOfLengths + pencils.N * 2 * nTargetNeighborsPerPencil;
+   std::vector<SpatialCell*> targetCells(nTargetCells);
+   computeSpatialTargetCellsForPencilsWithFaces(mpiGrid, pencils, dimension, targetCells.data());
    phiprof::stop("computeSpatialTargetCellsForPencils");
-   
+
+   // Compute spatial neighbors for the source cells of the pencils. In source cells we have
+   // a wider stencil and take into account boundaries. The source cells of pencil i start
+   // at idsStart[i] + 2 * VLASOV_STENCIL_WIDTH * i, and so does the source data.
+   phiprof::start("computeSpatialSourceCellsForPencils");
+   const uint nSourceCells = pencils.sumOfLengths + pencils.N * 2 * VLASOV_STENCIL_WIDTH;
+   std::vector<SpatialCell*> sourceCells(nSourceCells);
+   // dz is the cell size in the direction of the pencil
+   std::vector<Vec, aligned_allocator<Vec,WID3>> dz(nSourceCells);
+#pragma omp parallel for schedule(guided)
+   for(uint pencili = 0; pencili < pencils.N; ++pencili) {
+      cuint sourceStart = pencils.idsStart[pencili] + 2 * VLASOV_STENCIL_WIDTH * pencili;
+      cuint sourceLength = pencils.lengthOfPencils[pencili] + 2 * VLASOV_STENCIL_WIDTH;
+      computeSpatialSourceCellsForPencil(mpiGrid, pencils, pencili, dimension, sourceCells.data() + sourceStart);
+      for(uint i = sourceStart; i < sourceStart + sourceLength; ++i) {
+         dz[i] = sourceCells[i]->parameters[CellParams::DX+dimension];
+      }
+   }
+   phiprof::stop("computeSpatialSourceCellsForPencils");
+
+   // Select the pencils mapped in this phase
+   std::vector<bool> mapPencil(pencils.N, true);
+   if (phase != translationphase::ALL) {
+      for(uint pencili = 0; pencili < pencils.N; ++pencili) {
+         mapPencil[pencili] = (pencilSourceCellsAreLocal(mpiGrid, pencils, pencili, dimension)
+                               == (phase == translationphase::INTERIOR));
+      }
+   }
    
    phiprof::stop("setup");
    
    int t1 = phiprof::initializeTimer("mapping");
    int t2 = phiprof::initializeTimer("store");
+
+   if (transScratchBuffers.size() < (size_t)omp_get_max_threads()) {
+      transScratchBuffers.resize(omp_get_max_threads());
+   }
    
    #pragma omp parallel
    {
-      // declarations for variables needed by the threads
-      std::vector<Realf, aligned_allocator<Realf, WID3>> targetBlockData((DimensionPencils[dimension].sumOfLengths + 2 * nTargetNeighborsPerPencil * DimensionPencils[dimension].N) * WID3);
-      std::vector<std::vector<SpatialCell*>> pencilSourceCells;
-      
-      // Allocate aligned vectors which are needed once per pencil to avoid reallocating once per block loop + pencil loop iteration
-      std::vector<std::vector<Vec, aligned_allocator<Vec,WID3>>> pencilTargetValues;
-      std::vector<std::vector<Vec, aligned_allocator<Vec,WID3>>> pencilSourceVecData;
-      std::vector<std::vector<Vec, aligned_allocator<Vec,WID3>>> pencildz;
-      
-      for(uint pencili = 0; pencili < DimensionPencils[dimension].N; ++pencili) {
-         
-         cint L = DimensionPencils[dimension].lengthOfPencils[pencili];
-         cuint sourceLength = L + 2 * VLASOV_STENCIL_WIDTH;
-         
-         // Vector buffer where we write data, initialized to 0*/
-         std::vector<Vec, aligned_allocator<Vec,WID3>> targetValues((L + 2 * nTargetNeighborsPerPencil) * WID3 / VECL);
-         pencilTargetValues.push_back(targetValues);
-         // Allocate source data: sourcedata<length of pencil * WID3)
-         // Add padding by 2 * VLASOV_STENCIL_WIDTH
-         std::vector<Vec, aligned_allocator<Vec,WID3>> sourceVecData(sourceLength * WID3 / VECL);
-         pencilSourceVecData.push_back(sourceVecData);
-
-         // Compute spatial neighbors for the source cells of the pencil. In
-         // source cells we have a wider stencil and take into account boundaries.
-         std::vector<SpatialCell*> sourceCells(sourceLength);
-         computeSpatialSourceCellsForPencil(mpiGrid, DimensionPencils[dimension], pencili, dimension, sourceCells.data());
-         pencilSourceCells.push_back(sourceCells);
-
-         // dz is the cell size in the direction of the pencil
-         std::vector<Vec, aligned_allocator<Vec,WID3>> dz(sourceLength);
-         for(uint i = 0; i < sourceCells.size(); ++i) {
-            dz[i] = sourceCells[i]->parameters[CellParams::DX+dimension];
-         }
-         pencildz.push_back(dz);
-      }
+      // declarations for variables needed by the threads. The buffers of all pencils are
+      // reused from the thread's scratch buffers, the source and target data of the pencils
+      // laid out like sourceCells and targetCells.
+      TransScratchBuffers& scratch = transScratchBuffers[omp_get_thread_num()];
+      growScratchBuffer(scratch.targetBlockData, nTargetCells * WID3);
+      growScratchBuffer(scratch.targetValues, nTargetCells * WID3 / VECL);
+      growScratchBuffer(scratch.sourceVecData, nSourceCells * WID3 / VECL);
+      growScratchBuffer(scratch.sourcePlaneMasks, nSourceCells);
+      Realf* targetBlockData = scratch.targetBlockData.data();
+      Vec* targetValues = scratch.targetValues.data();
+      Vec* sourceVecData = scratch.sourceVecData.data();
+      uint8_t* sourcePlaneMasks = scratch.sourcePlaneMasks.data();
       
       // Loop over velocity space blocks. Thread this loop (over vspace blocks) with OpenMP.
       #pragma omp for schedule(guided)
@@ -1585,19 +1759,30 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
          vmesh::GlobalID blockGID = unionOfBlocks[blocki];
 
             phiprof::start(t1);
+            const double tMapping = MPI_Wtime();
+            uint64_t nMappedBlocks = 0;
             
             // Loop over pencils
             uint totalTargetLength = 0;
-            for(uint pencili = 0; pencili < DimensionPencils[dimension].N; ++pencili){
+            for(uint pencili = 0; pencili < pencils.N; ++pencili){
 //             for ( auto pencili : unionOfBlocksMapToPencilIds.at(blockGID) ) {
                
-               int L = DimensionPencils[dimension].lengthOfPencils[pencili];
+               int L = pencils.lengthOfPencils[pencili];
                uint targetLength = L + 2 * nTargetNeighborsPerPencil;
-               uint sourceLength = L + 2 * VLASOV_STENCIL_WIDTH;
+               cuint sourceStart = pencils.idsStart[pencili] + 2 * VLASOV_STENCIL_WIDTH * pencili;
+               SpatialCell** pencilSourceCells = sourceCells.data() + sourceStart;
+               Vec* pencilSourceVecData = sourceVecData + sourceStart * WID3 / VECL;
+               uint8_t* pencilPlaneMasks = sourcePlaneMasks + sourceStart;
+               Vec* pencilTargetValues = targetValues + totalTargetLength * WID3 / VECL;
+
+               if(!mapPencil[pencili]) {
+                  totalTargetLength += targetLength;
+                  continue;
+               }
                               
                // load data(=> sourcedata) / (proper xy reconstruction in future)
-               bool pencil_has_data = copy_trans_block_data_amr(pencilSourceCells[pencili].data(), blockGID, L, pencilSourceVecData[pencili].data(),
-                                         cellid_transpose, popID);
+               bool pencil_has_data = copy_trans_block_data_amr(pencilSourceCells, blockGID, L, pencilSourceVecData,
+                                         pencilPlaneMasks, cellid_transpose, popID);
 
                if(!pencil_has_data) {
                   totalTargetLength += targetLength;
@@ -1606,7 +1791,8 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
 
                // Dz and sourceVecData are both padded by VLASOV_STENCIL_WIDTH
                // Dz has 1 value/cell, sourceVecData has WID3 values/cell
-               propagatePencil(pencildz[pencili].data(), pencilSourceVecData[pencili].data(), pencilTargetValues[pencili].data(), dimension, blockGID, dt, vmesh, L, pencilSourceCells[pencili][0]->getVelocityBlockMinValue(popID));
+               propagatePencil(dz.data() + sourceStart, pencilSourceVecData, pencilTargetValues, dimension, blockGID, dt, vmesh, L, pencilSourceCells[0]->getVelocityBlockMinValue(popID), pencilPlaneMasks);
+               nMappedBlocks += L;
 
                // sourceVecData => targetBlockData[this pencil])
 
@@ -1619,8 +1805,8 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
 
                         // Unpack the vector data
                         Realf vector[VECL];
-                        //pencilSourceVecData[pencili][i_trans_ps_blockv_pencil(planeVector, k, icell - 1, L)].store(vector);
-                        pencilTargetValues[pencili][i_trans_pt_blockv(planeVector, k, icell - 1)].store(vector);
+                        //pencilSourceVecData[i_trans_ps_blockv_pencil(planeVector, k, icell - 1, L)].store(vector);
+                        pencilTargetValues[i_trans_pt_blockv(planeVector, k, icell - 1)].store(vector);
 
                         // Loop over 3rd (vectorized) vspace dimension
                         for (uint iv = 0; iv < VECL; iv++) {
@@ -1637,15 +1823,20 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
                
             } // Closes loop over pencils. SourceVecData gets implicitly deallocated here.
 
+            kernelcounters::add(kernelcounters::TRANS_MAPPING, MPI_Wtime() - tMapping, nMappedBlocks);
             phiprof::stop(t1);
             phiprof::start(t2);
+
+            // In split-phase translation the targets are reset in reset_trans_target_blocks,
+            // and the data is added to the temporary block containers.
+            const bool storeToTemporary = (phase != translationphase::ALL);
             
             // reset blocks in all non-sysboundary neighbor spatial cells for this block id
             // At this point the block data is saved in targetBlockData so we can reset the spatial cells
 
             for (auto *spatial_cell: targetCells) {
                // Check for null and system boundary
-               if (spatial_cell && spatial_cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) {
+               if (!storeToTemporary && spatial_cell && spatial_cell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) {
                   
                   // Get local velocity block id
                   const vmesh::LocalID blockLID = spatial_cell->get_velocity_block_local_id(blockGID, popID);
@@ -1667,9 +1858,14 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
             // store_data(target_data => targetCells)  :Aggregate data for blockid to original location 
             // Loop over pencils again
             totalTargetLength = 0;
-            for(uint pencili = 0; pencili < DimensionPencils[dimension].N; pencili++){
+            for(uint pencili = 0; pencili < pencils.N; pencili++){
                
-               uint targetLength = DimensionPencils[dimension].lengthOfPencils[pencili] + 2 * nTargetNeighborsPerPencil;
+               uint targetLength = pencils.lengthOfPencils[pencili] + 2 * nTargetNeighborsPerPencil;
+
+               if(!mapPencil[pencili]) {
+                  totalTargetLength += targetLength;
+                  continue;
+               }
                
                // store values from targetBlockData array to the actual blocks
                // Loop over cells in the pencil, including the padded cells of the target array
@@ -1687,10 +1883,12 @@ bool trans_map_1d_amr(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
                         continue;
                      }
                      
-                     Realf* blockData = targetCell->get_data(blockLID, popID);
+                     Realf* blockData = storeToTemporary ?
+                        targetCell->get_velocity_blocks_temporary().getData(blockLID) :
+                        targetCell->get_data(blockLID, popID);
                      
                      // areaRatio is the reatio of the cross-section of the spatial cell to the cross-section of the pencil.
-                     int diff = targetCell->SpatialCell::parameters[CellParams::REFINEMENT_LEVEL] - DimensionPencils[dimension].path[pencili].size();
+                     int diff = targetCell->SpatialCell::parameters[CellParams::REFINEMENT_LEVEL] - pencils.getPathLength(pencili);
                      int ratio;
                      Realf areaRatio;
                      if(diff>=0) {
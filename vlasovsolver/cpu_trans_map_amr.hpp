@@ -22,13 +22,33 @@
 #ifndef CPU_TRANS_MAP_AMR_H
 #define CPU_TRANS_MAP_AMR_H
 
+#include <algorithm>
 #include <vector>
+#include <unordered_set>
 
 #include "vec.h"
 #include "../common.h"
 #include "../spatial_cell.hpp"
+#include "cpu_trans_map.hpp"
 
 
+// Read-only view of the cell ids of one pencil. Valid until pencils are added to the set.
+struct PencilIds {
+
+   const CellID* first;
+   uint length;
+
+   const CellID* begin() const { return first; }
+   const CellID* end() const { return first + length; }
+   uint size() const { return length; }
+   const CellID& operator[](const uint i) const { return first[i]; }
+   const CellID& front() const { return first[0]; }
+   const CellID& back() const { return first[length - 1]; }
+};
+
+// Set of pencils stored as a structure of arrays. The cell ids of all pencils are stored
+// contiguously in ids, pencil i occupying lengthOfPencils[i] elements starting at idsStart[i].
+// The path taken through the refinement levels is packed in pathBits, two bits per level.
 struct setOfPencils {
 
    uint N; // Number of pencils in the set
@@ -37,123 +57,216 @@ struct setOfPencils {
    std::vector< CellID > ids; // List of cells
    std::vector< uint > idsStart; // List of where a pencil's CellIDs start in the ids array
    std::vector< Realv > x,y; // x,y - position
-   std::vector< bool > periodic;
-   std::vector< std::vector<uint> > path; // Path taken through refinement levels
+   std::vector< uint8_t > periodic;
+   std::vector< uint64_t > pathBits; // Path taken through refinement levels, 2 bits per level
+   std::vector< uint8_t > pathLength; // Number of refinement levels in the path
+
+   // Index of the pencils passing through each cell, in compressed sparse row form. The pencils
+   // of cell indexCells[k] are indexPencils[indexOffsets[k]] ... indexPencils[indexOffsets[k+1]-1].
+   // Built by buildCellIndex, pencils added after that (nIndexedPencils and up) are not in it.
+   std::vector< CellID > indexCells; // Sorted ids of the cells in the index
+   std::vector< uint > indexOffsets;
+   std::vector< uint > indexPencils;
+   uint nIndexedPencils;
+
+   static const uint maxPathLength = 32;
 
    setOfPencils() {
       
       N = 0;
       sumOfLengths = 0;
+      nIndexedPencils = 0;
    }
 
    void removeAllPencils() {
 
       N = 0;
       sumOfLengths = 0;
-      sumOfLengths = 0;
       lengthOfPencils.clear();
       idsStart.clear();
       ids.clear();
       x.clear();
       y.clear();
       periodic.clear();
-      path.clear();
+      pathBits.clear();
+      pathLength.clear();
+      indexCells.clear();
+      indexOffsets.clear();
+      indexPencils.clear();
+      nIndexedPencils = 0;
    }
 
-
-   void addPencil(std::vector<CellID> idsIn, Real xIn, Real yIn, bool periodicIn, std::vector<uint> pathIn) {
+   void addPencil(const CellID* idsBegin, const uint length, Real xIn, Real yIn, bool periodicIn,
+                  const uint64_t pathBitsIn, const uint pathLengthIn) {
 
       N++;
-      sumOfLengths += idsIn.size();
-      lengthOfPencils.push_back(idsIn.size());
+      sumOfLengths += length;
+      lengthOfPencils.push_back(length);
       idsStart.push_back(ids.size());
-      ids.insert(ids.end(),idsIn.begin(),idsIn.end());
+      ids.insert(ids.end(),idsBegin,idsBegin + length);
       x.push_back(xIn);
       y.push_back(yIn);
       periodic.push_back(periodicIn);
-      path.push_back(pathIn);
+      pathBits.push_back(pathBitsIn);
+      pathLength.push_back(pathLengthIn);
    }
 
-   void removePencil(const uint pencilId) {
+   void addPencil(const std::vector<CellID>& idsIn, Real xIn, Real yIn, bool periodicIn, const std::vector<uint>& pathIn) {
 
-      x.erase(x.begin() + pencilId);
-      y.erase(y.begin() + pencilId);
-      periodic.erase(periodic.begin() + pencilId);
-      path.erase(path.begin() + pencilId);
+      if (pathIn.size() > maxPathLength) {
+         std::cerr << __FILE__ << ":" << __LINE__ << " Pencil path too long: " << pathIn.size() << std::endl;
+         abort();
+      }
+      uint64_t bits = 0;
+      for (uint i = 0; i < pathIn.size(); ++i) {
+         bits |= (uint64_t)(pathIn[i] & 3) << (2 * i);
+      }
+      addPencil(idsIn.data(), idsIn.size(), xIn, yIn, periodicIn, bits, pathIn.size());
+   }
 
-      uint ibeg = idsStart[pencilId];
-      ids.erase(ids.begin() + ibeg, ids.begin() + ibeg + lengthOfPencils[pencilId]);
-      idsStart.erase(idsStart.begin() + pencilId);
+   // Copy pencil pencilId of another set to this set
+   void addPencil(const setOfPencils& other, const uint pencilId) {
 
-      N--;
-      sumOfLengths -= lengthOfPencils[pencilId];
-      lengthOfPencils.erase(lengthOfPencils.begin() + pencilId);
-         
+      addPencil(other.ids.data() + other.idsStart[pencilId], other.lengthOfPencils[pencilId],
+                other.x[pencilId], other.y[pencilId], other.periodic[pencilId],
+                other.pathBits[pencilId], other.pathLength[pencilId]);
+   }
+
+   // Append all pencils of another set to this set
+   void appendPencils(const setOfPencils& other) {
+
+      const uint idsOffset = ids.size();
+      for (uint i = 0; i < other.N; ++i) {
+         idsStart.push_back(idsOffset + other.idsStart[i]);
+      }
+      N += other.N;
+      sumOfLengths += other.sumOfLengths;
+      lengthOfPencils.insert(lengthOfPencils.end(), other.lengthOfPencils.begin(), other.lengthOfPencils.end());
+      ids.insert(ids.end(), other.ids.begin(), other.ids.end());
+      x.insert(x.end(), other.x.begin(), other.x.end());
+      y.insert(y.end(), other.y.begin(), other.y.end());
+      periodic.insert(periodic.end(), other.periodic.begin(), other.periodic.end());
+      pathBits.insert(pathBits.end(), other.pathBits.begin(), other.pathBits.end());
+      pathLength.insert(pathLength.end(), other.pathLength.begin(), other.pathLength.end());
    }
 
-   std::vector<CellID> getIds(const uint pencilId) const {
+   // Build the index of the pencils passing through each cell from all current pencils
+   void buildCellIndex() {
+
+      std::vector< std::pair<CellID,uint> > cellPencils;
+      cellPencils.reserve(ids.size());
+      for (uint i = 0; i < N; ++i) {
+         for (uint j = idsStart[i]; j < idsStart[i] + lengthOfPencils[i]; ++j) {
+            cellPencils.push_back(std::make_pair(ids[j], i));
+         }
+      }
+      std::sort(cellPencils.begin(), cellPencils.end());
+
+      indexCells.clear();
+      indexOffsets.clear();
+      indexPencils.resize(cellPencils.size());
+      for (uint k = 0; k < cellPencils.size(); ++k) {
+         if (k == 0 || cellPencils[k].first != cellPencils[k-1].first) {
+            indexCells.push_back(cellPencils[k].first);
+            indexOffsets.push_back(k);
+         }
+         indexPencils[k] = cellPencils[k].second;
+      }
+      indexOffsets.push_back(cellPencils.size());
+      nIndexedPencils = N;
+   }
+
+   // Number of indexed pencils passing through the cell, and a pointer to their indices
+   uint getPencilsOfCell(const CellID id, const uint*& pencilIds) const {
+
+      const auto it = std::lower_bound(indexCells.begin(), indexCells.end(), id);
+      if (it == indexCells.end() || *it != id) {
+         pencilIds = nullptr;
+         return 0;
+      }
+      const size_t k = it - indexCells.begin();
+      pencilIds = indexPencils.data() + indexOffsets[k];
+      return indexOffsets[k+1] - indexOffsets[k];
+   }
+
+   PencilIds getIds(const uint pencilId) const {
       
       if (pencilId >= N) {
-         std::vector<CellID> idsEmpty;
-         return idsEmpty;
+         return PencilIds {nullptr, 0};
       }
-      
-      // Use vector range constructor
-      std::vector<CellID>::const_iterator ibeg = ids.begin() + idsStart[pencilId];
-      std::vector<CellID>::const_iterator iend = ibeg + lengthOfPencils[pencilId];
-      std::vector<CellID> idsOut(ibeg, iend);
-      
-      return idsOut;
+      return PencilIds {ids.data() + idsStart[pencilId], lengthOfPencils[pencilId]};
+   }
+
+   uint getPathLength(const uint pencilId) const {
+      return pathLength[pencilId];
+   }
+
+   // Step taken by the pencil at refinement level refLvl (0...3)
+   uint getPathStep(const uint pencilId, const uint refLvl) const {
+      return (pathBits[pencilId] >> (2 * refLvl)) & 3;
+   }
+
+   std::vector<uint> getPath(const uint pencilId) const {
+      std::vector<uint> pathOut(pathLength[pencilId]);
+      for (uint i = 0; i < pathOut.size(); ++i) {
+         pathOut[i] = getPathStep(pencilId, i);
+      }
+      return pathOut;
    }
 
    // Split one pencil into up to four pencils covering the same space.
    // dx and dy are the dimensions of the original pencil.
    void split(const uint myPencilId, const Realv dx, const Realv dy) {
 
-      auto myIds = this->getIds(myPencilId);
+      // Copy of the ids, the storage of ids may move when pencils are added
+      const PencilIds myIdsView = this->getIds(myPencilId);
+      const std::vector<CellID> myIds(myIdsView.begin(), myIdsView.end());
 
       // Find paths that members of this pencil may have in other pencils (can happen)
-      // so that we don't add duplicates.
-      std::vector<int> existingSteps;
-
-#pragma omp parallel for      
-      for (uint theirPencilId = 0; theirPencilId < this->N; ++theirPencilId) {
-         if(theirPencilId == myPencilId) continue;
-         auto theirIds = this->getIds(theirPencilId);
-         for (auto theirId : theirIds) {
-            for (auto myId : myIds) {
-               if (myId == theirId) {
-                  std::vector<uint> theirPath = this->path.at(theirPencilId);
-                  std::vector<uint> myPath = this->path.at(myPencilId);
-                  if(theirPath.size() > myPath.size()) {
-                     bool samePath = true;
-                     for (uint i = 0; i < myPath.size(); ++i) {
-                        if(myPath.at(i) != theirPath.at(i)) {
-                           samePath = false;
-                        }
-                     }
-
-                     if(samePath) {
-                        uint theirStep = theirPath.at(myPath.size());
-#pragma omp critical
-                        {
-                           existingSteps.push_back(theirStep);
-                        }
-                     }
-                  }
-               }
+      // so that we don't add duplicates. Only the pencils sharing a cell with this
+      // pencil need to be checked, these are found from the cell index.
+      const uint myPathLength = pathLength[myPencilId];
+      if (myPathLength >= maxPathLength) {
+         std::cerr << __FILE__ << ":" << __LINE__ << " Pencil path too long: " << myPathLength + 1 << std::endl;
+         abort();
+      }
+      const uint64_t myPathMask = (myPathLength == 0) ? 0 : (~(uint64_t)0 >> (64 - 2 * myPathLength));
+      bool existingSteps[4] = {false, false, false, false};
+
+      auto checkPencil = [&](const uint theirPencilId) {
+         if(theirPencilId == myPencilId) return;
+         if(pathLength[theirPencilId] > myPathLength &&
+            (pathBits[theirPencilId] & myPathMask) == (pathBits[myPencilId] & myPathMask)) {
+            existingSteps[getPathStep(theirPencilId, myPathLength)] = true;
+         }
+      };
+      for (auto myId : myIds) {
+         const uint* theirPencilIds;
+         const uint nTheirPencils = getPencilsOfCell(myId, theirPencilIds);
+         for (uint i = 0; i < nTheirPencils; ++i) {
+            checkPencil(theirPencilIds[i]);
+         }
+      }
+      // Pencils added after the index was built, ie. by earlier splits
+      std::vector<CellID> mySortedIds(myIds);
+      std::sort(mySortedIds.begin(), mySortedIds.end());
+      for (uint theirPencilId = nIndexedPencils; theirPencilId < N; ++theirPencilId) {
+         for (uint j = idsStart[theirPencilId]; j < idsStart[theirPencilId] + lengthOfPencils[theirPencilId]; ++j) {
+            if (std::binary_search(mySortedIds.begin(), mySortedIds.end(), ids[j])) {
+               checkPencil(theirPencilId);
+               break;
             }
          }
       }
 
       bool firstPencil = true;
-      const auto copy_of_path = path.at(myPencilId);
-      const auto copy_of_x = x.at(myPencilId);
-      const auto copy_of_y = y.at(myPencilId);
+      const auto copy_of_path = pathBits[myPencilId];
+      const auto copy_of_x = x[myPencilId];
+      const auto copy_of_y = y[myPencilId];
 
       // Add those pencils whose steps dont already exist in the pencils struct
-      for (int step = 0; step < 4; ++step) {
-         if (std::any_of(existingSteps.begin(), existingSteps.end(), [step](int i){return step == i;})) {
+      for (uint step = 0; step < 4; ++step) {
+         if (existingSteps[step]) {
             continue;
          }
 
@@ -170,17 +283,17 @@ struct setOfPencils {
          
          auto myX = copy_of_x + signX * 0.25 * dx;
          auto myY = copy_of_y + signY * 0.25 * dy;
+         const uint64_t myPath = copy_of_path | ((uint64_t)step << (2 * myPathLength));
 
          if(firstPencil) {
             //TODO: set x and y correctly. Right now they are not used anywhere.
-            path.at(myPencilId).push_back(step);
-            x.at(myPencilId) = myX;
-            y.at(myPencilId) = myY;
+            pathBits[myPencilId] = myPath;
+            pathLength[myPencilId] = myPathLength + 1;
+            x[myPencilId] = myX;
+            y[myPencilId] = myY;
             firstPencil = false;
          } else {
-            auto myPath = copy_of_path;
-            myPath.push_back(step);
-            addPencil(myIds, myX, myY, periodic.at(myPencilId), myPath);
+            addPencil(myIds.data(), myIds.size(), myX, myY, periodic[myPencilId], myPath, myPathLength + 1);
          }
       }
    }
@@ -193,7 +306,8 @@ bool trans_map_1d_amr(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartes
                   std::vector<uint>& nPencils,
                   const uint dimension,
                   const Realv dt,
-                  const uint popID);
+                  const uint popID,
+                  const uint phase = translationphase::ALL);
 
 void update_remote_mapping_contribution_amr(dccrg::Dccrg<spatial_cell::SpatialCell,
                                             dccrg::Cartesian_Geometry>& mpiGrid,
@@ -204,6 +318,10 @@ void update_remote_mapping_contribution_amr(dccrg::Dccrg<spatial_cell::SpatialCe
 // grid.cpp calls this function to both find seed cells and build pencils
 void prepareSeedIdsAndPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                               const uint dimension);
+// Same as above, but keeps the existing pencils that are not affected by the migration of migratedCells
+void prepareSeedIdsAndPencils(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                              const uint dimension,
+                              const std::unordered_set<CellID>& migratedCells);
 
 // pencils used for AMR translation
 static std::array<setOfPencils,3> DimensionPencils;
@@ -20,8 +20,11 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <utility>
 #include <vector>
 #include <stdint.h>
 
@@ -55,6 +58,139 @@ creal ONE     = 1.0;
 creal TWO     = 2.0;
 creal EPSILON = 1.0e-25;
 
+/** Check whether the translation ghost data of any of the given populations is compressed.
+    @param popIDs Population IDs.
+*/
+static bool ghostTransferIsCompressed(const vector<uint>& popIDs) {
+   for (const uint popID : popIDs) {
+      if (getObjectWrapper().particleSpecies[popID].ghostTransferCompression) return true;
+   }
+   return false;
+}
+
+/** Unpack the received translation ghost cell data of the populations with ghost
+    transfer compression, see SpatialCell::unpack_compressed_block_data. Only the
+    remote cells that were received with the current transfer settings are unpacked.
+*/
+static void finishGhostTransfer(
+        dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+        const vector<uint>& popIDs,
+        const int neighborhood
+) {
+   if (!ghostTransferIsCompressed(popIDs)) return;
+
+   phiprof::start("unpack-stencil-data");
+   const vector<CellID> receiveCells = mpiGrid.get_remote_cells_on_process_boundary(neighborhood);
+   #pragma omp parallel for schedule(dynamic,1)
+   for (size_t c=0; c<receiveCells.size(); ++c) {
+      SpatialCell* cell = mpiGrid[receiveCells[c]];
+      if (!cell->mpi_transfer_is_active()) continue;
+      for (const uint popID : popIDs) {
+         if (!getObjectWrapper().particleSpecies[popID].ghostTransferCompression) continue;
+         if (cell->get_number_of_velocity_blocks(popID) == 0) continue;
+         cell->unpack_compressed_block_data(popID);
+      }
+   }
+   phiprof::stop("unpack-stencil-data");
+}
+
+/** Start the exchange of translation ghost cell data of the given populations in one
+    dimension. Populations with ghost transfer compression are first packed in the local
+    cells that are sent, see SpatialCell::pack_compressed_block_data, and the packed sizes
+    are exchanged so that the receives match the sends. If split is true, the exchange of
+    the data is only started, otherwise it is completed and the received data unpacked.
+*/
+static void startGhostTransfer(
+        dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+        const vector<uint>& popIDs,
+        const uint dimension,
+        const int neighborhood,
+        const bool split
+) {
+   const bool compressed = ghostTransferIsCompressed(popIDs);
+   if (compressed) {
+      phiprof::start("pack-stencil-data");
+      const vector<CellID>& sendCells = mpiGrid.get_local_cells_on_process_boundary(neighborhood);
+      #pragma omp parallel for schedule(dynamic,1)
+      for (size_t c=0; c<sendCells.size(); ++c) {
+         SpatialCell* cell = mpiGrid[sendCells[c]];
+         for (const uint popID : popIDs) {
+            if (!getObjectWrapper().particleSpecies[popID].ghostTransferCompression) continue;
+            cell->pack_compressed_block_data(popID, cell->getVelocityBlockMinValue(popID)
+                                             * getObjectWrapper().particleSpecies[popID].ghostTransferCompressionThreshold);
+         }
+      }
+      phiprof::stop("pack-stencil-data");
+   }
+
+   SpatialCell::setCommunicatedSpecies(popIDs);
+   SpatialCell::set_mpi_transfer_direction(dimension);
+   if (compressed) {
+      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA_COMPRESSED_SIZE, false, P::amrMaxSpatialRefLevel > 0);
+      mpiGrid.update_copies_of_remote_neighbors(neighborhood);
+   }
+   SpatialCell::set_mpi_transfer_type(compressed ? Transfer::VEL_BLOCK_DATA_COMPRESSED : Transfer::VEL_BLOCK_DATA,
+                                      false, P::amrMaxSpatialRefLevel > 0);
+   if (split) {
+      mpiGrid.start_remote_neighbor_copy_updates(neighborhood);
+   } else {
+      mpiGrid.update_copies_of_remote_neighbors(neighborhood);
+      finishGhostTransfer(mpiGrid, popIDs, neighborhood);
+   }
+}
+
+/** Maps the distribution function in one spatial dimension while the ghost
+    cell exchange, started by the caller, is still in flight. Cells (pencils
+    in AMR) whose source stencil is local are mapped first, the rest after
+    the receives have completed. Both are accumulated into the temporary
+    block containers of the target cells, which are stored to the actual
+    blocks once the sends have completed.
+*/
+static void splitPhaseMapping(
+        dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+        const vector<CellID>& local_propagated_cells,
+        const vector<CellID>& remoteTargetCells,
+        vector<uint>& nPencils,
+        const uint dimension,
+        const int neighborhood,
+        creal dt,
+        const uint popID,
+        const vector<uint>& transferPopIDs
+) {
+   reset_trans_target_blocks(mpiGrid, local_propagated_cells, remoteTargetCells, popID);
+
+   phiprof::start("compute-interior");
+   if(P::amrMaxSpatialRefLevel == 0) {
+      trans_map_1d(mpiGrid, local_propagated_cells, remoteTargetCells, dimension, dt, popID, translationphase::INTERIOR);
+   } else {
+      trans_map_1d_amr(mpiGrid, local_propagated_cells, remoteTargetCells, nPencils, dimension, dt, popID, translationphase::INTERIOR);
+   }
+   phiprof::stop("compute-interior");
+
+   int timer = phiprof::initializeTimer("wait-stencil-data-receives","MPI","Wait");
+   phiprof::start(timer);
+   mpiGrid.wait_remote_neighbor_copy_update_receives(neighborhood);
+   phiprof::stop(timer);
+   finishGhostTransfer(mpiGrid, transferPopIDs, neighborhood);
+
+   phiprof::start("compute-boundary");
+   if(P::amrMaxSpatialRefLevel == 0) {
+      trans_map_1d(mpiGrid, local_propagated_cells, remoteTargetCells, dimension, dt, popID, translationphase::BOUNDARY);
+   } else {
+      trans_map_1d_amr(mpiGrid, local_propagated_cells, remoteTargetCells, nPencils, dimension, dt, popID, translationphase::BOUNDARY);
+   }
+   phiprof::stop("compute-boundary");
+
+   timer = phiprof::initializeTimer("wait-stencil-data-sends","MPI","Wait");
+   phiprof::start(timer);
+   mpiGrid.wait_remote_neighbor_copy_update_sends(neighborhood);
+   phiprof::stop(timer);
+
+   phiprof::start("store-targets");
+   store_trans_target_blocks(mpiGrid, local_propagated_cells, remoteTargetCells, popID);
+   phiprof::stop("store-targets");
+}
+
 /** Propagates the distribution function in spatial space. 
     
     Based on SLICE-3D algorithm: Zerroukat, M., and T. Allen. "A
@@ -73,14 +209,12 @@ void calculateSpatialTranslation(
         const vector<CellID>& remoteTargetCellsz,
         vector<uint>& nPencils,
         creal dt,
-        const uint popID,
+        const vector<uint>& popIDs,
         Real &time
 ) {
 
     int trans_timer;
     bool localTargetGridGenerated = false;
-    bool AMRtranslationActive = false;
-    if (P::amrMaxSpatialRefLevel > 0) AMRtranslationActive = true;
 
     double t1;
     
@@ -91,6 +225,44 @@ void calculateSpatialTranslation(
    phiprof::start(bt);
    MPI_Barrier(MPI_COMM_WORLD);
    phiprof::stop(bt);
+
+   // On uniform grids, interior tiles may be translated in the first two
+   // dimensions at once. This reads the data before it is modified by
+   // trans_map_1d, which then only maps the cells whose values are still
+   // needed outside the tiles. The tiles are one cell thick in the third
+   // dimension, so that the per-thread buffers of a tile stay in cache,
+   // and their result is stored before the third dimension is mapped.
+   const bool fusedTileTranslation = P::vlasovFusedTileTranslation && !P::vlasovSplitPhaseTranslation &&
+                                     P::amrMaxSpatialRefLevel == 0;
+   FusedTransTiles fusedTiles;
+   int fusedStoreDimension = -1;
+   if (fusedTileTranslation) {
+      t1 = MPI_Wtime();
+      phiprof::start("compute-mapping-fused-tiles");
+      vector<uint> dimensions;
+      if (P::zcells_ini > 1) dimensions.push_back(2);
+      if (P::xcells_ini > 1) dimensions.push_back(0);
+      if (P::ycells_ini > 1) dimensions.push_back(1);
+      if (dimensions.size() > 2) dimensions.resize(2);
+      if (dimensions.size() > 0) fusedStoreDimension = dimensions.back();
+      prepare_fused_trans_tiles(mpiGrid, local_propagated_cells, dimensions, P::vlasovFusedTileSize, fusedTiles);
+      for (const uint popID : popIDs) {
+         trans_map_fused_tiles(mpiGrid, fusedTiles, dt, popID);
+      }
+      phiprof::stop("compute-mapping-fused-tiles");
+      time += MPI_Wtime() - t1;
+   }
+   const vector<CellID>& propagatedCellsx = fusedTileTranslation ? fusedTiles.propagatedCells[0] : local_propagated_cells;
+   const vector<CellID>& propagatedCellsy = fusedTileTranslation ? fusedTiles.propagatedCells[1] : local_propagated_cells;
+   const vector<CellID>& propagatedCellsz = fusedTileTranslation ? fusedTiles.propagatedCells[2] : local_propagated_cells;
+   auto storeFusedTiles = [&](const int dimension) {
+      if (dimension != fusedStoreDimension) return;
+      phiprof::start("store-fused-tiles");
+      for (const uint popID : popIDs) {
+         store_fused_trans_tiles(mpiGrid, fusedTiles, popID);
+      }
+      phiprof::stop("store-fused-tiles");
+   };
  
     // ------------- SLICE - map dist function in Z --------------- //
    if(P::zcells_ini > 1){
@@ -98,9 +270,7 @@ void calculateSpatialTranslation(
       trans_timer=phiprof::initializeTimer("transfer-stencil-data-z","MPI");
       phiprof::start(trans_timer);
       //updateRemoteVelocityBlockLists(mpiGrid,popID,VLASOV_SOLVER_Z_NEIGHBORHOOD_ID);
-      SpatialCell::set_mpi_transfer_direction(2);
-      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA,false,AMRtranslationActive);
-      mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Z_NEIGHBORHOOD_ID);
+      startGhostTransfer(mpiGrid, popIDs, 2, VLASOV_SOLVER_Z_NEIGHBORHOOD_ID, P::vlasovSplitPhaseTranslation);
       phiprof::stop(trans_timer);
 
       // bt=phiprof::initializeTimer("barrier-trans-pre-trans_map_1d-z","Barriers","MPI");
@@ -110,10 +280,17 @@ void calculateSpatialTranslation(
 
       t1 = MPI_Wtime();
       phiprof::start("compute-mapping-z");
-      if(P::amrMaxSpatialRefLevel == 0) {
-         trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsz, 2, dt,popID); // map along z//
-      } else {
-         trans_map_1d_amr(mpiGrid,local_propagated_cells, remoteTargetCellsz, nPencils, 2, dt,popID); // map along z//
+      // The ghost data of all populations arrives in the same exchange, the overlap
+      // with the exchange is only possible for the first population
+      for (size_t p=0; p<popIDs.size(); ++p) {
+         const uint popID = popIDs[p];
+         if(P::vlasovSplitPhaseTranslation && p == 0) {
+            splitPhaseMapping(mpiGrid, local_propagated_cells, remoteTargetCellsz, nPencils, 2, VLASOV_SOLVER_Z_NEIGHBORHOOD_ID, dt, popID, popIDs); // map along z//
+         } else if(P::amrMaxSpatialRefLevel == 0) {
+            trans_map_1d(mpiGrid,propagatedCellsz, remoteTargetCellsz, 2, dt,popID); // map along z//
+         } else {
+            trans_map_1d_amr(mpiGrid,local_propagated_cells, remoteTargetCellsz, nPencils, 2, dt,popID); // map along z//
+         }
       }
       phiprof::stop("compute-mapping-z");
       time += MPI_Wtime() - t1;
@@ -125,14 +302,17 @@ void calculateSpatialTranslation(
 
       trans_timer=phiprof::initializeTimer("update_remote-z","MPI");
       phiprof::start("update_remote-z");
-      if(P::amrMaxSpatialRefLevel == 0) {
-         update_remote_mapping_contribution(mpiGrid, 2,+1,popID);
-         update_remote_mapping_contribution(mpiGrid, 2,-1,popID);
-      } else {
-         update_remote_mapping_contribution_amr(mpiGrid, 2,+1,popID);
-         update_remote_mapping_contribution_amr(mpiGrid, 2,-1,popID);
+      for (const uint popID : popIDs) {
+         if(P::amrMaxSpatialRefLevel == 0) {
+            update_remote_mapping_contribution(mpiGrid, 2,+1,popID);
+            update_remote_mapping_contribution(mpiGrid, 2,-1,popID);
+         } else {
+            update_remote_mapping_contribution_amr(mpiGrid, 2,+1,popID);
+            update_remote_mapping_contribution_amr(mpiGrid, 2,-1,popID);
+         }
       }
       phiprof::stop("update_remote-z");
+      storeFusedTiles(2);
 
    }
 
@@ -147,9 +327,7 @@ void calculateSpatialTranslation(
       trans_timer=phiprof::initializeTimer("transfer-stencil-data-x","MPI");
       phiprof::start(trans_timer);
       //updateRemoteVelocityBlockLists(mpiGrid,popID,VLASOV_SOLVER_X_NEIGHBORHOOD_ID);
-      SpatialCell::set_mpi_transfer_direction(0);
-      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA,false,AMRtranslationActive);
-      mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_X_NEIGHBORHOOD_ID);
+      startGhostTransfer(mpiGrid, popIDs, 0, VLASOV_SOLVER_X_NEIGHBORHOOD_ID, P::vlasovSplitPhaseTranslation);
       phiprof::stop(trans_timer);
       
       // bt=phiprof::initializeTimer("barrier-trans-pre-trans_map_1d-x","Barriers","MPI");
@@ -159,10 +337,17 @@ void calculateSpatialTranslation(
 
       t1 = MPI_Wtime();
       phiprof::start("compute-mapping-x");
-      if(P::amrMaxSpatialRefLevel == 0) {
-         trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsx, 0,dt,popID); // map along x//
-      } else {
-         trans_map_1d_amr(mpiGrid,local_propagated_cells, remoteTargetCellsx, nPencils, 0,dt,popID); // map along x//
+      // The ghost data of all populations arrives in the same exchange, the overlap
+      // with the exchange is only possible for the first population
+      for (size_t p=0; p<popIDs.size(); ++p) {
+         const uint popID = popIDs[p];
+         if(P::vlasovSplitPhaseTranslation && p == 0) {
+            splitPhaseMapping(mpiGrid, local_propagated_cells, remoteTargetCellsx, nPencils, 0, VLASOV_SOLVER_X_NEIGHBORHOOD_ID, dt, popID, popIDs); // map along x//
+         } else if(P::amrMaxSpatialRefLevel == 0) {
+            trans_map_1d(mpiGrid,propagatedCellsx, remoteTargetCellsx, 0,dt,popID); // map along x//
+         } else {
+            trans_map_1d_amr(mpiGrid,local_propagated_cells, remoteTargetCellsx, nPencils, 0,dt,popID); // map along x//
+         }
       }
       phiprof::stop("compute-mapping-x");
       time += MPI_Wtime() - t1;
@@ -174,14 +359,17 @@ void calculateSpatialTranslation(
 
       trans_timer=phiprof::initializeTimer("update_remote-x","MPI");
       phiprof::start("update_remote-x");
-      if(P::amrMaxSpatialRefLevel == 0) {
-         update_remote_mapping_contribution(mpiGrid, 0,+1,popID);
-         update_remote_mapping_contribution(mpiGrid, 0,-1,popID);
-      } else {
-         update_remote_mapping_contribution_amr(mpiGrid, 0,+1,popID);
-         update_remote_mapping_contribution_amr(mpiGrid, 0,-1,popID);
+      for (const uint popID : popIDs) {
+         if(P::amrMaxSpatialRefLevel == 0) {
+            update_remote_mapping_contribution(mpiGrid, 0,+1,popID);
+            update_remote_mapping_contribution(mpiGrid, 0,-1,popID);
+         } else {
+            update_remote_mapping_contribution_amr(mpiGrid, 0,+1,popID);
+            update_remote_mapping_contribution_amr(mpiGrid, 0,-1,popID);
+         }
       }
       phiprof::stop("update_remote-x");
+      storeFusedTiles(0);
 
    }
 
@@ -196,9 +384,7 @@ void calculateSpatialTranslation(
       trans_timer=phiprof::initializeTimer("transfer-stencil-data-y","MPI");
       phiprof::start(trans_timer);
       //updateRemoteVelocityBlockLists(mpiGrid,popID,VLASOV_SOLVER_Y_NEIGHBORHOOD_ID);
-      SpatialCell::set_mpi_transfer_direction(1);
-      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA,false,AMRtranslationActive);
-      mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Y_NEIGHBORHOOD_ID);
+      startGhostTransfer(mpiGrid, popIDs, 1, VLASOV_SOLVER_Y_NEIGHBORHOOD_ID, P::vlasovSplitPhaseTranslation);
       phiprof::stop(trans_timer);
       
       // bt=phiprof::initializeTimer("barrier-trans-pre-trans_map_1d-y","Barriers","MPI");
@@ -208,10 +394,17 @@ void calculateSpatialTranslation(
 
       t1 = MPI_Wtime();
       phiprof::start("compute-mapping-y");
-      if(P::amrMaxSpatialRefLevel == 0) {
-         trans_map_1d(mpiGrid,local_propagated_cells, remoteTargetCellsy, 1,dt,popID); // map along y//
-      } else {
-         trans_map_1d_amr(mpiGrid,local_propagated_cells, remoteTargetCellsy, nPencils, 1,dt,popID); // map along y//      
+      // The ghost data of all populations arrives in the same exchange, the overlap
+      // with the exchange is only possible for the first population
+      for (size_t p=0; p<popIDs.size(); ++p) {
+         const uint popID = popIDs[p];
+         if(P::vlasovSplitPhaseTranslation && p == 0) {
+            splitPhaseMapping(mpiGrid, local_propagated_cells, remoteTargetCellsy, nPencils, 1, VLASOV_SOLVER_Y_NEIGHBORHOOD_ID, dt, popID, popIDs); // map along y//
+         } else if(P::amrMaxSpatialRefLevel == 0) {
+            trans_map_1d(mpiGrid,propagatedCellsy, remoteTargetCellsy, 1,dt,popID); // map along y//
+         } else {
+            trans_map_1d_amr(mpiGrid,local_propagated_cells, remoteTargetCellsy, nPencils, 1,dt,popID); // map along y//      
+         }
       }
       phiprof::stop("compute-mapping-y");
       time += MPI_Wtime() - t1;
@@ -223,14 +416,17 @@ void calculateSpatialTranslation(
 
       trans_timer=phiprof::initializeTimer("update_remote-y","MPI");
       phiprof::start("update_remote-y");
-      if(P::amrMaxSpatialRefLevel == 0) {
-         update_remote_mapping_contribution(mpiGrid, 1,+1,popID);
-         update_remote_mapping_contribution(mpiGrid, 1,-1,popID);
-      } else {
-         update_remote_mapping_contribution_amr(mpiGrid, 1,+1,popID);
-         update_remote_mapping_contribution_amr(mpiGrid, 1,-1,popID);
+      for (const uint popID : popIDs) {
+         if(P::amrMaxSpatialRefLevel == 0) {
+            update_remote_mapping_contribution(mpiGrid, 1,+1,popID);
+            update_remote_mapping_contribution(mpiGrid, 1,-1,popID);
+         } else {
+            update_remote_mapping_contribution_amr(mpiGrid, 1,+1,popID);
+            update_remote_mapping_contribution_amr(mpiGrid, 1,-1,popID);
+         }
       }
       phiprof::stop("update_remote-y");
+      storeFusedTiles(1);
      
    }
 
@@ -304,11 +500,13 @@ void calculateSpatialTranslation(
    phiprof::stop("compute_cell_lists");
    
    // Translate all particle species
-   for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
-      string profName = "translate "+getObjectWrapper().particleSpecies[popID].name;
-      phiprof::start(profName);
-      SpatialCell::setCommunicatedSpecies(popID);
-      //      std::cout << "I am at line " << __LINE__ << " of " << __FILE__ << std::endl;
+   if (P::vlasovCombinedPopulationTransfer) {
+      // Ghost data of all species is exchanged in one message per neighbor
+      vector<uint> popIDs;
+      for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
+         popIDs.push_back(popID);
+      }
+      phiprof::start("translate all species");
       calculateSpatialTranslation(
          mpiGrid,
          localCells,
@@ -319,10 +517,31 @@ void calculateSpatialTranslation(
          remoteTargetCellsz,
          nPencils,
          dt,
-         popID,
+         popIDs,
          time
       );
-      phiprof::stop(profName);
+      phiprof::stop("translate all species");
+   } else {
+      for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
+         string profName = "translate "+getObjectWrapper().particleSpecies[popID].name;
+         phiprof::start(profName);
+         SpatialCell::setCommunicatedSpecies(popID);
+         //      std::cout << "I am at line " << __LINE__ << " of " << __FILE__ << std::endl;
+         calculateSpatialTranslation(
+            mpiGrid,
+            localCells,
+            local_propagated_cells,
+            local_target_cells,
+            remoteTargetCellsx,
+            remoteTargetCellsy,
+            remoteTargetCellsz,
+            nPencils,
+            dt,
+            vector<uint>(1,popID),
+            time
+         );
+         phiprof::stop(profName);
+      }
    }
    
    if (Parameters::prepareForRebalance == true) {
@@ -360,6 +579,52 @@ momentCalculation:
   --------------------------------------------------
 */
 
+/** Accelerate one cell over one subcycle step.
+ * @param cell Spatial cell.
+ * @param popID Particle population ID.
+ * @param step The current subcycle step.
+ * @param dt Timestep.
+ * @param threaded If true, the cell is accelerated by all threads, see map_1d.*/
+static void accelerateCellSubcycle(SpatialCell* cell,const uint popID,const uint step,
+                                   const Real& dt,const bool threaded) {
+   const Real maxVdt = cell->get_max_v_dt(popID);
+   
+   //compute subcycle dt. The length is maxVdt on all steps
+   //except the last one. This is to keep the neighboring
+   //spatial cells in sync, so that two neighboring cells with
+   //different number of subcycles have similar timesteps,
+   //except that one takes an additional short step. This keeps
+   //spatial block neighbors as much in sync as possible for
+   //adjust blocks.
+   Real subcycleDt;
+   if( (step + 1) * maxVdt > fabs(dt)) {
+	 subcycleDt = max(fabs(dt) - step * maxVdt, 0.0);
+   } else{
+      subcycleDt = maxVdt;
+   }
+   if (dt<0) subcycleDt = -subcycleDt;
+   
+   //generate pseudo-random order which is always the same irrespective of parallelization, restarts, etc.
+   char rngStateBuffer[256];
+   random_data rngDataBuffer;
+
+   // set seed, initialise generator and get value. The order is the same
+   // for all cells, but varies with timestep.
+   memset(&(rngDataBuffer), 0, sizeof(rngDataBuffer));
+   #ifdef _AIX
+      initstate_r(P::tstep, &(rngStateBuffer[0]), 256, NULL, &(rngDataBuffer));
+      int64_t rndInt;
+      random_r(&rndInt, &rngDataBuffer);
+   #else
+      initstate_r(P::tstep, &(rngStateBuffer[0]), 256, &(rngDataBuffer));
+      int32_t rndInt;
+      random_r(&rngDataBuffer, &rndInt);
+   #endif
+      
+   uint map_order=rndInt%3;
+   cpu_accelerate_cell(cell,popID,map_order,subcycleDt,threaded);
+}
+
 /** Accelerate the given population to new time t+dt.
  * This function is AMR safe.
  * @param popID Particle population ID.
@@ -380,48 +645,34 @@ void calculateAcceleration(const uint popID,const uint globalMaxSubcycles,const
    // Calculated moments are stored in the "_V" variables.
    calculateMoments_V(mpiGrid, propagatedCells, false);
 
-   // Semi-Lagrangian acceleration for those cells which are subcycled
-   #pragma omp parallel for schedule(dynamic,1)
+   // The cost of a subcycle is proportional to the number of blocks in the cell, and
+   // varies by orders of magnitude between cells. Dispatch the cells in order of
+   // decreasing cost, so that the largest ones do not end up at the tail of the
+   // dynamic schedule.
+   std::vector<std::pair<vmesh::LocalID,CellID> > cellsByCost(propagatedCells.size());
    for (size_t c=0; c<propagatedCells.size(); ++c) {
-      const CellID cellID = propagatedCells[c];
-      const Real maxVdt = mpiGrid[cellID]->get_max_v_dt(popID);
-      
-      //compute subcycle dt. The length is maxVdt on all steps
-      //except the last one. This is to keep the neighboring
-      //spatial cells in sync, so that two neighboring cells with
-      //different number of subcycles have similar timesteps,
-      //except that one takes an additional short step. This keeps
-      //spatial block neighbors as much in sync as possible for
-      //adjust blocks.
-      Real subcycleDt;
-      if( (step + 1) * maxVdt > fabs(dt)) {
-	 subcycleDt = max(fabs(dt) - step * maxVdt, 0.0);
-      } else{
-         subcycleDt = maxVdt;
+      cellsByCost[c] = std::make_pair(mpiGrid[propagatedCells[c]]->get_number_of_velocity_blocks(popID), propagatedCells[c]);
+   }
+   std::sort(cellsByCost.begin(), cellsByCost.end(), std::greater<std::pair<vmesh::LocalID,CellID> >());
+
+   // Cells with a very large number of blocks would be left running alone on one
+   // thread at the end of the loop. They are accelerated one at a time, with all
+   // threads mapping the column sets of the cell in parallel.
+   size_t nThreadedCells = 0;
+   if (P::vlasovThreadedCellAccelerationBlocks > 0) {
+      while (nThreadedCells < cellsByCost.size() &&
+             cellsByCost[nThreadedCells].first >= P::vlasovThreadedCellAccelerationBlocks) {
+         ++nThreadedCells;
       }
-      if (dt<0) subcycleDt = -subcycleDt;
-      
-      //generate pseudo-random order which is always the same irrespective of parallelization, restarts, etc.
-      char rngStateBuffer[256];
-      random_data rngDataBuffer;
-
-      // set seed, initialise generator and get value. The order is the same
-      // for all cells, but varies with timestep.
-      memset(&(rngDataBuffer), 0, sizeof(rngDataBuffer));
-      #ifdef _AIX
-         initstate_r(P::tstep, &(rngStateBuffer[0]), 256, NULL, &(rngDataBuffer));
-         int64_t rndInt;
-         random_r(&rndInt, &rngDataBuffer);
-      #else
-         initstate_r(P::tstep, &(rngStateBuffer[0]), 256, &(rngDataBuffer));
-         int32_t rndInt;
-         random_r(&rngDataBuffer, &rndInt);
-      #endif
-         
-      uint map_order=rndInt%3;
-      phiprof::start("cell-semilag-acc");
-      cpu_accelerate_cell(mpiGrid[cellID],popID,map_order,subcycleDt);
-      phiprof::stop("cell-semilag-acc");
+   }
+   for (size_t c=0; c<nThreadedCells; ++c) {
+      accelerateCellSubcycle(mpiGrid[cellsByCost[c].second],popID,step,dt,true);
+   }
+
+   // Semi-Lagrangian acceleration for those cells which are subcycled
+   #pragma omp parallel for schedule(dynamic,1)
+   for (size_t c=nThreadedCells; c<cellsByCost.size(); ++c) {
+      accelerateCellSubcycle(mpiGrid[cellsByCost[c].second],popID,step,dt,false);
    }
 
    //global adjust after each subcycle to keep number of blocks managable. Even the ones not